@@ -0,0 +1,304 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+// Encodes known images with UBlockCompressor, decodes them back with a
+// reference BC1/BC3 decoder and checks the worst channel error of every case
+// against what the encoder's bounding box endpoints should reach. Also checks
+// that edge blocks repeat the last row/column and that nothing is written
+// past GetDataSize().
+// usage: 56_CefBlockCheck
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "../UBlockCompressor.h"
+
+//=============================================================================
+//=============================================================================
+#define CHECK_COMPONENTS    4
+#define CHECK_GUARD         0xcd
+#define CHECK_GUARD_BYTES   16
+
+// rgb565 truncates 3 bits of red and blue
+#define CHECK_QUANT_ERROR   7
+
+//=============================================================================
+//=============================================================================
+static void UnpackRGB565(unsigned short c, int *rgb)
+{
+    rgb[0] = ((c >> 11) & 0x1f) * 255 / 31;
+    rgb[1] = ((c >> 5) & 0x3f) * 255 / 63;
+    rgb[2] = (c & 0x1f) * 255 / 31;
+}
+
+static void DecodeColorBlock(const unsigned char *src, unsigned char *block)
+{
+    unsigned short c0 = (unsigned short)(src[0] | (src[1] << 8));
+    unsigned short c1 = (unsigned short)(src[2] | (src[3] << 8));
+    unsigned indices = src[4] | (src[5] << 8) | (src[6] << 16) | ((unsigned)src[7] << 24);
+    int palette[4][3];
+
+    UnpackRGB565(c0, palette[0]);
+    UnpackRGB565(c1, palette[1]);
+
+    for ( int c = 0; c < 3; ++c )
+    {
+        if ( c0 > c1 )
+        {
+            palette[2][c] = (2*palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2*palette[1][c]) / 3;
+        }
+        else
+        {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+
+    for ( int i = 0; i < 16; ++i )
+    {
+        const int *color = palette[(indices >> (i*2)) & 3];
+
+        for ( int c = 0; c < 3; ++c )
+        {
+            block[i*CHECK_COMPONENTS + c] = (unsigned char)color[c];
+        }
+    }
+}
+
+static void DecodeAlphaBlock(const unsigned char *src, unsigned char *block)
+{
+    int a0 = src[0];
+    int a1 = src[1];
+    unsigned long long indices = 0;
+    int palette[8];
+
+    for ( int i = 0; i < 6; ++i )
+    {
+        indices |= (unsigned long long)src[2 + i] << (i*8);
+    }
+
+    palette[0] = a0;
+    palette[1] = a1;
+
+    if ( a0 > a1 )
+    {
+        for ( int i = 1; i < 7; ++i )
+        {
+            palette[i + 1] = ((7 - i)*a0 + i*a1) / 7;
+        }
+    }
+    else
+    {
+        for ( int i = 1; i < 5; ++i )
+        {
+            palette[i + 1] = ((5 - i)*a0 + i*a1) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    for ( int i = 0; i < 16; ++i )
+    {
+        block[i*CHECK_COMPONENTS + 3] = (unsigned char)palette[(indices >> (i*3)) & 7];
+    }
+}
+
+// decoded rgba of width*height, alpha is 255 for dxt1
+static void Decode(BlockFormat format, const unsigned char *src, int width, int height, std::vector<unsigned char> &rgba)
+{
+    unsigned char block[16*CHECK_COMPONENTS];
+
+    rgba.assign(width*height*CHECK_COMPONENTS, 0);
+
+    for ( int by = 0; by < height; by += 4 )
+    {
+        for ( int bx = 0; bx < width; bx += 4 )
+        {
+            memset(block, 255, sizeof(block));
+
+            if ( format == BLOCK_DXT5 )
+            {
+                DecodeAlphaBlock(src, block);
+                src += 8;
+            }
+
+            DecodeColorBlock(src, block);
+            src += 8;
+
+            for ( int y = 0; y < 4 && by + y < height; ++y )
+            {
+                for ( int x = 0; x < 4 && bx + x < width; ++x )
+                {
+                    memcpy(&rgba[((by + y)*width + bx + x)*CHECK_COMPONENTS], block + (y*4 + x)*CHECK_COMPONENTS, CHECK_COMPONENTS);
+                }
+            }
+        }
+    }
+}
+
+//=============================================================================
+//=============================================================================
+struct CheckImage
+{
+    CheckImage(int width, int height)
+        : width_(width)
+        , height_(height)
+        , rgba_(width*height*CHECK_COMPONENTS, 255)
+    {
+    }
+
+    void Set(int x, int y, int r, int g, int b, int a)
+    {
+        unsigned char *pixel = &rgba_[(y*width_ + x)*CHECK_COMPONENTS];
+        pixel[0] = (unsigned char)r;
+        pixel[1] = (unsigned char)g;
+        pixel[2] = (unsigned char)b;
+        pixel[3] = (unsigned char)a;
+    }
+
+    int                         width_;
+    int                         height_;
+    std::vector<unsigned char>  rgba_;
+};
+
+static bool RunCase(const char *name, BlockFormat format, const CheckImage &image, int maxError)
+{
+    unsigned dataSize = UBlockCompressor::GetDataSize(format, image.width_, image.height_);
+    std::vector<unsigned char> blocks(dataSize + CHECK_GUARD_BYTES, CHECK_GUARD);
+    std::vector<unsigned char> decoded;
+
+    if ( !UBlockCompressor::Compress(format, &image.rgba_[0], image.width_, image.height_, &blocks[0]) )
+    {
+        printf("%-24s compress failed\n", name);
+        return false;
+    }
+
+    for ( unsigned i = dataSize; i < blocks.size(); ++i )
+    {
+        if ( blocks[i] != CHECK_GUARD )
+        {
+            printf("%-24s wrote past %u bytes\n", name, dataSize);
+            return false;
+        }
+    }
+
+    Decode(format, &blocks[0], image.width_, image.height_, decoded);
+
+    int error = 0;
+
+    for ( unsigned i = 0; i < decoded.size(); ++i )
+    {
+        int diff = abs((int)decoded[i] - (int)image.rgba_[i]);
+        error = diff > error ? diff : error;
+    }
+
+    bool ok = error <= maxError;
+    printf("%-24s %s %3dx%-3d max error %3d (limit %3d) %s\n", name, format == BLOCK_DXT1 ? "dxt1" : "dxt5",
+           image.width_, image.height_, error, maxError, ok ? "ok" : "FAILED");
+
+    return ok;
+}
+
+//=============================================================================
+//=============================================================================
+int main(int, char **)
+{
+    int failed = 0;
+
+    // one color, index 0 only
+    {
+        CheckImage image(4, 4);
+        for ( int i = 0; i < 16; ++i )
+            image.Set(i % 4, i / 4, 200, 100, 50, 255);
+        failed += !RunCase("solid", BLOCK_DXT1, image, CHECK_QUANT_ERROR);
+    }
+
+    // endpoints only, both exact in rgb565
+    {
+        CheckImage image(4, 4);
+        for ( int i = 0; i < 16; ++i )
+            image.Set(i % 4, i / 4, ((i + i/4) & 1) ? 255 : 0, ((i + i/4) & 1) ? 255 : 0, ((i + i/4) & 1) ? 255 : 0, 255);
+        failed += !RunCase("checker", BLOCK_DXT1, image, 0);
+    }
+
+    // four grays that fall on the palette
+    {
+        CheckImage image(4, 4);
+        for ( int i = 0; i < 16; ++i )
+            image.Set(i % 4, i / 4, (i % 4)*85, (i % 4)*85, (i % 4)*85, 255);
+        failed += !RunCase("palette ramp", BLOCK_DXT1, image, 1);
+    }
+
+    // smooth gradient, nearest of 4 steps over a range of 60
+    {
+        CheckImage image(4, 4);
+        for ( int i = 0; i < 16; ++i )
+            image.Set(i % 4, i / 4, 100 + i*4, 40 + i*4, 20, 255);
+        failed += !RunCase("gradient", BLOCK_DXT1, image, 60/6 + CHECK_QUANT_ERROR);
+    }
+
+    // one translucent color, alpha is an endpoint
+    {
+        CheckImage image(4, 4);
+        for ( int i = 0; i < 16; ++i )
+            image.Set(i % 4, i / 4, 16, 32, 64, 128);
+        failed += !RunCase("solid translucent", BLOCK_DXT5, image, CHECK_QUANT_ERROR);
+    }
+
+    // 16 alphas over the full range, nearest of 8 steps
+    {
+        CheckImage image(4, 4);
+        for ( int i = 0; i < 16; ++i )
+            image.Set(i % 4, i / 4, 255, 255, 255, i*17);
+        failed += !RunCase("alpha ramp", BLOCK_DXT5, image, 255/14 + 1);
+    }
+
+    // edge blocks repeat the last column/row, a 5th column of another color
+    // makes a solid block only when that's done right
+    {
+        CheckImage image(5, 6);
+        for ( int y = 0; y < 6; ++y )
+            for ( int x = 0; x < 5; ++x )
+                image.Set(x, y, x < 4 ? 240 : 16, x < 4 ? 16 : 240, y < 4 ? 128 : 64, x < 4 ? 255 : 64);
+        failed += !RunCase("edge 5x6", BLOCK_DXT5, image, CHECK_QUANT_ERROR);
+    }
+
+    // a page sized frame, only checks it stays inside its blocks
+    {
+        CheckImage image(333, 77);
+        for ( int y = 0; y < 77; ++y )
+            for ( int x = 0; x < 333; ++x )
+                image.Set(x, y, (x*7) & 0xff, (y*13) & 0xff, (x + y) & 0xff, 255);
+        failed += !RunCase("frame 333x77", BLOCK_DXT1, image, 255);
+    }
+
+    if ( failed )
+    {
+        printf("%d case(s) failed\n", failed);
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,227 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Sample reader of the frames exported by UFrameShmSink.
+// usage: 56_CefFrameReader <name> [seconds]
+//
+// Maps the ring read-only, follows the latest published frame and checks it
+// in place. Reports skipped frames (reader too slow, expected), overruns
+// (slot rewritten while reading, dropped by the sequence check), torn
+// frames (checksum mismatch after a clean sequence check, a real error) and
+// rejected frames (bigger than their slot, a real error, never read).
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <chrono>
+#include <thread>
+
+#include "../UFrameShm.h"
+
+//=============================================================================
+//=============================================================================
+static const FrameShmHeader* MapFrames(const std::string &name, unsigned &mapBytes)
+{
+    void *mem = NULL;
+
+    #if defined(_WIN32)
+    HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, ("Local\\" + name).c_str());
+    if ( mapping == NULL )
+    {
+        return NULL;
+    }
+
+    mem = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    mapBytes = 0;
+
+    MEMORY_BASIC_INFORMATION info;
+    if ( mem && VirtualQuery(mem, &info, sizeof(info)) )
+    {
+        mapBytes = (unsigned)info.RegionSize;
+    }
+    #else
+    int fd = shm_open(("/" + name).c_str(), O_RDONLY, 0);
+    if ( fd < 0 )
+    {
+        return NULL;
+    }
+
+    off_t size = lseek(fd, 0, SEEK_END);
+    mapBytes = (unsigned)size;
+    mem = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if ( mem == MAP_FAILED )
+    {
+        mem = NULL;
+    }
+    #endif
+
+    return (const FrameShmHeader*)mem;
+}
+
+int main(int argc, char **argv)
+{
+    if ( argc < 2 )
+    {
+        printf("usage: %s <name> [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    std::string name = argv[1];
+    int seconds = ( argc > 2 ) ? atoi(argv[2]) : 10;
+    unsigned mapBytes = 0;
+
+    const FrameShmHeader *header = MapFrames(name, mapBytes);
+
+    if ( header == NULL )
+    {
+        printf("can't map %s\n", name.c_str());
+        return 1;
+    }
+
+    if ( header->magic_ != FRAMESHM_MAGIC || header->version_ != FRAMESHM_VERSION )
+    {
+        printf("%s isn't a frame ring (magic %08x, version %u)\n", name.c_str(), header->magic_, header->version_);
+        return 1;
+    }
+
+    // every slot the header describes has to be inside the mapping
+    unsigned long long ringBytes = header->headerBytes_ + (unsigned long long)header->numSlots_*header->slotBytes_;
+
+    if ( header->numSlots_ == 0 || header->numSlots_ > FRAMESHM_SLOTS ||
+         header->headerBytes_ < sizeof(FrameShmHeader) || ringBytes > mapBytes )
+    {
+        printf("%s has a bad layout (%u slots of %u bytes, %u header bytes, %u mapped)\n",
+               name.c_str(), header->numSlots_, header->slotBytes_, header->headerBytes_, mapBytes);
+        return 1;
+    }
+
+    const unsigned char *pixels = (const unsigned char*)header + header->headerBytes_;
+
+    unsigned lastPublished = 0;
+    unsigned lastFrame = 0;
+    unsigned frames = 0, skipped = 0, overruns = 0, torn = 0, rejected = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point report = start;
+
+    while ( std::chrono::steady_clock::now() - start < std::chrono::seconds(seconds) )
+    {
+        unsigned published = header->published_;
+
+        if ( published == lastPublished )
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        FRAMESHM_BARRIER();
+        unsigned index = header->latestSlot_;
+
+        if ( index >= header->numSlots_ )
+        {
+            ++rejected;
+            lastPublished = published;
+            continue;
+        }
+
+        const FrameShmSlot &slot = header->slots_[index];
+
+        unsigned sequence = slot.sequence_;
+        FRAMESHM_BARRIER();
+
+        if ( sequence & 1 )
+        {
+            continue;
+        }
+
+        // use the pixels in place, here just the checksum. A frame that
+        // claims more than its slot is never read
+        unsigned frameNumber = slot.frameNumber_;
+        int height = slot.height_;
+        unsigned long long frameBytes = (unsigned long long)slot.rowBytes_*(unsigned)height;
+
+        if ( height < 0 || frameBytes > header->slotBytes_ )
+        {
+            FRAMESHM_BARRIER();
+
+            // sizes read while the slot was rewritten are just an overrun
+            if ( slot.sequence_ != sequence )
+            {
+                ++overruns;
+                continue;
+            }
+
+            ++rejected;
+            lastPublished = published;
+            printf("rejected frame %u, %llu bytes in a %u byte slot\n", frameNumber, frameBytes, header->slotBytes_);
+            continue;
+        }
+
+        unsigned size = (unsigned)frameBytes;
+        unsigned checksum = slot.checksum_;
+        unsigned actual = FrameShmChecksum(pixels + index*header->slotBytes_, size);
+
+        FRAMESHM_BARRIER();
+
+        if ( slot.sequence_ != sequence )
+        {
+            ++overruns;
+            continue;
+        }
+
+        if ( actual != checksum )
+        {
+            ++torn;
+            printf("torn frame %u\n", frameNumber);
+        }
+
+        if ( lastFrame && frameNumber > lastFrame + 1 )
+        {
+            skipped += frameNumber - lastFrame - 1;
+        }
+
+        lastFrame = frameNumber;
+        lastPublished = published;
+        ++frames;
+
+        if ( std::chrono::steady_clock::now() - report >= std::chrono::seconds(1) )
+        {
+            printf("frames %u, skipped %u, overruns %u, torn %u, rejected %u, %dx%d\n", frames, skipped, overruns, torn, rejected, slot.width_, slot.height_);
+            report = std::chrono::steady_clock::now();
+        }
+    }
+
+    printf("total: frames %u, skipped %u, overruns %u, torn %u, rejected %u\n", frames, skipped, overruns, torn, rejected);
+
+    return ( torn || rejected ) ? 2 : 0;
+}
+
@@ -0,0 +1,517 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Microbenchmark of the router's query bookkeeping, CefBrowserInfoMap
+// against the std::map of std::maps it replaced, with pooled and heap
+// allocated records. Both maps run the same operations and must agree, then
+// adds from inside a visit are checked to fail rather than move slots.
+// Single runs vary by 20% and more on a shared machine, compare medians.
+// usage: 56_CefInfoMapBench [operations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <map>
+#include <vector>
+
+#include "libcef_dll/wrapper/cef_browser_info_map.h"
+
+//=============================================================================
+//=============================================================================
+#define BENCH_BROWSERS      4
+#define BENCH_PERSISTENT    64      // long lived queries per browser
+#define BENCH_INFLIGHT      256     // short queries in flight per browser
+
+struct HeapQuery
+{
+    int64 id_;
+    bool  persistent_;
+    void  *callback_;
+    void  *handler_;
+};
+
+struct PooledQuery
+{
+    int64 id_;
+    bool  persistent_;
+    void  *callback_;
+    void  *handler_;
+
+    CEF_INFO_RECORD_POOLED(PooledQuery)
+};
+
+// The map of maps CefBrowserInfoMap used to be, kept as the baseline.
+template <typename IdType,
+          typename ObjectType,
+          typename Traits = DefaultCefBrowserInfoMapTraits<ObjectType> >
+class LegacyBrowserInfoMap {
+ public:
+  // Implement this interface to visit and optionally delete objects in the map.
+  class Visitor {
+   public:
+    typedef IdType InfoIdType;
+    typedef ObjectType InfoObjectType;
+
+    // Called once for each info object. Set |remove| to true to remove the
+    // object from the map. It is safe to destruct removed objects in this
+    // callback. Return true to continue iterating or false to stop iterating.
+    virtual bool OnNextInfo(int browser_id,
+                            InfoIdType info_id,
+                            InfoObjectType info,
+                            bool* remove) =0;
+
+   protected:
+    virtual ~Visitor() {}
+  };
+
+  LegacyBrowserInfoMap() {}
+
+  ~LegacyBrowserInfoMap() {
+    clear();
+  }
+
+  // Add an object associated with the specified ID values.
+  void Add(int browser_id, IdType info_id, ObjectType info) {
+    InfoMap* info_map = NULL;
+    typename BrowserInfoMap::const_iterator it_browser =
+        browser_info_map_.find(browser_id);
+    if (it_browser == browser_info_map_.end()) {
+      // No InfoMap exists for the browser ID so create it.
+      info_map = new InfoMap;
+      browser_info_map_.insert(std::make_pair(browser_id, info_map));
+    } else {
+      info_map = it_browser->second;
+      // The specified ID should not already exist in the map.
+      DCHECK(info_map->find(info_id) == info_map->end());
+    }
+
+    info_map->insert(std::make_pair(info_id, info));
+  }
+
+  // Find the object with the specified ID values. |visitor| can optionally be
+  // used to evaluate or remove the object at the same time. If the object is
+  // removed using the Visitor the caller is responsible for destroying it.
+  ObjectType Find(int browser_id, IdType info_id, Visitor* vistor) {
+    if (browser_info_map_.empty())
+      return ObjectType();
+
+    typename BrowserInfoMap::iterator it_browser =
+        browser_info_map_.find(browser_id);
+    if (it_browser == browser_info_map_.end())
+      return ObjectType();
+
+    InfoMap* info_map = it_browser->second;
+    typename InfoMap::iterator it_info = info_map->find(info_id);
+    if (it_info == info_map->end())
+      return ObjectType();
+
+    ObjectType info = it_info->second;
+
+    bool remove = false;
+    if (vistor)
+      vistor->OnNextInfo(browser_id, it_info->first, info, &remove);
+    if (remove) {
+      info_map->erase(it_info);
+
+      if (info_map->empty()) {
+        // No more entries in the InfoMap so remove it.
+        browser_info_map_.erase(it_browser);
+        delete info_map;
+      }
+    }
+
+    return info;
+  }
+
+  // Find all objects. If any objects are removed using the Visitor the caller
+  // is responsible for destroying them.
+  void FindAll(Visitor* visitor) {
+    DCHECK(visitor);
+
+    if (browser_info_map_.empty())
+      return;
+
+    bool remove, keepgoing = true;
+
+    typename BrowserInfoMap::iterator it_browser = browser_info_map_.begin();
+    while (it_browser != browser_info_map_.end()) {
+      InfoMap* info_map = it_browser->second;
+
+      typename InfoMap::iterator it_info = info_map->begin();
+      while (it_info != info_map->end()) {
+        remove = false;
+        keepgoing = visitor->OnNextInfo(it_browser->first, it_info->first,
+                                        it_info->second, &remove);
+
+        if (remove)
+          info_map->erase(it_info++);
+        else
+          ++it_info;
+
+        if (!keepgoing)
+          break;
+      }
+
+      if (info_map->empty()) {
+        // No more entries in the InfoMap so remove it.
+        browser_info_map_.erase(it_browser++);
+        delete info_map;
+      } else {
+        ++it_browser;
+      }
+
+      if (!keepgoing)
+        break;
+    }
+  }
+
+  // Find all objects associated with the specified browser. If any objects are
+  // removed using the Visitor the caller is responsible for destroying them.
+  void FindAll(int browser_id, Visitor* visitor) {
+    DCHECK(visitor);
+
+    if (browser_info_map_.empty())
+      return;
+
+    typename BrowserInfoMap::iterator it_browser =
+        browser_info_map_.find(browser_id);
+    if (it_browser == browser_info_map_.end())
+      return;
+
+    InfoMap* info_map = it_browser->second;
+    bool remove, keepgoing;
+
+    typename InfoMap::iterator it_info = info_map->begin();
+    while (it_info != info_map->end()) {
+      remove = false;
+      keepgoing = visitor->OnNextInfo(browser_id, it_info->first,
+                                      it_info->second, &remove);
+
+      if (remove)
+        info_map->erase(it_info++);
+      else
+        ++it_info;
+
+      if (!keepgoing)
+        break;
+    }
+
+    if (info_map->empty()) {
+      // No more entries in the InfoMap so remove it.
+      browser_info_map_.erase(it_browser);
+      delete info_map;
+    }
+  }
+
+  // Returns true if the map is empty.
+  bool empty() const { return browser_info_map_.empty(); }
+
+  // Returns the number of objects in the map.
+  size_t size() const {
+    if (browser_info_map_.empty())
+      return 0;
+
+    size_t size = 0;
+    typename BrowserInfoMap::const_iterator it_browser =
+        browser_info_map_.begin();
+    for (; it_browser != browser_info_map_.end(); ++it_browser)
+      size += it_browser->second->size();
+    return size;
+  }
+
+  // Returns the number of objects in the map that are associated with the
+  // specified browser.
+  size_t size(int browser_id) const {
+    if (browser_info_map_.empty())
+      return 0;
+
+    typename BrowserInfoMap::const_iterator it_browser =
+        browser_info_map_.find(browser_id);
+    if (it_browser != browser_info_map_.end())
+      return it_browser->second->size();
+
+    return 0;
+  }
+
+  // Remove all objects from the map. The objects will be destructed.
+  void clear() {
+    if (browser_info_map_.empty())
+      return;
+
+    typename BrowserInfoMap::const_iterator it_browser =
+        browser_info_map_.begin();
+    for (; it_browser != browser_info_map_.end(); ++it_browser) {
+      InfoMap* info_map = it_browser->second;
+      typename InfoMap::const_iterator it_info = info_map->begin();
+      for (; it_info != info_map->end(); ++it_info)
+        Traits::Destruct(it_info->second);
+      delete info_map;
+    }
+    browser_info_map_.clear();
+  }
+
+  // Remove all objects from the map that are associated with the specified
+  // browser. The objects will be destructed.
+  void clear(int browser_id) {
+    if (browser_info_map_.empty())
+      return;
+
+    typename BrowserInfoMap::iterator it_browser =
+        browser_info_map_.find(browser_id);
+    if (it_browser == browser_info_map_.end())
+      return;
+
+    InfoMap* info_map = it_browser->second;
+    typename InfoMap::const_iterator it_info = info_map->begin();
+    for (; it_info != info_map->end(); ++it_info)
+      Traits::Destruct(it_info->second);
+
+    browser_info_map_.erase(it_browser);
+    delete info_map;
+  }
+
+ private:
+  // Map IdType to ObjectType instance.
+  typedef std::map<IdType, ObjectType> InfoMap;
+  // Map browser ID to InfoMap instance.
+  typedef std::map<int, InfoMap*> BrowserInfoMap;
+
+  BrowserInfoMap browser_info_map_;
+
+  DISALLOW_COPY_AND_ASSIGN(LegacyBrowserInfoMap);
+};
+
+//=============================================================================
+//=============================================================================
+// the router's GetQueryInfo(): remove unless persistent
+template <typename MapType, typename QueryType>
+class TakeVisitor : public MapType::Visitor
+{
+public:
+    virtual bool OnNextInfo(int browser_id, int64 info_id, QueryType *info, bool *remove)
+    {
+        *remove = !info->persistent_;
+        return true;
+    }
+};
+
+// the router's GetPendingCount() with a handler
+template <typename MapType, typename QueryType>
+class CountVisitor : public MapType::Visitor
+{
+public:
+    CountVisitor() : count_(0) {}
+
+    virtual bool OnNextInfo(int browser_id, int64 info_id, QueryType *info, bool *remove)
+    {
+        count_ += info->persistent_ ? 1 : 0;
+        return true;
+    }
+
+    unsigned count_;
+};
+
+// the workload of a hud with persistent subscriptions and a flood of short
+// queries answered in roughly the order they were sent
+template <typename MapType, typename QueryType>
+static double RunBench(unsigned operations, unsigned long long &checksum)
+{
+    MapType map;
+    TakeVisitor<MapType, QueryType> take;
+    std::vector<int64> inflight[BENCH_BROWSERS];
+    int64 nextId = 0;
+    unsigned seed = 1;
+
+    checksum = 0;
+
+    for ( int b = 0; b < BENCH_BROWSERS; ++b )
+    {
+        for ( int i = 0; i < BENCH_PERSISTENT; ++i )
+        {
+            QueryType *query = new QueryType();
+            query->id_ = ++nextId;
+            query->persistent_ = true;
+            map.Add(b + 1, query->id_, query);
+        }
+    }
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+    for ( unsigned op = 0; op < operations; ++op )
+    {
+        seed = seed*1103515245U + 12345U;
+        int b = (seed >> 16) % BENCH_BROWSERS;
+        std::vector<int64> &queue = inflight[b];
+
+        if ( queue.size() < BENCH_INFLIGHT )
+        {
+            QueryType *query = new QueryType();
+            query->id_ = ++nextId;
+            query->persistent_ = false;
+            map.Add(b + 1, query->id_, query);
+            queue.push_back(query->id_);
+        }
+
+        // answer one, mostly the oldest
+        if ( queue.size() >= BENCH_INFLIGHT/2 )
+        {
+            size_t at = ((seed >> 8) & 7) == 0 ? queue.size() - 1 : 0;
+            int64 id = queue[at];
+            queue.erase(queue.begin() + at);
+
+            QueryType *query = map.Find(b + 1, id, &take);
+            if ( query )
+            {
+                checksum += (unsigned long long)query->id_;
+                delete query;
+            }
+        }
+
+        // persistent answers
+        if ( (op & 3) == 0 )
+        {
+            int64 id = 1 + (int64)((seed >> 4) % (BENCH_BROWSERS*BENCH_PERSISTENT));
+            int owner = (int)((id - 1)/BENCH_PERSISTENT) + 1;
+            QueryType *query = map.Find(owner, id, &take);
+            checksum += query ? (unsigned long long)query->id_ * 3 : 0;
+        }
+
+        // pending counts
+        if ( (op & 1023) == 0 )
+        {
+            CountVisitor<MapType, QueryType> count;
+            map.FindAll(b + 1, &count);
+            checksum += count.count_ + map.size(b + 1) + map.size();
+        }
+    }
+
+    std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+
+    checksum += map.size();
+    map.clear();
+
+    return std::chrono::duration<double, std::nano>(end - start).count()/operations;
+}
+
+//=============================================================================
+//=============================================================================
+// adds from inside a visit until the table has no room left
+class AddVisitor : public CefBrowserInfoMap<int64, HeapQuery*>::Visitor
+{
+public:
+    AddVisitor(CefBrowserInfoMap<int64, HeapQuery*> &map, int64 nextId)
+        : map_(map)
+        , nextId_(nextId)
+        , added_(0)
+        , failed_(false)
+    {
+    }
+
+    virtual bool OnNextInfo(int browser_id, int64 info_id, HeapQuery *info, bool *remove)
+    {
+        while ( !failed_ )
+        {
+            HeapQuery *query = new HeapQuery();
+            query->id_ = nextId_;
+
+            if ( map_.Add(browser_id, query->id_, query) )
+            {
+                ++nextId_;
+                ++added_;
+            }
+            else
+            {
+                delete query;
+                failed_ = true;
+            }
+        }
+        return true;
+    }
+
+    CefBrowserInfoMap<int64, HeapQuery*>    &map_;
+    int64                                   nextId_;
+    unsigned                                added_;
+    bool                                    failed_;
+};
+
+// slots must not move under a visitor that adds, adds fail instead
+static bool CheckVisitAdd()
+{
+    CefBrowserInfoMap<int64, HeapQuery*> map;
+    int64 id = 0;
+
+    // just below the grow threshold of the first table
+    for ( ; id < 11; ++id )
+    {
+        HeapQuery *query = new HeapQuery();
+        query->id_ = id;
+        map.Add(1, id, query);
+    }
+
+    AddVisitor visitor(map, id);
+    map.FindAll(&visitor);
+
+    bool ok = visitor.added_ > 0 && visitor.failed_ && map.size() == (size_t)visitor.nextId_;
+
+    for ( int64 i = 0; i < visitor.nextId_ && ok; ++i )
+    {
+        HeapQuery *query = map.Find(1, i, NULL);
+        ok = query && query->id_ == i;
+    }
+
+    // and the table grows again once the visit is over
+    HeapQuery *query = new HeapQuery();
+    query->id_ = visitor.nextId_;
+    ok = ok && map.Add(1, query->id_, query) && map.size() == (size_t)visitor.nextId_ + 1;
+
+    printf("adds during a visit: %u before the table was full, %s\n", visitor.added_, ok ? "ok" : "FAILED");
+
+    return ok;
+}
+
+//=============================================================================
+//=============================================================================
+int main(int argc, char **argv)
+{
+    unsigned operations = argc > 1 ? (unsigned)atoi(argv[1]) : 2000000;
+    unsigned long long sums[4];
+    double ns[4];
+
+    ns[0] = RunBench<LegacyBrowserInfoMap<int64, HeapQuery*>, HeapQuery>(operations, sums[0]);
+    ns[1] = RunBench<LegacyBrowserInfoMap<int64, PooledQuery*>, PooledQuery>(operations, sums[1]);
+    ns[2] = RunBench<CefBrowserInfoMap<int64, HeapQuery*>, HeapQuery>(operations, sums[2]);
+    ns[3] = RunBench<CefBrowserInfoMap<int64, PooledQuery*>, PooledQuery>(operations, sums[3]);
+
+    printf("std::map,     heap records:   %7.1f ns/op\n", ns[0]);
+    printf("std::map,     pooled records: %7.1f ns/op\n", ns[1]);
+    printf("open address, heap records:   %7.1f ns/op\n", ns[2]);
+    printf("open address, pooled records: %7.1f ns/op\n", ns[3]);
+    printf("pool slabs: %u KB\n", (unsigned)(CefInfoRecordPool<PooledQuery>::GetSlabBytes()/1024));
+
+    if ( sums[0] != sums[1] || sums[0] != sums[2] || sums[0] != sums[3] )
+    {
+        printf("mismatch: %llu %llu %llu %llu\n", sums[0], sums[1], sums[2], sums[3]);
+        return 1;
+    }
+
+    return CheckVisitAdd() ? 0 : 1;
+}
@@ -46,7 +46,14 @@
 
 #include "Main.h"
 #include "simple_app.h"
+#include "simple_render_app.h"
 #include "UCefApp.h"
+#include "UFrameNetClient.h"
+#include "UCefQueryBridge.h"
+#include "UCefPubSub.h"
+#include "UCefValueConv.h"
+#include "UNativeBindings.h"
+#include "UFrameRateScheduler.h"
 
 #include <Urho3D/DebugNew.h>
 
@@ -71,13 +78,23 @@ CharacterDemo::CharacterDemo(Context* context)
     // CEF applications have multiple sub-processes (render, plugin, GPU, etc)
     // that share the same executable. This function checks the command-line and,
     // if this is a sub-process, executes the appropriate logic.
-    int exit_code = CefExecuteProcess(main_args, NULL, NULL);
+    // the render process installs the cefQuery router, both processes need
+    // the same window.urho bindings
+    RegisterNativeBindings();
+    CefRefPtr<SimpleRenderApp> renderApp = new SimpleRenderApp();
+    int exit_code = CefExecuteProcess(main_args, renderApp.get(), NULL);
 }
 
 //=============================================================================
 //=============================================================================
 CharacterDemo::~CharacterDemo()
 {
+    if ( frameNetClient_ )
+    {
+        frameNetClient_->Disconnect();
+        frameNetClient_ = NULL;
+    }
+
     if ( uCefApp_ )
     {
         uCefApp_->DestroyAppBrowser();
@@ -277,7 +294,7 @@ void CharacterDemo::CreateInstructions()
     // fps text
     fpsText_  = ui->GetRoot()->CreateChild<Text>();
     fpsText_->SetFont(cache->GetResource<Font>("Fonts/Anonymous Pro.ttf"), 15);
-    fpsText_->SetPosition(graphics->GetWidth() - 100, 5);
+    fpsText_->SetPosition(graphics->GetWidth() - 160, 5);
     fpsText_->SetColor(Color::YELLOW);
 
     UIElement* root = ui->GetRoot();
@@ -327,11 +344,156 @@ void CharacterDemo::HandleUpdate(StringHash eventType, VariantMap& eventData)
     }
 
     //*********************************************
-    if (input->GetKeyPress(KEY_F5) && uCefApp_ == NULL)
+    if (input->GetKeyPress(KEY_F5) && uCefApp_ == NULL && frameNetClient_ == NULL)
     {
-        uCefApp_ = new UCefApp(context_);
-        uCefApp_->CreateAppBrowser();
-        cefAppCreatedOnce_ = true;
+        // --bake-url=<url> shows a baked page or bakes it on the first run
+        // --frame-shm=<name> exports the frames to a shared memory ring
+        // --frame-server=<port> replicates the frames to networked clients
+        // --frame-client=<host>:<port> shows a replicated browser without cef,
+        //   both together on one instance is a loopback test
+        // --query-bench opens a page that floods cefQuery, stats are logged
+        // --pubsub-bench publishes hud-like topics every frame to a page
+        //   that subscribes to them, per topic stats are logged
+        // --value-bench round trips VariantMaps through CefListValues and
+        //   times the layout conversion against the naive one, once, a failed
+        //   round trip is logged
+        // --binding-bench times urho.add() against the same call as json over
+        //   cefQuery, native calls/sec are logged
+        // --compress-idle block compresses the page while it doesn't paint
+        // --framerate-check checks that a browser given input gets the focused
+        //   frame rate role, the result is logged
+        String bakeUrl;
+        String frameShm;
+        String frameClient;
+        unsigned frameServerPort = 0;
+        bool queryBench = false;
+        bool pubsubBench = false;
+        bool bindingBench = false;
+        bool frameRateCheck = false;
+        bool compressIdle = false;
+        bool valueBench = false;
+        const Vector<String> &args = GetArguments();
+        for ( unsigned i = 0; i < args.Size(); ++i )
+        {
+            if ( args[i].StartsWith("--bake-url=") )
+            {
+                bakeUrl = args[i].Substring(11);
+            }
+            else if ( args[i].StartsWith("--frame-shm=") )
+            {
+                frameShm = args[i].Substring(12);
+            }
+            else if ( args[i].StartsWith("--frame-server=") )
+            {
+                frameServerPort = ToUInt(args[i].Substring(15));
+            }
+            else if ( args[i].StartsWith("--frame-client=") )
+            {
+                frameClient = args[i].Substring(15);
+            }
+            else if ( args[i] == "--query-bench" )
+            {
+                queryBench = true;
+            }
+            else if ( args[i] == "--pubsub-bench" )
+            {
+                pubsubBench = true;
+            }
+            else if ( args[i] == "--binding-bench" )
+            {
+                bindingBench = true;
+            }
+            else if ( args[i] == "--framerate-check" )
+            {
+                frameRateCheck = true;
+            }
+            else if ( args[i] == "--compress-idle" )
+            {
+                compressIdle = true;
+            }
+            else if ( args[i] == "--value-bench" )
+            {
+                valueBench = true;
+            }
+        }
+
+        if ( valueBench && !RunValueConvBench(2000) )
+        {
+            SDL_Log("value conv: round trip FAILED, see the mismatches above");
+        }
+
+        if ( frameClient.Empty() || frameServerPort )
+        {
+            uCefApp_ = new UCefApp(context_);
+
+            if ( queryBench )
+            {
+                uCefApp_->SetStartUrl(UCefQueryBridge::GetBenchmarkUrl());
+            }
+            else if ( pubsubBench )
+            {
+                uCefApp_->SetStartUrl(UCefPubSub::GetBenchmarkUrl());
+            }
+            else if ( bindingBench )
+            {
+                uCefApp_->SetStartUrl(UNativeBindings::GetBenchmarkUrl());
+            }
+
+            uCefApp_->CreateAppBrowser(bakeUrl);
+
+            if ( queryBench && GetSubsystem<UCefQueryBridge>() )
+            {
+                GetSubsystem<UCefQueryBridge>()->EnableBenchmark();
+            }
+
+            if ( pubsubBench && GetSubsystem<UCefPubSub>() )
+            {
+                GetSubsystem<UCefPubSub>()->EnableBenchmark();
+            }
+
+            if ( bindingBench && GetSubsystem<UNativeBindings>() )
+            {
+                GetSubsystem<UNativeBindings>()->EnableBenchmark();
+            }
+
+            if ( frameRateCheck && GetSubsystem<UFrameRateScheduler>() )
+            {
+                GetSubsystem<UFrameRateScheduler>()->EnableInteractiveCheck();
+            }
+
+            if ( compressIdle )
+            {
+                uCefApp_->CompressIdlePage(CEFBUF_COMPRESS_IDLE_FRAMES);
+            }
+
+            if ( !frameShm.Empty() )
+            {
+                uCefApp_->ExportFrames(frameShm);
+            }
+
+            if ( frameServerPort )
+            {
+                uCefApp_->ReplicateFrames((unsigned short)frameServerPort);
+            }
+
+            if ( uCefApp_->IsCefStarted() )
+            {
+                cefAppCreatedOnce_ = true;
+            }
+        }
+
+        if ( !frameClient.Empty() )
+        {
+            Vector<String> hostPort = frameClient.Split(':');
+            unsigned port = hostPort.Size() > 1 ? ToUInt(hostPort[1]) : 0;
+
+            frameNetClient_ = new UFrameNetClient(context_);
+
+            if ( port == 0 || !frameNetClient_->Connect(hostPort[0], (unsigned short)port) )
+            {
+                SDL_Log("frame client: can't connect to %s", frameClient.CString());
+            }
+        }
     }
 
     // fps text
@@ -339,7 +501,9 @@ void CharacterDemo::HandleUpdate(StringHash eventType, VariantMap& eventData)
 
     if ( timerFps_.GetMSec(false) > 1000 )
     {
-        fpsText_->SetText(String("fps: ") + String(fpsCounter_));
+        fpsText_->SetText(String("fps: ") + String(fpsCounter_) +
+                          String("\nstaging: ") + String(UCefRenderHandle::GetResidentStagingBytes()/1024) + String("KB") +
+                          String("\nupload: ") + String(UBrowserImage::GetAvgUploadUSec(true)) + String("us"));
         fpsCounter_ = 0;
         timerFps_.Reset();
     }
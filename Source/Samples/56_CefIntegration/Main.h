@@ -37,6 +37,7 @@ class Scene;
 }
 
 class UCefApp;
+class UFrameNetClient;
 class UCefBrowserWin;
 //class Touch;
 
@@ -131,6 +132,7 @@ private:
     bool firstPerson_;
 
     SharedPtr<UCefApp> uCefApp_;
+    SharedPtr<UFrameNetClient> frameNetClient_;
     bool cefAppCreatedOnce_;
 
     // dbg fps
@@ -0,0 +1,322 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+// Throughput of large payloads sent to the renderer, as a CefString argument
+// of the process message against the shared memory ring of UPayloadShm.h.
+// A second thread plays the render process. The message path is modelled by
+// its copies: utf-8 to utf-16 into the CefString, into the ipc message, out
+// of it and into the v8 string. The ring path copies into a block, and the
+// reader converts it in place into the v8 string and releases it.
+// usage: 56_CefPayloadBench [megabytes per size]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "../UPayloadShm.h"
+
+//=============================================================================
+//=============================================================================
+#define BENCH_RING_BYTES    PAYLOADSHM_RING_BYTES
+
+struct BenchMessage
+{
+    std::u16string  text_;      // message path
+    unsigned        offset_;    // ring path
+    unsigned        length_;
+    unsigned        serial_;
+    bool            last_;
+};
+
+// stands in for the ipc channel, only ever holds what's in flight
+class BenchChannel
+{
+public:
+    void Push(BenchMessage &message)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(BenchMessage());
+        queue_.back().text_.swap(message.text_);
+        queue_.back().offset_ = message.offset_;
+        queue_.back().length_ = message.length_;
+        queue_.back().serial_ = message.serial_;
+        queue_.back().last_ = message.last_;
+        ready_.notify_one();
+    }
+
+    void Pop(BenchMessage &message)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this] { return !queue_.empty(); });
+        message.text_.swap(queue_.front().text_);
+        message.offset_ = queue_.front().offset_;
+        message.length_ = queue_.front().length_;
+        message.serial_ = queue_.front().serial_;
+        message.last_ = queue_.front().last_;
+        queue_.pop_front();
+    }
+
+protected:
+    std::mutex                  mutex_;
+    std::condition_variable     ready_;
+    std::deque<BenchMessage>    queue_;
+};
+
+//=============================================================================
+//=============================================================================
+static void Utf8ToUtf16(const char *data, unsigned length, std::u16string &out)
+{
+    out.clear();
+    out.reserve(length);
+
+    for ( unsigned i = 0; i < length; )
+    {
+        unsigned char c = (unsigned char)data[i];
+        unsigned code;
+
+        if ( c < 0x80 )
+        {
+            code = c;
+            i += 1;
+        }
+        else if ( ( c >> 5 ) == 0x6 && i + 1 < length )
+        {
+            code = ( ( c & 0x1f ) << 6 ) | ( data[i + 1] & 0x3f );
+            i += 2;
+        }
+        else if ( ( c >> 4 ) == 0xe && i + 2 < length )
+        {
+            code = ( ( c & 0x0f ) << 12 ) | ( ( data[i + 1] & 0x3f ) << 6 ) | ( data[i + 2] & 0x3f );
+            i += 3;
+        }
+        else if ( ( c >> 3 ) == 0x1e && i + 3 < length )
+        {
+            code = ( ( c & 0x07 ) << 18 ) | ( ( data[i + 1] & 0x3f ) << 12 ) | ( ( data[i + 2] & 0x3f ) << 6 ) | ( data[i + 3] & 0x3f );
+            i += 4;
+        }
+        else
+        {
+            code = 0xfffd;
+            i += 1;
+        }
+
+        if ( code >= 0x10000 )
+        {
+            code -= 0x10000;
+            out.push_back((char16_t)( 0xd800 + ( code >> 10 ) ));
+            out.push_back((char16_t)( 0xdc00 + ( code & 0x3ff ) ));
+        }
+        else
+        {
+            out.push_back((char16_t)code);
+        }
+    }
+}
+
+// leaderboard-like json with some non-ascii names
+static std::string MakePayload(unsigned size)
+{
+    std::string json("[");
+    unsigned rank = 0;
+
+    while ( json.size() + 64 < size )
+    {
+        ++rank;
+        json += "{\"rank\":" + std::to_string(rank) + ",\"name\":\"pl\xc3\xa4yer_" + std::to_string(rank * 7919 % 10007) + "\",\"score\":" + std::to_string(1000000 - rank * 13) + "},";
+    }
+
+    json.resize(size - 1, ' ');
+    json += ']';
+    return json;
+}
+
+static unsigned long long Checksum(const std::u16string &text)
+{
+    unsigned long long sum = text.size();
+
+    for ( size_t i = 0; i < text.size(); i += 61 )
+    {
+        sum = sum * 31 + text[i];
+    }
+
+    return sum;
+}
+
+//=============================================================================
+//=============================================================================
+static double RunMessages(const std::string &payload, unsigned count, unsigned long long &sum)
+{
+    BenchChannel channel;
+    sum = 0;
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+    std::thread renderer([&]
+    {
+        BenchMessage message;
+        std::u16string v8;
+
+        do
+        {
+            channel.Pop(message);
+
+            // out of the ipc message, then into the v8 string
+            std::u16string argument(message.text_);
+            v8.assign(argument);
+            sum += Checksum(v8);
+        }
+        while ( !message.last_ );
+    });
+
+    for ( unsigned i = 0; i < count; ++i )
+    {
+        // CefString from the std::string, then serialized into the message
+        std::u16string argument;
+        Utf8ToUtf16(payload.data(), (unsigned)payload.size(), argument);
+
+        BenchMessage message;
+        message.text_ = argument;
+        message.offset_ = message.length_ = message.serial_ = 0;
+        message.last_ = i + 1 == count;
+        channel.Push(message);
+    }
+
+    renderer.join();
+
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static double RunRing(const std::string &payload, unsigned count, unsigned long long &sum, unsigned &stalls)
+{
+    PayloadShmWriter writer;
+    std::string name = PayloadShmName("payload_bench_");
+
+    if ( !writer.Create(name, BENCH_RING_BYTES) )
+    {
+        printf("failed to map %s\n", name.c_str());
+        return 0.0;
+    }
+
+    PayloadShmReader reader;
+
+    if ( !reader.Open(name) )
+    {
+        printf("failed to open %s\n", name.c_str());
+        return 0.0;
+    }
+
+    BenchChannel channel;
+    sum = 0;
+    stalls = 0;
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+    std::thread renderer([&]
+    {
+        BenchMessage message;
+        std::u16string v8;
+
+        do
+        {
+            channel.Pop(message);
+
+            const char *data = reader.Acquire(message.offset_, message.length_, message.serial_);
+
+            if ( data == NULL )
+            {
+                printf("stale block at %u\n", message.offset_);
+                sum = 0;
+                return;
+            }
+
+            // straight from the ring into the v8 string
+            Utf8ToUtf16(data, message.length_, v8);
+            if ( !reader.Release(message.offset_, message.serial_) )
+            {
+                printf("block at %u freed while read\n", message.offset_);
+                sum = 0;
+                return;
+            }
+            sum += Checksum(v8);
+        }
+        while ( !message.last_ );
+    });
+
+    for ( unsigned i = 0; i < count; ++i )
+    {
+        BenchMessage message;
+        message.length_ = (unsigned)payload.size();
+        message.last_ = i + 1 == count;
+
+        // the real sender falls back to the message, here it waits to keep
+        // the comparison about the ring
+        while ( !writer.Write(payload.data(), message.length_, 1, message.offset_, message.serial_) )
+        {
+            ++stalls;
+            std::this_thread::yield();
+        }
+
+        channel.Push(message);
+    }
+
+    renderer.join();
+
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+//=============================================================================
+//=============================================================================
+int main(int argc, char **argv)
+{
+    unsigned megabytes = argc > 1 ? (unsigned)atoi(argv[1]) : 256;
+    const unsigned sizes[] = { 16*1024, 256*1024, 2*1024*1024 };
+    int result = 0;
+
+    for ( unsigned s = 0; s < sizeof(sizes)/sizeof(sizes[0]); ++s )
+    {
+        std::string payload = MakePayload(sizes[s]);
+        unsigned count = (unsigned)( (unsigned long long)megabytes*1024*1024 / sizes[s] );
+        unsigned long long sumMessages, sumRing;
+        unsigned stalls = 0;
+
+        double secMessages = RunMessages(payload, count, sumMessages);
+        double secRing = RunRing(payload, count, sumRing, stalls);
+
+        printf("%5u KB x %u: message %7.1f MB/s, ring %7.1f MB/s (%.2fx), ring full %u times\n",
+               sizes[s]/1024, count,
+               megabytes / secMessages, megabytes / secRing, secMessages / secRing, stalls);
+
+        if ( sumMessages != sumRing )
+        {
+            printf("mismatch: %llu %llu\n", sumMessages, sumRing);
+            result = 1;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,241 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Urho3D.h>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Graphics/Texture2D.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/Math/MathDefs.h>
+#include <Urho3D/Resource/Image.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <SDL/SDL_log.h>
+
+#include "UBakedTextureCache.h"
+
+#include <Urho3D/DebugNew.h>
+
+//=============================================================================
+//=============================================================================
+UBakedTextureCache::UBakedTextureCache(Context *context)
+    : Object(context)
+    , resourceDirAdded_(false)
+{
+    SetCacheDir(GetSubsystem<FileSystem>()->GetAppPreferencesDir("urho3d", "cef") + BAKE_CACHE_DIR);
+}
+
+UBakedTextureCache::~UBakedTextureCache()
+{
+}
+
+void UBakedTextureCache::SetCacheDir(const String &cacheDir)
+{
+    ResourceCache *cache = GetSubsystem<ResourceCache>();
+
+    if ( resourceDirAdded_ )
+    {
+        cache->RemoveResourceDir(cacheDir_);
+        resourceDirAdded_ = false;
+    }
+
+    cacheDir_ = AddTrailingSlash(cacheDir);
+    GetSubsystem<FileSystem>()->CreateDir(cacheDir_);
+}
+
+bool UBakedTextureCache::IsBaked(const String &url)
+{
+    return GetSubsystem<FileSystem>()->FileExists(cacheDir_ + GetFileName(url));
+}
+
+Texture2D* UBakedTextureCache::Load(const String &url)
+{
+    String fileName = GetFileName(url);
+
+    if ( !GetSubsystem<FileSystem>()->FileExists(cacheDir_ + fileName) )
+    {
+        return NULL;
+    }
+
+    // the cache dir is searched last so it can't shadow game resources
+    ResourceCache *cache = GetSubsystem<ResourceCache>();
+
+    if ( !resourceDirAdded_ )
+    {
+        cache->AddResourceDir(cacheDir_);
+        resourceDirAdded_ = true;
+    }
+
+    return cache->GetResource<Texture2D>(fileName);
+}
+
+bool UBakedTextureCache::Store(const String &url, const unsigned char *rgba, int width, int height)
+{
+    String fileName = GetFileName(url);
+
+    Image image(context_);
+    image.SetSize(width, height, 4);
+    image.SetData(rgba);
+
+    if ( !image.SavePNG(cacheDir_ + fileName) )
+    {
+        return false;
+    }
+
+    // bakes of older content of the same url are stale now
+    RemoveEntries(url, fileName);
+
+    // a texture loaded from the same file earlier in this run is reloaded
+    ResourceCache *cache = GetSubsystem<ResourceCache>();
+    if ( resourceDirAdded_ && cache->GetExistingResource<Texture2D>(fileName) )
+    {
+        cache->ReloadResourceWithDependencies(fileName);
+    }
+
+    SDL_Log("baked: %s -> %s", url.CString(), fileName.CString());
+
+    return true;
+}
+
+void UBakedTextureCache::Invalidate(const String &url)
+{
+    RemoveEntries(url, String::EMPTY);
+    contentHashes_.Erase(url);
+}
+
+void UBakedTextureCache::RemoveEntries(const String &url, const String &keepFileName)
+{
+    FileSystem *fileSystem = GetSubsystem<FileSystem>();
+    ResourceCache *cache = GetSubsystem<ResourceCache>();
+    String prefix = GetUrlPrefix(url);
+    Vector<String> files;
+
+    fileSystem->ScanDir(files, cacheDir_, "*.png", SCAN_FILES, false);
+
+    for ( unsigned i = 0; i < files.Size(); ++i )
+    {
+        if ( files[i].StartsWith(prefix) && files[i] != keepFileName )
+        {
+            cache->ReleaseResource(Texture2D::GetTypeStatic(), files[i], true);
+            fileSystem->Delete(cacheDir_ + files[i]);
+        }
+    }
+}
+
+String UBakedTextureCache::GetUrlPrefix(const String &url) const
+{
+    return StringHash(url).ToString() + "_";
+}
+
+String UBakedTextureCache::GetFileName(const String &url)
+{
+    return GetUrlPrefix(url) + ToStringHex(GetContentHash(url)) + ".png";
+}
+
+unsigned UBakedTextureCache::GetContentHash(const String &url)
+{
+    // IsBaked(), Load() and Store() all need it, the folder is scanned once
+    HashMap<String, unsigned>::ConstIterator it = contentHashes_.Find(url);
+
+    if ( it != contentHashes_.End() )
+    {
+        return it->second_;
+    }
+
+    unsigned hash = ComputeContentHash(url);
+    contentHashes_[url] = hash;
+    return hash;
+}
+
+unsigned UBakedTextureCache::ComputeContentHash(const String &url)
+{
+    String path = GetLocalPath(url);
+
+    if ( path.Empty() )
+    {
+        return 0;
+    }
+
+    FileSystem *fileSystem = GetSubsystem<FileSystem>();
+
+    if ( !fileSystem->FileExists(path) )
+    {
+        return 0;
+    }
+
+    // the page and its folder's resources (css, scripts, images), sorted for a stable hash.
+    // name, size and modification time stand in for the contents
+    String pageDir = GetPath(path);
+    Vector<String> files;
+
+    fileSystem->ScanDir(files, pageDir, "*.*", SCAN_FILES, true);
+    Sort(files.Begin(), files.End());
+
+    unsigned hash = 0;
+
+    for ( unsigned i = 0; i < files.Size(); ++i )
+    {
+        for ( unsigned j = 0; j < files[i].Length(); ++j )
+        {
+            hash = SDBMHash(hash, (unsigned char)files[i][j]);
+        }
+
+        unsigned stamp[2];
+        stamp[0] = fileSystem->GetLastModifiedTime(pageDir + files[i]);
+        stamp[1] = File(context_, pageDir + files[i], FILE_READ).GetSize();
+
+        const unsigned char *bytes = (const unsigned char*)stamp;
+        for ( unsigned j = 0; j < sizeof(stamp); ++j )
+        {
+            hash = SDBMHash(hash, bytes[j]);
+        }
+    }
+
+    return hash;
+}
+
+String UBakedTextureCache::GetLocalPath(const String &url)
+{
+    if ( !url.StartsWith("file://", false) )
+    {
+        return String::EMPTY;
+    }
+
+    String path = url.Substring(7);
+
+    // file:///C:/... on windows
+    if ( path.Length() > 2 && path[0] == '/' && path[2] == ':' )
+    {
+        path = path.Substring(1);
+    }
+
+    // drop the query/fragment and the most common escape
+    unsigned end = Min(path.Find('?'), path.Find('#'));
+    if ( end != String::NPOS )
+    {
+        path = path.Substring(0, end);
+    }
+    path.Replace("%20", " ");
+
+    return GetInternalPath(path);
+}
+
@@ -0,0 +1,84 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+
+namespace Urho3D
+{
+class Texture2D;
+}
+
+using namespace Urho3D;
+
+//=============================================================================
+//=============================================================================
+#define BAKE_CACHE_DIR          "CefBake/"
+#define BAKE_IDLE_FRAMES        30
+
+//=============================================================================
+// On-disk cache of settled browser frames, keyed by url and content hash.
+// A cached page loads through the ResourceCache as a plain texture so a level
+// with only baked panels doesn't need cef at all. The content hash of a
+// file:// page covers the names, sizes and modification times of the page
+// and every file in its folder. It's computed once per url per run, so edits
+// made while the app runs need Invalidate().
+//
+// Remote (http, https, data) pages are never invalidated automatically, they
+// have no content hash and stay baked until Invalidate() is called.
+//=============================================================================
+class UBakedTextureCache : public Object
+{
+    URHO3D_OBJECT(UBakedTextureCache, Object);
+public:
+
+    UBakedTextureCache(Context *context);
+    virtual ~UBakedTextureCache();
+
+    // defaults to BAKE_CACHE_DIR in the app preferences dir
+    void SetCacheDir(const String &cacheDir);
+    const String& GetCacheDir() const       { return cacheDir_; }
+
+    bool IsBaked(const String &url);
+    Texture2D* Load(const String &url);
+    bool Store(const String &url, const unsigned char *rgba, int width, int height);
+    // removes the bakes of the url and forgets its content hash, the only way
+    // to refresh a remote page
+    void Invalidate(const String &url);
+
+protected:
+    String GetFileName(const String &url);
+    String GetUrlPrefix(const String &url) const;
+    unsigned GetContentHash(const String &url);
+    unsigned ComputeContentHash(const String &url);
+    void RemoveEntries(const String &url, const String &keepFileName);
+    static String GetLocalPath(const String &url);
+
+protected:
+    String cacheDir_;
+    bool   resourceDirAdded_;
+
+    // content hashes computed this run, by url
+    HashMap<String, unsigned> contentHashes_;
+};
+
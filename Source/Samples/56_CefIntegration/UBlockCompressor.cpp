@@ -0,0 +1,233 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "UBlockCompressor.h"
+
+//=============================================================================
+//=============================================================================
+#define BLOCK_PIXELS        16
+#define BLOCK_COMPONENTS    4
+
+//=============================================================================
+//=============================================================================
+static unsigned short PackRGB565(int r, int g, int b)
+{
+    return (unsigned short)( ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3) );
+}
+
+static void UnpackRGB565(unsigned short c, int *rgb)
+{
+    rgb[0] = ((c >> 11) & 0x1f) * 255 / 31;
+    rgb[1] = ((c >> 5) & 0x3f) * 255 / 63;
+    rgb[2] = (c & 0x1f) * 255 / 31;
+}
+
+//=============================================================================
+//=============================================================================
+unsigned UBlockCompressor::GetBlockSize(BlockFormat format)
+{
+    if ( format == BLOCK_DXT1 )
+        return 8;
+    if ( format == BLOCK_DXT5 )
+        return 16;
+
+    return 0;
+}
+
+unsigned UBlockCompressor::GetDataSize(BlockFormat format, int width, int height)
+{
+    return ((width + 3) / 4) * ((height + 3) / 4) * GetBlockSize(format);
+}
+
+bool UBlockCompressor::Compress(BlockFormat format, const unsigned char *rgba, int width, int height, unsigned char *dst)
+{
+    unsigned blockSize = GetBlockSize(format);
+
+    if ( blockSize == 0 || rgba == NULL || dst == NULL || width <= 0 || height <= 0 )
+    {
+        return false;
+    }
+
+    unsigned char block[BLOCK_PIXELS*BLOCK_COMPONENTS];
+
+    for ( int by = 0; by < height; by += 4 )
+    {
+        for ( int bx = 0; bx < width; bx += 4 )
+        {
+            // gather the 4x4 block, clamped at the right and bottom edges
+            for ( int y = 0; y < 4; ++y )
+            {
+                const unsigned char *row = rgba + std::min(by + y, height - 1)*width*BLOCK_COMPONENTS;
+
+                for ( int x = 0; x < 4; ++x )
+                {
+                    memcpy(block + (y*4 + x)*BLOCK_COMPONENTS, row + std::min(bx + x, width - 1)*BLOCK_COMPONENTS, BLOCK_COMPONENTS);
+                }
+            }
+
+            // dxt5 is the alpha block followed by a dxt1 color block
+            if ( format == BLOCK_DXT5 )
+            {
+                CompressAlphaBlock(block, dst);
+                dst += 8;
+            }
+
+            CompressColorBlock(block, dst);
+            dst += 8;
+        }
+    }
+
+    return true;
+}
+
+void UBlockCompressor::CompressColorBlock(const unsigned char *block, unsigned char *dst)
+{
+    int minColor[3] = { 255, 255, 255 };
+    int maxColor[3] = { 0, 0, 0 };
+
+    for ( int i = 0; i < BLOCK_PIXELS; ++i )
+    {
+        for ( int c = 0; c < 3; ++c )
+        {
+            minColor[c] = std::min(minColor[c], (int)block[i*BLOCK_COMPONENTS + c]);
+            maxColor[c] = std::max(maxColor[c], (int)block[i*BLOCK_COMPONENTS + c]);
+        }
+    }
+
+    unsigned short c0 = PackRGB565(maxColor[0], maxColor[1], maxColor[2]);
+    unsigned short c1 = PackRGB565(minColor[0], minColor[1], minColor[2]);
+
+    // c0 > c1 selects the 4 color palette, equal endpoints use index 0 only
+    if ( c0 < c1 )
+    {
+        std::swap(c0, c1);
+    }
+
+    dst[0] = (unsigned char)(c0 & 0xff);
+    dst[1] = (unsigned char)(c0 >> 8);
+    dst[2] = (unsigned char)(c1 & 0xff);
+    dst[3] = (unsigned char)(c1 >> 8);
+
+    unsigned indices = 0;
+
+    if ( c0 != c1 )
+    {
+        int palette[4][3];
+        UnpackRGB565(c0, palette[0]);
+        UnpackRGB565(c1, palette[1]);
+
+        for ( int c = 0; c < 3; ++c )
+        {
+            palette[2][c] = (2*palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2*palette[1][c]) / 3;
+        }
+
+        for ( int i = 0; i < BLOCK_PIXELS; ++i )
+        {
+            const unsigned char *pixel = block + i*BLOCK_COMPONENTS;
+            unsigned best = 0;
+            int bestDist = INT_MAX;
+
+            for ( unsigned p = 0; p < 4; ++p )
+            {
+                int dr = pixel[0] - palette[p][0];
+                int dg = pixel[1] - palette[p][1];
+                int db = pixel[2] - palette[p][2];
+                int dist = dr*dr + dg*dg + db*db;
+
+                if ( dist < bestDist )
+                {
+                    bestDist = dist;
+                    best = p;
+                }
+            }
+
+            indices |= best << (i*2);
+        }
+    }
+
+    dst[4] = (unsigned char)(indices & 0xff);
+    dst[5] = (unsigned char)((indices >> 8) & 0xff);
+    dst[6] = (unsigned char)((indices >> 16) & 0xff);
+    dst[7] = (unsigned char)(indices >> 24);
+}
+
+void UBlockCompressor::CompressAlphaBlock(const unsigned char *block, unsigned char *dst)
+{
+    int a0 = 0;
+    int a1 = 255;
+
+    for ( int i = 0; i < BLOCK_PIXELS; ++i )
+    {
+        a0 = std::max(a0, (int)block[i*BLOCK_COMPONENTS + 3]);
+        a1 = std::min(a1, (int)block[i*BLOCK_COMPONENTS + 3]);
+    }
+
+    dst[0] = (unsigned char)a0;
+    dst[1] = (unsigned char)a1;
+
+    // a0 > a1 selects the 8 alpha palette
+    unsigned long long indices = 0;
+
+    if ( a0 != a1 )
+    {
+        int palette[8];
+        palette[0] = a0;
+        palette[1] = a1;
+
+        for ( int i = 0; i < 6; ++i )
+        {
+            palette[i + 2] = ((6 - i)*a0 + (1 + i)*a1) / 7;
+        }
+
+        for ( int i = 0; i < BLOCK_PIXELS; ++i )
+        {
+            int alpha = block[i*BLOCK_COMPONENTS + 3];
+            unsigned best = 0;
+            int bestDist = INT_MAX;
+
+            for ( unsigned p = 0; p < 8; ++p )
+            {
+                int dist = abs(alpha - palette[p]);
+
+                if ( dist < bestDist )
+                {
+                    bestDist = dist;
+                    best = p;
+                }
+            }
+
+            indices |= (unsigned long long)best << (i*3);
+        }
+    }
+
+    for ( int i = 0; i < 6; ++i )
+    {
+        dst[2 + i] = (unsigned char)((indices >> (i*8)) & 0xff);
+    }
+}
+
@@ -0,0 +1,53 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+//=============================================================================
+// CPU only BC1 (DXT1) and BC3 (DXT5) encoder for settled browser frames.
+// Bounding box endpoints and nearest palette indices, quality is below an
+// offline encoder but it's fast enough to run on a worker within a few frames.
+// Edge blocks of sizes that aren't a multiple of 4 repeat the last row/column.
+// Doesn't depend on the engine, BlockCheck builds it on its own.
+//=============================================================================
+enum BlockFormat
+{
+    BLOCK_NONE = 0,
+    BLOCK_DXT1,         // CF_DXT1, 8 bytes per block
+    BLOCK_DXT5,         // CF_DXT5, 16 bytes per block
+};
+
+class UBlockCompressor
+{
+public:
+    // 0 for BLOCK_NONE
+    static unsigned GetBlockSize(BlockFormat format);
+    static unsigned GetDataSize(BlockFormat format, int width, int height);
+
+    // rgba is tightly packed, dst must hold GetDataSize() bytes
+    static bool Compress(BlockFormat format, const unsigned char *rgba, int width, int height, unsigned char *dst);
+
+protected:
+    static void CompressColorBlock(const unsigned char *block, unsigned char *dst);
+    static void CompressAlphaBlock(const unsigned char *block, unsigned char *dst);
+};
+
@@ -24,6 +24,8 @@
 #include <Urho3D/Core/Context.h>
 #include <Urho3D/Core/Object.h>
 #include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Core/WorkQueue.h>
 #include <Urho3D/UI/UI.h>
 #include <Urho3D/UI/UIElement.h>
 #include <Urho3D/UI/UIEvents.h>
@@ -34,20 +36,39 @@
 #include <Urho3D/Input/Input.h>
 #include <Urho3D/Input/InputEvents.h>
 #include <fstream>
+#include <math.h>
 #include <SDL/SDL_log.h>
 
+#include "include/base/cef_bind.h"
+#include "include/wrapper/cef_closure_task.h"
+
 #include "UBrowserImage.h"
+#include "UUploadScheduler.h"
+#include "UFrameRateScheduler.h"
+#include "UMipChain.h"
+#include "UBlockCompressor.h"
+#include "UBakedTextureCache.h"
 #include "UCefApp.h"
 
 #include <Urho3D/DebugNew.h>
 
 //=============================================================================
 //=============================================================================
-#define FRAME_RATE_MS           32
 #define MOUSE_WHEEL_MULTIPLYER  30.0f
 
+// begin frame sync - paints should complete this long before the next engine frame
+#define BEGINFRAME_MARGIN_USEC      1500
+#define BEGINFRAME_TOLERANCE_USEC   4000
+#define BEGINFRAME_LATENCY_USEC     8000
+#define BEGINFRAME_DRIFT_FRAMES     10
+#define BEGINFRAME_REARM_MS         1000
+
 //=============================================================================
 //=============================================================================
+Mutex    UCefRenderHandle::stagingMutex_;
+unsigned UCefRenderHandle::residentStagingBytes_ = 0;
+HiresTimer UCefRenderHandle::frameClock_;
+
 UCefRenderHandle::UCefRenderHandle(int width, int height, unsigned components)
     : width_(width)
     , height_(height)
@@ -55,223 +76,1553 @@ UCefRenderHandle::UCefRenderHandle(int width, int height, unsigned components)
     , bufferUpdated_(false)
     , browser_(NULL)
     , isShuttingDown_(false)
+    , paintCount_(0)
+    , beginFrameUSec_(0)
+    , paintPhaseUSec_(-1)
+    , popupWidth_(0)
+    , popupHeight_(0)
+    , popupVisible_(false)
+    , popupUpdated_(false)
+    , frameNumber_(0)
+    , alphaMaskStride_(0)
+    , hitTestAlpha_(CEFBUF_HITMASK_ALPHA)
+    , alphaMaskUpdated_(false)
+    , idleFrames_(0)
+    , reclaimIdleFrames_(CEFBUF_RECLAIM_IDLE_FRAMES)
+{
+    // the frame is acquired lazily on the first OnPaint()
+}
+
+UCefRenderHandle::~UCefRenderHandle()
+{
+    ReleaseCopyBuffer();
+    ReleasePopupBuffer();
+    browser_ = NULL;
+}
+
+bool UCefRenderHandle::GetViewRect(CefRefPtr<CefBrowser> browser, CefRect& rect)
+{
+    rect = CefRect(0, 0, width_, height_);
+    return true;
+}
+
+void UCefRenderHandle::OnPaint(CefRefPtr<CefBrowser> browser, PaintElementType ttype, 
+                               const RectList& dirtyRects, const void* buffer, int width, int height)
+{
+    if ( IsShuttingDown() )
+    {
+        return;
+    }
+
+    // no frame rate check here, chromium already paces paints to the windowless frame rate
+    // and a dropped paint would leave its dirty rows stale in the texture
+    MutexLock lock(copyMutex_);
+
+    if ( !AcceptBrowser(browser) )
+    {
+        return;
+    }
+
+    // popups (dropdowns, <select>) go to their own small buffer and texture
+    if ( ttype == PET_POPUP )
+    {
+        if ( width != popupWidth_ || height != popupHeight_ || popupBuffer_.Null() )
+        {
+            AllocPopupBuffer(width, height);
+        }
+
+        CopyBuffer(popupBuffer_.Get(), (void*)buffer, popupWidth_*popupHeight_*components_);
+        popupUpdated_ = true;
+        return;
+    }
+
+    if ( width != width_ || height != height_ || frame_ == NULL )
+    {
+        width_ = width;
+        height_ = height;
+        AllocCopyBuffer();
+    }
+    else if ( !frame_->HasOneRef() )
+    {
+        // a sink still reads the published frame, every paint is a full view so any free frame will do
+        AcquireFrame();
+    }
+
+    // uploads are done in full-width row bands
+    for ( unsigned i = 0; i < dirtyRects.size(); ++i )
+    {
+        AddDirtyRows(dirtyRects[i].y, dirtyRects[i].y + dirtyRects[i].height);
+    }
+
+    // the hit-test mask and tile occupancy are built in the same pass as the r-b swap
+    memset(&alphaMask_[0], 0, alphaMask_.Size()*sizeof(unsigned));
+
+    unsigned numTiles = tiles_.x_*tiles_.y_;
+    for ( unsigned i = 0; i < numTiles; ++i )
+    {
+        tileAlpha_[i*2] = 0;
+        tileAlpha_[i*2 + 1] = 255;
+    }
+
+    CopyBuffer(frame_->data_, (void*)buffer, width_*height_*components_, &alphaMask_[0], &tileAlpha_[0]);
+
+    for ( unsigned i = 0; i < numTiles; ++i )
+    {
+        if ( tileAlpha_[i*2] == 0 )
+            tileMap_[i] = TILE_EMPTY;
+        else if ( tileAlpha_[i*2 + 1] == 255 )
+            tileMap_[i] = TILE_OPAQUE;
+        else
+            tileMap_[i] = TILE_MIXED;
+    }
+    alphaMaskUpdated_ = true;
+    bufferUpdated_ = true;
+    idleFrames_ = 0;
+    ++paintCount_;
+
+    // when the paint became available relative to the engine frame
+    paintPhaseUSec_ = frameClock_.GetUSec(false) - beginFrameUSec_;
+}
+
+void UCefRenderHandle::OnPopupShow(CefRefPtr<CefBrowser> browser, bool show)
+{
+    MutexLock lock(copyMutex_);
+
+    popupVisible_ = show;
+
+    // the view underneath is intact, only the popup buffer goes away
+    if ( !show )
+    {
+        popupRect_ = IntRect::ZERO;
+        popupUpdated_ = false;
+        ReleasePopupBuffer();
+    }
+}
+
+void UCefRenderHandle::OnPopupSize(CefRefPtr<CefBrowser> browser, const CefRect& rect)
+{
+    MutexLock lock(copyMutex_);
+
+    // keep the popup inside the view
+    int x = Clamp(rect.x, 0, Max(width_ - rect.width, 0));
+    int y = Clamp(rect.y, 0, Max(height_ - rect.height, 0));
+
+    popupRect_ = IntRect(x, y, x + rect.width, y + rect.height);
+}
+
+bool UCefRenderHandle::IsPopupVisible()
+{
+    MutexLock lock(copyMutex_);
+    return popupVisible_;
+}
+
+IntRect UCefRenderHandle::GetPopupRect()
+{
+    MutexLock lock(copyMutex_);
+    return popupRect_;
+}
+
+bool UCefRenderHandle::CopyPopupToTexture(Texture2D *texture)
+{
+    MutexLock lock(copyMutex_);
+
+    if ( !popupUpdated_ || popupBuffer_.Null() )
+    {
+        return false;
+    }
+
+    if ( texture->GetWidth() != popupWidth_ || texture->GetHeight() != popupHeight_ )
+    {
+        texture->SetSize(popupWidth_, popupHeight_, Graphics::GetRGBAFormat());
+    }
+
+    texture->SetData(0, 0, 0, popupWidth_, popupHeight_, popupBuffer_.Get());
+    popupUpdated_ = false;
+
+    return true;
+}
+
+void UCefRenderHandle::AllocPopupBuffer(int width, int height)
+{
+    ReleasePopupBuffer();
+
+    popupWidth_ = width;
+    popupHeight_ = height;
+    popupBuffer_ = new unsigned char[popupWidth_*popupHeight_*components_];
+
+    MutexLock lock(stagingMutex_);
+    residentStagingBytes_ += popupWidth_*popupHeight_*components_;
+}
+
+void UCefRenderHandle::ReleasePopupBuffer()
+{
+    if ( popupBuffer_.Null() )
+    {
+        return;
+    }
+
+    popupBuffer_ = NULL;
+
+    MutexLock lock(stagingMutex_);
+    residentStagingBytes_ -= popupWidth_*popupHeight_*components_;
+    popupWidth_ = 0;
+    popupHeight_ = 0;
+}
+
+void UCefRenderHandle::OnScrollOffsetChanged(CefRefPtr<CefBrowser> browser, double x, double y)
+{
+    scrollOffset_ = IntVector2((int)x, (int)y);
+}
+
+void UCefRenderHandle::Resize(int width, int height)
+{
+    if ( width != width_ || height != height_ )
+    {
+        MutexLock lock(copyMutex_);
+
+        width_ = width;
+        height_ = height;
+        ReleaseCopyBuffer();
+    }
+}
+
+void UCefRenderHandle::AllocCopyBuffer()
+{
+    ReleaseCopyBuffer();
+
+    frame_ = new UBrowserFrame(width_, height_, components_);
+
+    // a new size has to be uploaded in full
+    dirtyRows_ = IntVector2::ZERO;
+    AddDirtyRows(0, height_);
+
+    // 32 blocks per mask word
+    alphaMaskBlocks_ = IntVector2((width_ + (1 << CEFBUF_HITMASK_SHIFT) - 1) >> CEFBUF_HITMASK_SHIFT,
+                                  (height_ + (1 << CEFBUF_HITMASK_SHIFT) - 1) >> CEFBUF_HITMASK_SHIFT);
+    alphaMaskStride_ = (alphaMaskBlocks_.x_ + 31) >> 5;
+    alphaMask_.Resize(alphaMaskStride_ * alphaMaskBlocks_.y_ + 1);
+
+    tiles_ = IntVector2((width_ + (1 << CEFBUF_TILE_SHIFT) - 1) >> CEFBUF_TILE_SHIFT,
+                        (height_ + (1 << CEFBUF_TILE_SHIFT) - 1) >> CEFBUF_TILE_SHIFT);
+    tileAlpha_.Resize(tiles_.x_*tiles_.y_*2 + 2);
+    tileMap_.Resize(tiles_.x_*tiles_.y_);
+}
+
+void UCefRenderHandle::AcquireFrame()
+{
+    spareFrames_.Push(frame_);
+    frame_ = NULL;
+
+    for ( unsigned i = 0; i < spareFrames_.Size(); ++i )
+    {
+        if ( spareFrames_[i]->HasOneRef() )
+        {
+            frame_ = spareFrames_[i];
+            spareFrames_.Erase(i);
+            break;
+        }
+    }
+
+    if ( frame_ == NULL )
+    {
+        frame_ = new UBrowserFrame(width_, height_, components_);
+    }
+
+    // frames dropped from the pool are freed by their last sink
+    while ( spareFrames_.Size() > CEFBUF_FRAME_POOL )
+    {
+        spareFrames_.Erase(0);
+    }
+}
+
+void UCefRenderHandle::ReleaseCopyBuffer()
+{
+    frame_ = NULL;
+    spareFrames_.Clear();
+}
+
+void UCefRenderHandle::AddDirtyRows(int top, int bottom)
+{
+    top = Clamp(top, 0, height_);
+    bottom = Clamp(bottom, 0, height_);
+
+    if ( top >= bottom )
+    {
+        return;
+    }
+
+    if ( dirtyRows_.x_ >= dirtyRows_.y_ )
+    {
+        dirtyRows_ = IntVector2(top, bottom);
+    }
+    else
+    {
+        dirtyRows_.x_ = Min(dirtyRows_.x_, top);
+        dirtyRows_.y_ = Max(dirtyRows_.y_, bottom);
+    }
+}
+
+void UCefRenderHandle::SetBeginFrameTime(long long usec)
+{
+    MutexLock lock(copyMutex_);
+    beginFrameUSec_ = usec;
+}
+
+long long UCefRenderHandle::TakePaintPhaseUSec()
+{
+    MutexLock lock(copyMutex_);
+
+    long long paintPhase = paintPhaseUSec_;
+    paintPhaseUSec_ = -1;
+
+    return paintPhase;
+}
+
+void UCefRenderHandle::RearmFrameTimer(int frameRate, int delayMS)
+{
+    CefPostDelayedTask(TID_UI, base::Bind(&UCefRenderHandle::OnRearmFrameTimer, this, frameRate), delayMS);
+}
+
+void UCefRenderHandle::OnRearmFrameTimer(int frameRate)
+{
+    // setting the rate restarts chromium's begin frame timer at the time of the call
+    CefRefPtr<CefBrowser> browser = GetBrowser();
+
+    if ( browser && !IsShuttingDown() )
+    {
+        browser->GetHost()->SetWindowlessFrameRate(frameRate);
+    }
+}
+
+long long UCefRenderHandle::GetFrameClockUSec()
+{
+    return frameClock_.GetUSec(false);
+}
+
+unsigned UCefRenderHandle::TakePaintCount()
+{
+    MutexLock lock(copyMutex_);
+
+    unsigned paintCount = paintCount_;
+    paintCount_ = 0;
+
+    return paintCount;
+}
+
+bool UCefRenderHandle::TakeAlphaMask(PODVector<unsigned> &mask, IntVector2 &blocks)
+{
+    MutexLock lock(copyMutex_);
+
+    if ( !alphaMaskUpdated_ )
+    {
+        return false;
+    }
+
+    // the mask is kept when the frame is reclaimed, the texture still shows the same frame
+    mask = alphaMask_;
+    blocks = alphaMaskBlocks_;
+    alphaMaskUpdated_ = false;
+
+    return true;
+}
+
+bool UCefRenderHandle::TakeTileMap(PODVector<unsigned char> &tileMap, IntVector2 &tiles)
+{
+    MutexLock lock(copyMutex_);
+
+    if ( tileMap_.Empty() )
+    {
+        return false;
+    }
+
+    tileMap = tileMap_;
+    tiles = tiles_;
+
+    return true;
+}
+
+CefRefPtr<UBrowserFrame> UCefRenderHandle::TakeFrame()
+{
+    MutexLock lock(copyMutex_);
+
+    if ( !bufferUpdated_ || frame_ == NULL )
+    {
+        return NULL;
+    }
+
+    // the frame isn't shared until it's returned here, so these are its last writes
+    frame_->dirtyRows_ = dirtyRows_;
+    frame_->frameNumber_ = ++frameNumber_;
+    dirtyRows_ = IntVector2::ZERO;
+    bufferUpdated_ = false;
+
+    return frame_;
+}
+
+bool UCefRenderHandle::ReclaimIdleBuffer()
+{
+    MutexLock lock(copyMutex_);
+
+    // the texture already holds the same pixels once a static page has been uploaded
+    if ( reclaimIdleFrames_ == 0 || bufferUpdated_ || frame_ == NULL )
+    {
+        return false;
+    }
+
+    if ( ++idleFrames_ >= reclaimIdleFrames_ )
+    {
+        ReleaseCopyBuffer();
+        return true;
+    }
+
+    return false;
+}
+
+unsigned UCefRenderHandle::GetResidentStagingBytes()
+{
+    MutexLock lock(stagingMutex_);
+    return residentStagingBytes_ + UBrowserFrame::GetResidentBytes();
+}
+
+void UCefRenderHandle::CopyBuffer(void *dst, void *src, unsigned usize, unsigned *alphaMask, unsigned char *tileAlpha)
+{
+    MutexLock lock(copyMutex_);
+    //HiresTimer htimer;
+
+    struct CefColor
+    {
+        unsigned char r_, g_, b_, a_;
+    };
+
+    #ifdef INDIVIDUAL_RGBA_CPY
+    CefColor *fsrc = (CefColor*)src;
+    CefColor *fdst = (CefColor*)dst;
+
+    for ( unsigned i = 0; i < usize/sizeof(CefColor); ++i )
+    {
+        fdst[i].r_ = fsrc[i].b_;
+        fdst[i].g_ = fsrc[i].g_;
+        fdst[i].b_ = fsrc[i].r_;
+        fdst[i].a_ = fsrc[i].a_;
+
+        if ( alphaMask && fdst[i].a_ > hitTestAlpha_ )
+        {
+            unsigned block = ((i % width_) >> CEFBUF_HITMASK_SHIFT) + ((i / width_) >> CEFBUF_HITMASK_SHIFT)*alphaMaskStride_*32;
+            alphaMask[block >> 5] |= 1U << (block & 31);
+        }
+        if ( tileAlpha )
+        {
+            unsigned tile = ((i % width_) >> CEFBUF_TILE_SHIFT) + ((i / width_) >> CEFBUF_TILE_SHIFT)*tiles_.x_;
+            tileAlpha[tile*2] |= fdst[i].a_;
+            tileAlpha[tile*2 + 1] &= fdst[i].a_;
+        }
+    }
+    //SDL_Log("rgba cp = %I64d", htimer.GetUSec(false) );
+
+    #else
+    // doing mempcy first then doing the r-b swap in shared ptr 
+    // array is about 20%-40% faster than individual rgba cpy
+    // -sample output data (in usecs):
+    //INFO: rgba cp = 12581
+    //INFO: rgba cp = 16775
+    //INFO: rgba cp = 18151
+    //INFO: rgba cp = 19887
+    //INFO: memcpy - rb swap = 11272
+    //INFO: memcpy - rb swap = 12205
+    //INFO: memcpy - rb swap = 14512
+    //INFO: memcpy - rb swap = 7541
+
+    memcpy(dst, src, usize);
+
+    CefColor *fdst = (CefColor*)dst;
+
+    if ( alphaMask == NULL || tileAlpha == NULL )
+    {
+        for ( unsigned i = 0; i < usize/sizeof(CefColor); ++i )
+        {
+            unsigned char tmp = fdst[i].r_;
+            fdst[i].r_ = fdst[i].b_;
+            fdst[i].b_ = tmp;
+        }
+    }
+    else
+    {
+        // same swap walked by rows so that each pixel's alpha lands in its 4x4 block bit
+        // and in its tile's or/and alpha
+        for ( int y = 0; y < height_; ++y )
+        {
+            CefColor *row = fdst + y*width_;
+            unsigned *maskRow = alphaMask + (y >> CEFBUF_HITMASK_SHIFT)*alphaMaskStride_;
+            unsigned char *tileRow = tileAlpha + (y >> CEFBUF_TILE_SHIFT)*tiles_.x_*2;
+
+            for ( int x = 0; x < width_; ++x )
+            {
+                unsigned char tmp = row[x].r_;
+                row[x].r_ = row[x].b_;
+                row[x].b_ = tmp;
+
+                unsigned char alpha = row[x].a_;
+                if ( alpha > hitTestAlpha_ )
+                {
+                    unsigned block = x >> CEFBUF_HITMASK_SHIFT;
+                    maskRow[block >> 5] |= 1U << (block & 31);
+                }
+
+                unsigned char *tile = tileRow + (x >> CEFBUF_TILE_SHIFT)*2;
+                tile[0] |= alpha;
+                tile[1] &= alpha;
+            }
+        }
+    }
+    //SDL_Log("memcpy - rb swap = %I64d", htimer.GetUSec(false) );
+    #endif
+}
+
+void UCefRenderHandle::Shutdown()
+{ 
+    isShuttingDown_ = true; 
+}
+
+bool UCefRenderHandle::IsShuttingDown()
+{
+    return isShuttingDown_;
+}
+
+bool UCefRenderHandle::AcceptBrowser(CefRefPtr<CefBrowser> browser)
+{
+    int browserId = browser->GetIdentifier();
+
+    if ( browser_ )
+    {
+        return browser_->GetIdentifier() == browserId;
+    }
+
+    // a paint from a closing browser would rebind it
+    if ( retiredBrowserIds_.Contains(browserId) )
+    {
+        return false;
+    }
+
+    browser_ = browser;
+    return true;
+}
+
+CefRefPtr<CefBrowser> UCefRenderHandle::GetBrowser()
+{
+    MutexLock lock(copyMutex_);
+    return browser_;
+}
+
+void UCefRenderHandle::Hibernate()
+{
+    MutexLock lock(copyMutex_);
+
+    if ( browser_ )
+    {
+        // a closed browser never paints again, a few ids are plenty
+        if ( retiredBrowserIds_.Size() >= 16 )
+        {
+            retiredBrowserIds_.Erase(0);
+        }
+        retiredBrowserIds_.Push(browser_->GetIdentifier());
+    }
+
+    // the texture keeps the last frame, the cpu side copy is re-allocated on the next OnPaint()
+    ReleaseCopyBuffer();
+    ReleasePopupBuffer();
+    popupVisible_ = false;
+    bufferUpdated_ = false;
+    dirtyRows_ = IntVector2::ZERO;
+    browser_ = NULL;
+}
+
+//=============================================================================
+//=============================================================================
+long long UBrowserImage::uploadUSec_ = 0;
+unsigned UBrowserImage::uploadCount_ = 0;
+
+UBrowserImage::UBrowserImage(Context *context)
+    : BorderImage(context)
+    , cefBrowser_(NULL)
+    , cefRendererHandle_(NULL)
+    , hibernateTimeMS_(0)
+    , hibernated_(false)
+    , wakeOnVisible_(false)
+    , restoring_(false)
+    , firstFrameShown_(false)
+    , textureRingSize_(CEFBUF_TEXTURE_RING)
+    , ringIndex_(0)
+    , pendingFrames_(0)
+    , frame_(NULL)
+    , mipmaps_(false)
+    , mipBuilt_(false)
+    , compressIdleFrames_(0)
+    , compressIdleCount_(0)
+    , compressed_(false)
+    , compressDiscard_(false)
+    , compressFormat_(BLOCK_NONE)
+    , baked_(false)
+    , bakeIdleCount_(0)
+    , videoFrameRate_(0)
+    , frameRateRole_(FRR_PASSIVE)
+    , frameRate_(0)
+    , frameRateBrowserId_(0)
+    , paintRate_(0)
+    , lastBeginFrameUSec_(0)
+    , engineIntervalUSec_(0.0f)
+    , paintLatencyUSec_(BEGINFRAME_LATENCY_USEC)
+    , armedPhaseUSec_(0.0f)
+    , phaseArmed_(false)
+    , phaseMisses_(0)
+    , alphaHitTest_(true)
+    , tileBatching_(true)
+    , lastInputMSec_(0)
+    , hadInput_(false)
+{
+    // clicks focus the browser, keys and the focused frame rate follow it
+    SetFocusMode(FM_FOCUSABLE);
+}
+
+UBrowserImage::~UBrowserImage()
+{
+    UUploadScheduler *uploadScheduler = GetSubsystem<UUploadScheduler>();
+    if ( uploadScheduler )
+    {
+        uploadScheduler->Remove(this);
+    }
+
+    UFrameRateScheduler *frameRateScheduler = GetSubsystem<UFrameRateScheduler>();
+    if ( frameRateScheduler )
+    {
+        frameRateScheduler->Remove(this);
+    }
+
+    WaitForMips();
+    WaitForCompress();
+
+    cefRendererHandle_ = NULL;
+    cefBrowser_ = NULL;
+}
+
+void UBrowserImage::ClearCefHandler()
+{
+    if ( cefRendererHandle_ )
+    {
+        cefRendererHandle_->Shutdown();
+        cefRendererHandle_->browser_ = NULL;
+    }
+
+    if ( cefBrowser_ )
+    {
+        cefBrowser_ = NULL;
+    }
+}
+
+void UBrowserImage::Init(UCefRenderHandle *cefRenderHandler, int width, int height)
+{
+    InitTexture(width, height);
+
+    cefRendererHandle_ = cefRenderHandler;
+
+    RegisterHandlers();
+}
+
+bool UBrowserImage::InitBaked(const String &url, int width, int height)
+{
+    UBakedTextureCache *bakedCache = GetSubsystem<UBakedTextureCache>();
+    Texture2D *texture = bakedCache ? bakedCache->Load(url) : NULL;
+
+    if ( texture == NULL )
+    {
+        return false;
+    }
+
+    // no render handler, no events - a plain image of the page
+    texture_ = texture;
+    bakeUrl_ = url;
+    baked_ = true;
+
+    width_ = width;
+    height_ = height;
+    scaleDiff_ = Vector2( (float)texture->GetWidth()/(float)width_, (float)texture->GetHeight()/(float)height_ );
+    initalOffset_ = IntVector2(20, 20);
+
+    SetPosition(initalOffset_);
+    SetTexture(texture_);
+    SetFullImageRect();
+    SetSize(width_, height_);
+    SetEnabled(true);
+    SetOpacity(0.95f);
+    SetVisible(true);
+
+    return true;
+}
+
+void UBrowserImage::InitTexture(int width, int height)
+{
+    CreateTextureRing();
+
+    // popup layer, disabled so that hover and clicks go through to the browser
+    popupTexture_ = new Texture2D(context_);
+    popupTexture_->SetNumLevels(1);
+    popupTexture_->SetFilterMode(FILTER_BILINEAR);
+    popupTexture_->SetAddressMode(COORD_U, ADDRESS_CLAMP);
+    popupTexture_->SetAddressMode(COORD_V, ADDRESS_CLAMP);
+
+    popupImage_ = CreateChild<BorderImage>();
+    popupImage_->SetEnabled(false);
+    popupImage_->SetVisible(false);
+
+    width_ = width;
+    height_ = height;
+
+    scaleDiff_ = Vector2( (float)CEFBUF_WIDTH/(float)width_, (float)CEFBUF_HEIGHT/(float)height_ );
+    initalOffset_ = IntVector2(20, 20);
+
+    // init 
+    SetVisible(false);
+    SetPosition(initalOffset_);
+    SetTexture(texture_);
+    SetSize(width_, height_);
+    SetEnabled(true);
+    SetOpacity(0.95f);
+}
+
+void UBrowserImage::UpdateBuffer()
+{
+    if ( cefRendererHandle_ == NULL )
+    {
+        return;
+    }
+
+    // collect the rows painted since the last frame, paints are phased by HandleBeginFrame()
+    if ( IsAppReady() )
+    {
+        cefBrowser_ = cefRendererHandle_->GetBrowser();
+
+        CefRefPtr<UBrowserFrame> frame = cefRendererHandle_->TakeFrame();
+        if ( frame )
+        {
+            // the page changed, back to rgba
+            compressIdleCount_ = 0;
+            bakeIdleCount_ = 0;
+            RestoreUncompressed();
+
+            // the texture path first, then the other sinks with the same frame
+            OnFrame(frame);
+
+            for ( unsigned i = 0; i < frameSinks_.Size(); ++i )
+            {
+                frameSinks_[i]->OnFrame(frame);
+            }
+        }
+
+        if ( cefRendererHandle_->TakeAlphaMask(hitMask_, hitMaskBlocks_) )
+        {
+            cefRendererHandle_->TakeTileMap(pendingTileMap_, pendingTiles_);
+        }
+    }
+
+    // keep the hibernation snapshot until the recreated page has loaded, nothing to upload while hibernated
+    if ( restoring_ || hibernated_ )
+    {
+        return;
+    }
+
+    UpdatePopup();
+    UpdateMips();
+
+    if ( !HasPendingUpload() )
+    {
+        return;
+    }
+
+    ++pendingFrames_;
+
+    UUploadScheduler *uploadScheduler = GetSubsystem<UUploadScheduler>();
+
+    if ( uploadScheduler )
+    {
+        uploadScheduler->Request(this);
+    }
+    else
+    {
+        UploadPending(M_MAX_UNSIGNED);
+    }
+}
+
+void UBrowserImage::OnFrame(UBrowserFrame *frame)
+{
+    frame_ = frame;
+
+    const IntVector2 &rows = frame->GetDirtyRows();
+
+    if ( rows.x_ >= rows.y_ )
+    {
+        return;
+    }
+
+    for ( unsigned i = 0; i < textureRing_.Size(); ++i )
+    {
+        AddDirtyRows(ringDirty_[i], rows);
+    }
+
+    if ( mipmaps_ )
+    {
+        AddDirtyRows(mipDirty_, rows);
+    }
+}
+
+void UBrowserImage::AddFrameSink(UFrameSink *frameSink)
+{
+    if ( frameSink && frameSink != this && !frameSinks_.Contains(frameSink) )
+    {
+        frameSinks_.Push(frameSink);
+    }
+}
+
+void UBrowserImage::RemoveFrameSink(UFrameSink *frameSink)
+{
+    frameSinks_.Remove(frameSink);
+}
+
+void UBrowserImage::UpdateMips()
+{
+    if ( mipItem_ )
+    {
+        if ( !mipItem_->completed_ )
+        {
+            return;
+        }
+
+        // mips trail level 0 by the worker's latency, every texture in the ring gets them
+        if ( mipBuilt_ )
+        {
+            for ( unsigned i = 0; i < textureRing_.Size(); ++i )
+            {
+                mipChain_->Upload(textureRing_[i], mipRows_.x_, mipRows_.y_);
+            }
+        }
+
+        mipItem_ = NULL;
+        mipFrame_ = NULL;
+    }
+
+    if ( !mipmaps_ || mipDirty_.x_ >= mipDirty_.y_ || frame_ == NULL )
+    {
+        return;
+    }
+
+    WorkQueue *queue = GetSubsystem<WorkQueue>();
+
+    // the worker reads the immutable frame, no lock against the next paint
+    mipFrame_ = frame_;
+    mipRows_ = mipDirty_;
+    mipDirty_ = IntVector2::ZERO;
+    mipBuilt_ = false;
+
+    mipItem_ = queue->GetFreeItem();
+    mipItem_->workFunction_ = MipWorkFunction;
+    mipItem_->aux_ = this;
+    mipItem_->priority_ = 0;
+    queue->AddWorkItem(mipItem_);
+}
+
+void UBrowserImage::MipWorkFunction(const WorkItem *item, unsigned threadIndex)
+{
+    UBrowserImage *image = (UBrowserImage*)item->aux_;
+    const IntVector2 &rows = image->mipRows_;
+    UBrowserFrame *frame = image->mipFrame_;
+
+    if ( image->mipChain_->GetLevelSize(0) == IntVector2(frame->GetWidth(), frame->GetHeight()) )
+    {
+        image->mipChain_->Downsample(1, frame->GetData(), rows.x_, rows.y_);
+        image->mipChain_->DownsampleLevels(rows.x_, rows.y_);
+        image->mipBuilt_ = true;
+    }
+}
+
+void UBrowserImage::WaitForMips()
+{
+    if ( mipItem_ == NULL )
+    {
+        return;
+    }
+
+    // a started item can't be removed, it's short so wait it out
+    WorkQueue *queue = GetSubsystem<WorkQueue>();
+
+    if ( queue == NULL || !queue->RemoveWorkItem(mipItem_) )
+    {
+        while ( !mipItem_->completed_ )
+        {
+            Time::Sleep(0);
+        }
+    }
+
+    mipItem_ = NULL;
+}
+
+void UBrowserImage::UpdateCompression()
+{
+    if ( compressItem_ )
+    {
+        if ( compressItem_->completed_ )
+        {
+            if ( !compressDiscard_ && compressLevels_.Size() )
+            {
+                ApplyCompressed();
+            }
+
+            compressLevels_.Clear();
+            compressFrame_ = NULL;
+            compressItem_ = NULL;
+        }
+        return;
+    }
+
+    if ( compressIdleFrames_ == 0 || compressed_ || restoring_ || frame_ == NULL || HasPendingUpload() || 
+         mipItem_ || mipDirty_.x_ < mipDirty_.y_ )
+    {
+        return;
+    }
+
+    if ( ++compressIdleCount_ < compressIdleFrames_ )
+    {
+        return;
+    }
+
+    // no etc2 in the engine's compressed formats, gles panels stay rgba
+    Graphics *graphics = GetSubsystem<Graphics>();
+
+    if ( graphics == NULL || !graphics->GetDXTTextureSupport() )
+    {
+        return;
+    }
+
+    // level 0 is compressed straight from the frame
+    compressFrame_ = frame_;
+    compressLevels_.Resize(1);
+    compressSizes_.Resize(1);
+    compressSizes_[0] = IntVector2(frame_->GetWidth(), frame_->GetHeight());
+
+    if ( mipmaps_ && mipChain_ )
+    {
+        for ( unsigned level = 1; level < mipChain_->GetNumLevels(); ++level )
+        {
+            IntVector2 size = mipChain_->GetLevelSize(level);
+            compressLevels_.Push(PODVector<unsigned char>());
+            compressLevels_.Back().Resize(size.x_*size.y_*CEFBUF_COMPONENTS);
+            memcpy(&compressLevels_.Back()[0], mipChain_->GetLevelData(level), size.x_*size.y_*CEFBUF_COMPONENTS);
+            compressSizes_.Push(size);
+        }
+    }
+
+    // dxt1 when every tile is opaque
+    compressFormat_ = BLOCK_DXT1;
+
+    for ( unsigned i = 0; i < tileMap_.Size(); ++i )
+    {
+        if ( tileMap_[i] != TILE_OPAQUE )
+        {
+            compressFormat_ = BLOCK_DXT5;
+            break;
+        }
+    }
+
+    WorkQueue *queue = GetSubsystem<WorkQueue>();
+
+    compressDiscard_ = false;
+    compressItem_ = queue->GetFreeItem();
+    compressItem_->workFunction_ = CompressWorkFunction;
+    compressItem_->aux_ = this;
+    compressItem_->priority_ = 0;
+    queue->AddWorkItem(compressItem_);
+}
+
+void UBrowserImage::UpdateBake()
+{
+    if ( bakeUrl_.Empty() || baked_ || restoring_ || hibernated_ || cefRendererHandle_ == NULL )
+    {
+        return;
+    }
+
+    SimpleHandler *simpleHandler = SimpleHandler::GetInstance();
+
+    if ( simpleHandler == NULL || cefBrowser_ == NULL || !simpleHandler->HasLoadEnded(cefBrowser_->GetIdentifier()) )
+    {
+        return;
+    }
+
+    // settled - loaded and not painting, IsFrameNeeded() keeps the frame from being reclaimed
+    if ( ++bakeIdleCount_ < BAKE_IDLE_FRAMES )
+    {
+        return;
+    }
+
+    // no frame yet, retried on the next update
+    if ( frame_ == NULL )
+    {
+        return;
+    }
+
+    UBakedTextureCache *bakedCache = GetSubsystem<UBakedTextureCache>();
+
+    if ( bakedCache )
+    {
+        bakedCache->Store(bakeUrl_, frame_->GetData(), frame_->GetWidth(), frame_->GetHeight());
+    }
+
+    // one attempt per page load
+    baked_ = true;
+}
+
+bool UBrowserImage::IsFrameNeeded() const
+{
+    // a bake reads the last frame once the page has loaded, however long ago it painted
+    if ( !bakeUrl_.Empty() && !baked_ && !hibernated_ )
+    {
+        return true;
+    }
+
+    // so does a compression that hasn't started, unless it never can
+    if ( compressIdleFrames_ && !compressed_ && compressItem_ == NULL && !hibernated_ )
+    {
+        Graphics *graphics = GetSubsystem<Graphics>();
+        return graphics && graphics->GetDXTTextureSupport();
+    }
+
+    return false;
+}
+
+void UBrowserImage::CompressWorkFunction(const WorkItem *item, unsigned threadIndex)
+{
+    UBrowserImage *image = (UBrowserImage*)item->aux_;
+
+    for ( unsigned i = 0; i < image->compressLevels_.Size(); ++i )
+    {
+        const IntVector2 &size = image->compressSizes_[i];
+        const unsigned char *rgba = ( i == 0 ) ? image->compressFrame_->GetData() : &image->compressLevels_[i][0];
+        PODVector<unsigned char> blocks(UBlockCompressor::GetDataSize(image->compressFormat_, size.x_, size.y_));
+
+        if ( image->compressDiscard_ ||
+             !UBlockCompressor::Compress(image->compressFormat_, rgba, size.x_, size.y_, &blocks[0]) )
+        {
+            image->compressLevels_.Clear();
+            return;
+        }
+
+        image->compressLevels_[i] = blocks;
+    }
+}
+
+void UBrowserImage::ApplyCompressed()
+{
+    SharedPtr<Texture2D> texture(new Texture2D(context_));
+
+    texture->SetNumLevels(compressLevels_.Size());
+    CompressedFormat format = ( compressFormat_ == BLOCK_DXT1 ) ? CF_DXT1 : CF_DXT5;
+    texture->SetSize(compressSizes_[0].x_, compressSizes_[0].y_, GetSubsystem<Graphics>()->GetFormat(format));
+    texture->SetFilterMode(mipmaps_ ? FILTER_TRILINEAR : FILTER_BILINEAR);
+    texture->SetAddressMode(COORD_U, ADDRESS_CLAMP);
+    texture->SetAddressMode(COORD_V, ADDRESS_CLAMP);
+
+    for ( unsigned i = 0; i < compressLevels_.Size(); ++i )
+    {
+        texture->SetData(i, 0, 0, compressSizes_[i].x_, compressSizes_[i].y_, &compressLevels_[i][0]);
+    }
+
+    // the rgba ring is released, its vram is what compression saves
+    textureRing_.Clear();
+    ringDirty_.Clear();
+    ringIndex_ = 0;
+    texture_ = texture;
+    SetTexture(texture_);
+    compressed_ = true;
+
+    SDL_Log("compressed: %s %dx%d", compressFormat_ == BLOCK_DXT1 ? "dxt1" : "dxt5", compressSizes_[0].x_, compressSizes_[0].y_);
+}
+
+void UBrowserImage::RestoreUncompressed()
+{
+    if ( compressItem_ )
+    {
+        compressDiscard_ = true;
+    }
+
+    if ( !compressed_ )
+    {
+        return;
+    }
+
+    // a new ring is fully dirty, the paint that triggered this is a full frame
+    compressed_ = false;
+    CreateTextureRing();
+    SetTexture(texture_);
+}
+
+void UBrowserImage::WaitForCompress()
 {
-    copyBuffer_ = new unsigned char[width*height*components];
+    if ( compressItem_ == NULL )
+    {
+        return;
+    }
+
+    compressDiscard_ = true;
+
+    WorkQueue *queue = GetSubsystem<WorkQueue>();
+
+    if ( queue == NULL || !queue->RemoveWorkItem(compressItem_) )
+    {
+        while ( !compressItem_->completed_ )
+        {
+            Time::Sleep(0);
+        }
+    }
+
+    compressItem_ = NULL;
 }
 
-UCefRenderHandle::~UCefRenderHandle()
+void UBrowserImage::SetMipmaps(bool enable)
 {
-    copyBuffer_ = NULL;
-    browser_ = NULL;
+    if ( enable == mipmaps_ )
+    {
+        return;
+    }
+
+    WaitForMips();
+    WaitForCompress();
+    mipmaps_ = enable;
+    mipDirty_ = IntVector2::ZERO;
+
+    // the ring is recreated with or without levels, the next paint fills it.
+    // a compressed page keeps its texture until it changes
+    if ( texture_ && !compressed_ )
+    {
+        CreateTextureRing();
+        SetTexture(texture_);
+    }
 }
 
-bool UCefRenderHandle::GetViewRect(CefRefPtr<CefBrowser> browser, CefRect& rect)
+void UBrowserImage::UpdatePopup()
 {
-    rect = CefRect(0, 0, width_, height_);
-    return true;
+    if ( !cefRendererHandle_->IsPopupVisible() )
+    {
+        if ( popupImage_->IsVisible() )
+        {
+            popupImage_->SetVisible(false);
+        }
+        return;
+    }
+
+    // only the popup's pixels are uploaded, the view texture is untouched
+    if ( cefRendererHandle_->CopyPopupToTexture(popupTexture_) )
+    {
+        popupImage_->SetTexture(popupTexture_);
+        popupImage_->SetFullImageRect();
+    }
+
+    // popup rect is in cef view coords
+    IntRect rect = cefRendererHandle_->GetPopupRect();
+    popupImage_->SetPosition((int)((float)rect.left_/scaleDiff_.x_), (int)((float)rect.top_/scaleDiff_.y_));
+    popupImage_->SetSize((int)((float)rect.Width()/scaleDiff_.x_), (int)((float)rect.Height()/scaleDiff_.y_));
+
+    if ( !popupImage_->IsVisible() && rect.Width() > 0 && popupTexture_->GetWidth() > 0 )
+    {
+        popupImage_->SetVisible(true);
+    }
 }
 
-void UCefRenderHandle::OnPaint(CefRefPtr<CefBrowser> browser, PaintElementType ttype, 
-                               const RectList& dirtyRects, const void* buffer, int width, int height)
+bool UBrowserImage::IsInside(IntVector2 position, bool isScreen)
 {
-    if ( IsShuttingDown() )
+    if ( !BorderImage::IsInside(position, isScreen) )
     {
-        return;
+        return false;
     }
 
-    if ( copyTimer_.GetMSec(false) < FRAME_RATE_MS )
+    if ( !alphaHitTest_ || hitMask_.Empty() )
     {
-        return;
+        return true;
     }
 
-    if ( width != width_ || height != height_ )
+    if ( isScreen )
     {
-        MutexLock lock(copyMutex_);
+        position = ScreenToElement(position);
+    }
 
-        width_ = width;
-        height_ = height;
-        copyBuffer_ = new unsigned char[width_*height_*components_];
+    // an open popup is always hit
+    if ( popupImage_ && popupImage_->IsVisible() )
+    {
+        IntRect popupRect(popupImage_->GetPosition(), popupImage_->GetPosition() + popupImage_->GetSize());
+
+        if ( popupRect.IsInside(position) == INSIDE )
+        {
+            return true;
+        }
     }
 
-    if ( browser_ == NULL )
+    // element coords to cef view coords to mask block
+    int x = (int)((float)position.x_ * scaleDiff_.x_) >> CEFBUF_HITMASK_SHIFT;
+    int y = (int)((float)position.y_ * scaleDiff_.y_) >> CEFBUF_HITMASK_SHIFT;
+
+    if ( x < 0 || y < 0 || x >= hitMaskBlocks_.x_ || y >= hitMaskBlocks_.y_ )
     {
-        browser_ = browser;
+        return true;
     }
 
-    CopyBuffer(copyBuffer_.Get(), (void*)buffer, width_*height_*components_);
+    unsigned stride = (hitMaskBlocks_.x_ + 31) >> 5;
 
-    copyTimer_.Reset();
+    return ( hitMask_[y*stride + (x >> 5)] & (1U << (x & 31)) ) != 0;
 }
 
-void UCefRenderHandle::Resize(int width, int height)
+void UBrowserImage::GetBatches(PODVector<UIBatch>& batches, PODVector<float>& vertexData, const IntRect& currentScissor)
 {
-    if ( width != width_ || height != height_ )
+    if ( !tileBatching_ || tileMap_.Empty() || texture_ == NULL )
     {
-        MutexLock lock(copyMutex_);
+        BorderImage::GetBatches(batches, vertexData, currentScissor);
+        return;
+    }
 
-        width_ = width;
-        height_ = height;
-        copyBuffer_ = new unsigned char[width_*height_*components_];
+    // opaque tiles only skip blending when the element itself is fully opaque
+    bool replaceOpaque = ( blendMode_ == BLEND_ALPHA && GetDerivedOpacity() >= 1.0f );
+
+    UIBatch opaqueBatch(this, replaceOpaque ? BLEND_REPLACE : blendMode_, currentScissor, texture_, &vertexData);
+    UIBatch blendBatch(this, blendMode_, currentScissor, texture_, &vertexData);
+
+    int tileSize = 1 << CEFBUF_TILE_SHIFT;
+    int viewWidth = Min(tiles_.x_*tileSize, (int)texture_->GetWidth());
+    int viewHeight = Min(tiles_.y_*tileSize, (int)texture_->GetHeight());
+
+    for ( int ty = 0; ty < tiles_.y_; ++ty )
+    {
+        const unsigned char *tileRow = &tileMap_[ty*tiles_.x_];
+        int texTop = ty*tileSize;
+        int texBottom = Min(texTop + tileSize, viewHeight);
+        int top = (int)((float)texTop/scaleDiff_.y_);
+        int bottom = (int)((float)texBottom/scaleDiff_.y_);
+
+        // runs of equal tiles go out as one quad
+        for ( int tx = 0; tx < tiles_.x_; )
+        {
+            unsigned char occupancy = tileRow[tx];
+            int runEnd = tx + 1;
+
+            while ( runEnd < tiles_.x_ && tileRow[runEnd] == occupancy )
+            {
+                ++runEnd;
+            }
+
+            if ( occupancy != TILE_EMPTY )
+            {
+                int texLeft = tx*tileSize;
+                int texRight = Min(runEnd*tileSize, viewWidth);
+                int left = (int)((float)texLeft/scaleDiff_.x_);
+                int right = (int)((float)texRight/scaleDiff_.x_);
+
+                UIBatch &batch = ( occupancy == TILE_OPAQUE ) ? opaqueBatch : blendBatch;
+                batch.AddQuad(left, top, right - left, bottom - top, texLeft, texTop, texRight - texLeft, texBottom - texTop);
+            }
+
+            tx = runEnd;
+        }
     }
+
+    UIBatch::AddOrMerge(opaqueBatch, batches);
+    UIBatch::AddOrMerge(blendBatch, batches);
+
+    // reset hovering for next frame
+    hovering_ = false;
 }
 
-void UCefRenderHandle::CopyBuffer(void *dst, void *src, unsigned usize)
+bool UBrowserImage::HasPendingUpload() const
 {
-    MutexLock lock(copyMutex_);
-    //HiresTimer htimer;
+    // with a ring, only upload when the displayed texture is missing rows
+    return ( textureRing_.Size() && ringDirty_[ringIndex_].x_ < ringDirty_[ringIndex_].y_ );
+}
 
-    struct CefColor
+unsigned UBrowserImage::UploadPending(unsigned maxBytes)
+{
+    // upload into a texture that isn't sampled by the ui batch of this frame, then swap
+    unsigned backIndex = (ringIndex_ + 1) % textureRing_.Size();
+    IntVector2 &rows = ringDirty_[backIndex];
+    unsigned rowBytes = frame_ ? frame_->GetRowBytes() : 0;
+    unsigned bytes = 0;
+
+    if ( rows.x_ < rows.y_ && rowBytes )
     {
-        unsigned char r_, g_, b_, a_;
-    };
+        int numRows = Min(rows.y_ - rows.x_, (int)Min(maxBytes/rowBytes, (unsigned)M_MAX_INT));
 
-    #ifdef INDIVIDUAL_RGBA_CPY
-    CefColor *fsrc = (CefColor*)src;
-    CefColor *fdst = (CefColor*)dst;
+        if ( numRows > 0 )
+        {
+            bytes = UploadRows(textureRing_[backIndex], rows.x_, numRows);
 
-    for ( unsigned i = 0; i < usize/sizeof(CefColor); ++i )
+            if ( bytes )
+            {
+                rows.x_ += numRows;
+            }
+        }
+    }
+
+    // swap once the back texture is complete
+    if ( rows.x_ >= rows.y_ )
     {
-        fdst[i].r_ = fsrc[i].b_;
-        fdst[i].g_ = fsrc[i].g_;
-        fdst[i].b_ = fsrc[i].r_;
-        fdst[i].a_ = fsrc[i].a_;
+        rows = IntVector2::ZERO;
+        ringIndex_ = backIndex;
+        texture_ = textureRing_[ringIndex_];
+        SetTexture(texture_);
+        pendingFrames_ = 0;
+
+        tileMap_ = pendingTileMap_;
+        tiles_ = pendingTiles_;
+
+        // show on the first frame only, hidden browsers stay hidden
+        if ( !firstFrameShown_ )
+        {
+            SetVisible(true);
+            firstFrameShown_ = true;
+        }
     }
-    //SDL_Log("rgba cp = %I64d", htimer.GetUSec(false) );
 
-    #else
-    // doing mempcy first then doing the r-b swap in shared ptr 
-    // array is about 20%-40% faster than individual rgba cpy
-    // -sample output data (in usecs):
-    //INFO: rgba cp = 12581
-    //INFO: rgba cp = 16775
-    //INFO: rgba cp = 18151
-    //INFO: rgba cp = 19887
-    //INFO: memcpy - rb swap = 11272
-    //INFO: memcpy - rb swap = 12205
-    //INFO: memcpy - rb swap = 14512
-    //INFO: memcpy - rb swap = 7541
+    return bytes;
+}
 
-    memcpy(dst, src, usize);
+unsigned UBrowserImage::UploadRows(Texture2D *texture, int top, int rows)
+{
+    if ( frame_ == NULL || rows <= 0 || top < 0 || top + rows > frame_->GetHeight() )
+    {
+        return 0;
+    }
 
-    CefColor *fdst = (CefColor*)dst;
+    // full-width row bands are contiguous in the frame, no lock needed as frames are immutable
+    uploadTimer_.Reset();
+    texture->SetData(0, 0, top, frame_->GetWidth(), rows, frame_->GetRow(top));
 
-    for ( unsigned i = 0; i < usize/sizeof(CefColor); ++i )
+    uploadUSec_ += uploadTimer_.GetUSec(false);
+    ++uploadCount_;
+
+    return rows*frame_->GetRowBytes();
+}
+
+unsigned UBrowserImage::GetAvgUploadUSec(bool reset)
+{
+    unsigned avgUSec = uploadCount_ ? (unsigned)(uploadUSec_/uploadCount_) : 0;
+
+    if ( reset )
     {
-        unsigned char tmp = fdst[i].r_;
-        fdst[i].r_ = fdst[i].b_;
-        fdst[i].b_ = tmp;
+        uploadUSec_ = 0;
+        uploadCount_ = 0;
     }
-    //SDL_Log("memcpy - rb swap = %I64d", htimer.GetUSec(false) );
-    #endif
 
-    bufferUpdated_ = true;
+    return avgUSec;
 }
 
-void UCefRenderHandle::CopyToTexture(Texture2D *texture)
+unsigned UBrowserImage::GetUploadPriority(unsigned maxStarveFrames) const
 {
-    MutexLock lock(copyMutex_);
+    // starving > focused > visible > screen coverage
+    unsigned priority = Min((unsigned)(GetWidth()*GetHeight()), (unsigned)UPLOAD_PRIORITY_COVERAGE);
 
-    if ( bufferUpdated_ )
+    if ( IsVisible() )
     {
-        texture->SetData(0, 0, 0, width_, height_, copyBuffer_.Get());
-        bufferUpdated_ = false;
+        priority |= UPLOAD_PRIORITY_VISIBLE;
+    }
+    if ( IsInteractive() )
+    {
+        priority |= UPLOAD_PRIORITY_FOCUSED;
+    }
+    if ( pendingFrames_ > maxStarveFrames )
+    {
+        priority |= UPLOAD_PRIORITY_STARVING;
     }
-}
 
-void UCefRenderHandle::Shutdown()
-{ 
-    isShuttingDown_ = true; 
+    return priority;
 }
 
-bool UCefRenderHandle::IsShuttingDown()
+void UBrowserImage::UpdatePaintRate(unsigned msec)
 {
-    return isShuttingDown_;
+    unsigned paintCount = cefRendererHandle_ ? cefRendererHandle_->TakePaintCount() : 0;
+
+    paintRate_ = msec ? paintCount * 1000 / msec : 0;
 }
 
-//=============================================================================
-//=============================================================================
-UBrowserImage::UBrowserImage(Context *context)
-    : BorderImage(context)
-    , cefBrowser_(NULL)
-    , cefRendererHandle_(NULL)
+void UBrowserImage::ApplyFrameRate(FrameRateRole role, int frameRate)
 {
+    frameRateRole_ = role;
+
+    if ( cefBrowser_ == NULL )
+    {
+        return;
+    }
+
+    // a recreated browser (hibernation) starts with the default rate
+    int browserId = cefBrowser_->GetIdentifier();
+
+    if ( frameRate != frameRate_ || browserId != frameRateBrowserId_ )
+    {
+        cefBrowser_->GetHost()->SetWindowlessFrameRate(frameRate);
+        frameRate_ = frameRate;
+        frameRateBrowserId_ = browserId;
+    }
 }
 
-UBrowserImage::~UBrowserImage()
+void UBrowserImage::AddDirtyRows(IntVector2 &dirty, const IntVector2 &rows)
 {
-    cefRendererHandle_ = NULL;
-    cefBrowser_ = NULL;
+    if ( dirty.x_ >= dirty.y_ )
+    {
+        dirty = rows;
+    }
+    else
+    {
+        dirty.x_ = Min(dirty.x_, rows.x_);
+        dirty.y_ = Max(dirty.y_, rows.y_);
+    }
 }
 
-void UBrowserImage::ClearCefHandler()
+void UBrowserImage::UpdateHibernation()
 {
-    if ( cefRendererHandle_ )
+    if ( hibernated_ )
     {
-        cefRendererHandle_->Shutdown();
-        cefRendererHandle_->browser_ = NULL;
+        if ( wakeOnVisible_ && IsVisible() )
+        {
+            WakeUp();
+        }
+        return;
     }
 
-    if ( cefBrowser_ )
+    if ( restoring_ )
     {
-        cefBrowser_ = NULL;
+        SimpleHandler *simpleHandler = SimpleHandler::GetInstance();
+
+        // only the recreated browser's own load counts, other panels load too
+        if ( cefBrowser_ && simpleHandler && simpleHandler->HasLoadEnded(cefBrowser_->GetIdentifier()) )
+        {
+            if ( hibernateScroll_ != IntVector2::ZERO )
+            {
+                String script = "window.scrollTo(" + String(hibernateScroll_.x_) + "," + String(hibernateScroll_.y_) + ");";
+                cefBrowser_->GetMainFrame()->ExecuteJavaScript(script.CString(), hibernateUrl_.CString(), 0);
+            }
+
+            restoring_ = false;
+            idleTimer_.Reset();
+        }
+        return;
+    }
+
+    if ( hibernateTimeMS_ == 0 || cefBrowser_ == NULL )
+    {
+        return;
+    }
+
+    if ( IsVisible() && IsInteractive() )
+    {
+        idleTimer_.Reset();
+    }
+    else if ( idleTimer_.GetMSec(false) > hibernateTimeMS_ )
+    {
+        Hibernate();
     }
 }
 
-void UBrowserImage::Init(UCefRenderHandle *cefRenderHandler, int width, int height)
+void UBrowserImage::Hibernate()
 {
-    InitTexture(width, height);
+    if ( hibernated_ || cefBrowser_ == NULL || cefRendererHandle_ == NULL )
+    {
+        return;
+    }
 
-    cefRendererHandle_ = cefRenderHandler;
+    hibernateUrl_ = cefBrowser_->GetMainFrame()->GetURL().ToString().c_str();
+    hibernateScroll_ = cefRendererHandle_->GetScrollOffset();
+    wakeOnVisible_ = !IsVisible();
 
-    RegisterHandlers();
+    // texture_ keeps the last frame as the placeholder
+    cefRendererHandle_->Hibernate();
+    frame_ = NULL;
+
+    // the ring would wait forever for rows of a frame that's gone
+    for ( unsigned i = 0; i < ringDirty_.Size(); ++i )
+    {
+        ringDirty_[i] = IntVector2::ZERO;
+    }
+    pendingFrames_ = 0;
+    cefBrowser_->GetHost()->CloseBrowser(true);
+    cefBrowser_ = NULL;
+
+    hibernated_ = true;
+
+    SDL_Log("hibernate: %s", hibernateUrl_.CString());
 }
 
-void UBrowserImage::InitTexture(int width, int height)
+void UBrowserImage::WakeUp()
 {
-    texture_ = new Texture2D(context_);
-    
-    // set texture format
-    texture_->SetMipsToSkip(QUALITY_LOW, 0);
-    texture_->SetNumLevels(1);
-    texture_->SetSize(CEFBUF_WIDTH, CEFBUF_HEIGHT, Graphics::GetRGBAFormat());
-    
-    // set modes
-    texture_->SetFilterMode(FILTER_BILINEAR);
-    texture_->SetAddressMode(COORD_U, ADDRESS_CLAMP);
-    texture_->SetAddressMode(COORD_V, ADDRESS_CLAMP);
+    SimpleHandler *simpleHandler = SimpleHandler::GetInstance();
 
-    width_ = width;
-    height_ = height;
+    if ( !hibernated_ || simpleHandler == NULL )
+    {
+        return;
+    }
 
-    scaleDiff_ = Vector2( (float)CEFBUF_WIDTH/(float)width_, (float)CEFBUF_HEIGHT/(float)height_ );
-    initalOffset_ = IntVector2(20, 20);
+    CefWindowInfo window_info;
+    window_info.SetAsWindowless(NULL, false);
+    CefBrowserSettings browser_settings;
 
-    // init 
-    SetVisible(false);
-    SetPosition(initalOffset_);
-    SetTexture(texture_);
-    SetSize(width_, height_);
-    SetEnabled(true);
-    SetOpacity(0.95f);
+    CefBrowserHost::CreateBrowser(window_info, simpleHandler, hibernateUrl_.CString(), browser_settings, NULL);
+
+    hibernated_ = false;
+    wakeOnVisible_ = false;
+    restoring_ = true;
+
+    SDL_Log("wake up: %s", hibernateUrl_.CString());
 }
 
-void UBrowserImage::UpdateBuffer()
+void UBrowserImage::SetTextureRingSize(unsigned size)
 {
-    // check timer before appready
-    if ( copyTimer_.GetMSec(false) < FRAME_RATE_MS || !IsAppReady())
+    size = Clamp(size, 1U, (unsigned)CEFBUF_TEXTURE_RING_MAX);
+
+    if ( size != textureRingSize_ )
     {
-        return;
+        textureRingSize_ = size;
+
+        if ( texture_ && !compressed_ )
+        {
+            CreateTextureRing();
+            SetTexture(texture_);
+        }
     }
+}
+
+void UBrowserImage::CreateTextureRing()
+{
+    textureRing_.Clear();
+    ringDirty_.Clear();
+
+    for ( unsigned i = 0; i < textureRingSize_; ++i )
+    {
+        SharedPtr<Texture2D> texture(new Texture2D(context_));
 
-    // copy buffer
-    cefRendererHandle_->CopyToTexture( texture_ );
-    copyTimer_.Reset();
+        // set texture format, 0 levels is a full chain
+        texture->SetMipsToSkip(QUALITY_LOW, 0);
+        texture->SetNumLevels(mipmaps_ ? 0 : 1);
+        texture->SetSize(CEFBUF_WIDTH, CEFBUF_HEIGHT, Graphics::GetRGBAFormat());
 
-    cefBrowser_ = cefRendererHandle_->browser_;
+        // set modes
+        texture->SetFilterMode(mipmaps_ ? FILTER_TRILINEAR : FILTER_BILINEAR);
+        texture->SetAddressMode(COORD_U, ADDRESS_CLAMP);
+        texture->SetAddressMode(COORD_V, ADDRESS_CLAMP);
 
-    if ( !IsVisible() )
+        textureRing_.Push(texture);
+        ringDirty_.Push(IntVector2(0, CEFBUF_HEIGHT));
+    }
+
+    ringIndex_ = 0;
+    texture_ = textureRing_[ringIndex_];
+
+    if ( mipmaps_ )
     {
-        SetVisible(true);
+        if ( mipChain_ == NULL )
+        {
+            mipChain_ = new UMipChain();
+        }
+        mipChain_->SetSize(CEFBUF_WIDTH, CEFBUF_HEIGHT);
+        mipDirty_ = IntVector2(0, CEFBUF_HEIGHT);
     }
 }
 
@@ -283,6 +1634,7 @@ bool UBrowserImage::IsAppReady() const
 void UBrowserImage::RegisterHandlers()
 {
     // timer
+    SubscribeToEvent(E_BEGINFRAME, URHO3D_HANDLER(UBrowserImage, HandleBeginFrame));
     SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(UBrowserImage, HandleUpdate));
 
     // screen resize and renderer
@@ -303,19 +1655,122 @@ void UBrowserImage::RegisterHandlers()
 void UBrowserImage::HandleUpdate(StringHash eventType, VariantMap& eventData)
 {
     UpdateBuffer();
+
+    // the frame is released along with the handler's, sinks keep their own references
+    if ( cefRendererHandle_ && !HasPendingUpload() && mipItem_ == NULL && mipDirty_.x_ >= mipDirty_.y_ && !IsFrameNeeded() )
+    {
+        if ( cefRendererHandle_->ReclaimIdleBuffer() )
+        {
+            frame_ = NULL;
+        }
+    }
+
+    UpdateCompression();
+    UpdateBake();
+    UpdateHibernation();
+}
+
+void UBrowserImage::HandleBeginFrame(StringHash eventType, VariantMap& eventData)
+{
+    if ( cefRendererHandle_ == NULL )
+    {
+        return;
+    }
+
+    long long now = UCefRenderHandle::GetFrameClockUSec();
+
+    if ( lastBeginFrameUSec_ > 0 )
+    {
+        float interval = (float)(now - lastBeginFrameUSec_);
+        engineIntervalUSec_ = ( engineIntervalUSec_ > 0.0f ) ? Lerp(engineIntervalUSec_, interval, 0.1f) : interval;
+    }
+
+    lastBeginFrameUSec_ = now;
+    cefRendererHandle_->SetBeginFrameTime(now);
+
+    UpdateFramePhase();
+}
+
+void UBrowserImage::UpdateFramePhase()
+{
+    long long paintPhase = cefRendererHandle_->TakePaintPhaseUSec();
+
+    if ( cefBrowser_ == NULL || frameRate_ <= 0 || engineIntervalUSec_ <= 0.0f || paintPhase < 0 )
+    {
+        return;
+    }
+
+    // a paint landing just before the next engine frame is uploaded with the least latency,
+    // one landing just after it waits a whole frame
+    float interval = engineIntervalUSec_;
+    float phase = fmodf((float)paintPhase, interval);
+    float target = interval - BEGINFRAME_MARGIN_USEC;
+
+    if ( phaseArmed_ )
+    {
+        float latency = fmodf(phase - armedPhaseUSec_ + interval, interval);
+        paintLatencyUSec_ = Lerp(paintLatencyUSec_, latency, 0.2f);
+    }
+
+    if ( phase > target || phase < target - BEGINFRAME_TOLERANCE_USEC )
+    {
+        ++phaseMisses_;
+    }
+    else
+    {
+        phaseMisses_ = 0;
+    }
+
+    // re-arm chromium's timer so that its tick leads the target by the measured paint latency
+    if ( phaseMisses_ >= BEGINFRAME_DRIFT_FRAMES && rearmTimer_.GetMSec(false) >= BEGINFRAME_REARM_MS )
+    {
+        armedPhaseUSec_ = Max(target - paintLatencyUSec_, 0.0f);
+        phaseArmed_ = true;
+        phaseMisses_ = 0;
+        rearmTimer_.Reset();
+
+        cefRendererHandle_->RearmFrameTimer(frameRate_, (int)(armedPhaseUSec_/1000.0f));
+    }
 }
 
 void UBrowserImage::HandleFocusChanged(StringHash eventType, VariantMap& eventData)
 {
     if ( cefBrowser_ )
     {
-        cefBrowser_->GetHost()->SendFocusEvent(IsHovering());
+        cefBrowser_->GetHost()->SendFocusEvent(HasFocus());
+    }
+}
+
+void UBrowserImage::NotifyInput()
+{
+    lastInputMSec_ = Time::GetSystemTime();
+    hadInput_ = true;
+
+    // a page being read or hovered doesn't hibernate
+    idleTimer_.Reset();
+}
+
+bool UBrowserImage::IsInteractive() const
+{
+    if ( HasFocus() )
+    {
+        return true;
     }
+
+    return hadInput_ && Time::GetSystemTime() - lastInputMSec_ < CEFBUF_INTERACTIVE_MSEC;
 }
 
 void UBrowserImage::OnHover(const IntVector2& position, const IntVector2& screenPosition, 
                             int buttons, int qualifiers, Cursor* cursor)
 {
+    BorderImage::OnHover(position, screenPosition, buttons, qualifiers, cursor);
+    NotifyInput();
+
+    if ( hibernated_ )
+    {
+        WakeUp();
+    }
+
     if ( cefBrowser_ )
     {
         lastMousePos_ = position;
@@ -328,6 +1783,13 @@ void UBrowserImage::OnHover(const IntVector2& position, const IntVector2& screen
 void UBrowserImage::OnClickBegin(const IntVector2& position, const IntVector2& screenPosition, 
                                  int button, int buttons, int qualifiers, Cursor* cursor)
 {
+    NotifyInput();
+
+    if ( hibernated_ )
+    {
+        WakeUp();
+    }
+
     if ( cefBrowser_ )
     {
         lastMousePos_ = position;
@@ -342,6 +1804,8 @@ void UBrowserImage::OnClickBegin(const IntVector2& position, const IntVector2& s
 void UBrowserImage::OnClickEnd(const IntVector2& position, const IntVector2& screenPosition, 
                                int button, int buttons, int qualifiers, Cursor* cursor, UIElement* beginElement)
 {
+    NotifyInput();
+
     if ( cefBrowser_ )
     {
         lastMousePos_ = position;
@@ -362,6 +1826,13 @@ void UBrowserImage::HandleMouseWheel(StringHash eventType, VariantMap& eventData
     int qualifiers = eventData[P_QUALIFIERS].GetInt();
     int delta = eventData[P_WHEEL].GetInt();
 
+    // wheel events are global, only scrolling over this browser counts as input
+    UI *ui = GetSubsystem<UI>();
+    if ( ui->GetElementAt(ui->GetCursorPosition()) == this )
+    {
+        NotifyInput();
+    }
+
     if ( cefBrowser_ )
     {
         CefMouseEvent cevent = GetCefMoustEvent(qualifiers);
@@ -390,6 +1861,12 @@ void UBrowserImage::HandleKeyDown(StringHash eventType, VariantMap& eventData)
     int qualifiers = eventData[P_QUALIFIERS].GetInt();
     int key = eventData[P_KEY].GetInt();
 
+    // key events are global, typing only keeps an interactive browser interactive
+    if ( IsInteractive() )
+    {
+        NotifyInput();
+    }
+
     if ( cefBrowser_ )
     {
         CefKeyEvent cevent;
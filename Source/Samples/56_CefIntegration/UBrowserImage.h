@@ -24,27 +24,65 @@
 
 #include <Urho3D/UI/Window.h>
 #include <Urho3D/UI/BorderImage.h>
+#include <Urho3D/UI/UIBatch.h>
+#include <Urho3D/Resource/Image.h>
 #include <Urho3D/Container/ArrayPtr.h>
 
 #include <cef_render_handler.h>
 
+#include "UFrameSink.h"
+#include "UBlockCompressor.h"
+
 namespace Urho3D
 {
 class Texture2D;
+struct WorkItem;
 }
 
 using namespace Urho3D;
 class CefAppThread;
+class UMipChain;
 
 //=============================================================================
 //=============================================================================
 #define CEFBUF_WIDTH            1100
 #define CEFBUF_HEIGHT           700
 #define CEFBUF_COMPONENTS       4
+#define CEFBUF_RECLAIM_IDLE_FRAMES  60
+#define CEFBUF_TEXTURE_RING     2
+#define CEFBUF_TEXTURE_RING_MAX 3
+#define CEFBUF_COMPRESS_IDLE_FRAMES 30
+#define CEFBUF_FRAME_POOL       2
+#define CEFBUF_INTERACTIVE_MSEC 3000
+
+// alpha hit-test mask, 1 bit per 4x4 pixel block
+#define CEFBUF_HITMASK_SHIFT    2
+#define CEFBUF_HITMASK_ALPHA    0
+
+// tile occupancy, 64x64 pixel tiles
+#define CEFBUF_TILE_SHIFT       6
 
 #define BROWSER_RENDER_WIDTH    640
 #define BROWSER_RENDER_HEIGTH   480
 
+// frame rate roles assigned by UFrameRateScheduler
+enum FrameRateRole
+{
+    FRR_FOCUSED,
+    FRR_VIDEO,
+    FRR_PASSIVE,
+    FRR_BACKGROUND,
+    MAX_FRAMERATE_ROLES
+};
+
+// tile occupancy classes
+enum TileOccupancy
+{
+    TILE_EMPTY,
+    TILE_OPAQUE,
+    TILE_MIXED
+};
+
 //=============================================================================
 //=============================================================================
 class UCefRenderHandle : public CefRenderHandler
@@ -62,18 +100,89 @@ public:
                          const RectList& dirtyRects,
                          const void* buffer,
                          int width, int height);
+    virtual void OnScrollOffsetChanged(CefRefPtr<CefBrowser> browser, double x, double y);
+    virtual void OnPopupShow(CefRefPtr<CefBrowser> browser, bool show);
+    virtual void OnPopupSize(CefRefPtr<CefBrowser> browser, const CefRect& rect);
 
     void Resize(int width, int height);
-    void CopyBuffer(void *dst, void *src, unsigned usize);
-    void CopyToTexture(Texture2D *texture);
+    void CopyBuffer(void *dst, void *src, unsigned usize, unsigned *alphaMask = NULL, unsigned char *tileAlpha = NULL);
     bool IsUpdated()const   { return bufferUpdated_; }
+
+    // publishes the latest frame with the rows painted since the last call, NULL without a new paint
+    CefRefPtr<UBrowserFrame> TakeFrame();
+    unsigned TakePaintCount();
+
+    // begin frame sync
+    void SetBeginFrameTime(long long usec);
+    long long TakePaintPhaseUSec();
+    void RearmFrameTimer(int frameRate, int delayMS);
+    static long long GetFrameClockUSec();
+
+    // popup
+    bool IsPopupVisible();
+    IntRect GetPopupRect();
+    bool CopyPopupToTexture(Texture2D *texture);
     void Shutdown();
     bool IsShuttingDown();
 
+    // hibernation - the browser is closed asynchronously, its late paints are dropped
+    void Hibernate();
+    IntVector2 GetScrollOffset() const { return scrollOffset_; }
+
+    // the browser painting into this handle, NULL until its first paint
+    CefRefPtr<CefBrowser> GetBrowser();
+
+    // alpha hit-test - blocks with any pixel above the alpha threshold are hit
+    void SetHitTestAlpha(unsigned char alpha) { hitTestAlpha_ = alpha; }
+    bool TakeAlphaMask(PODVector<unsigned> &mask, IntVector2 &blocks);
+
+    // tile occupancy of the last paint, one TileOccupancy per tile
+    bool TakeTileMap(PODVector<unsigned char> &tileMap, IntVector2 &tiles);
+
+    // staging memory - 0 frames never releases the frames
+    void SetReclaimIdleFrames(unsigned frames) { reclaimIdleFrames_ = frames; }
+    bool ReclaimIdleBuffer();
+    static unsigned GetResidentStagingBytes();
+
     CefRefPtr<CefBrowser> browser_;
 
 protected:
-    SharedArrayPtr<unsigned char> copyBuffer_;
+    void AllocCopyBuffer();
+    void AcquireFrame();
+    void ReleaseCopyBuffer();
+    void AddDirtyRows(int top, int bottom);
+    void OnRearmFrameTimer(int frameRate);
+    bool AcceptBrowser(CefRefPtr<CefBrowser> browser);
+    void AllocPopupBuffer(int width, int height);
+    void ReleasePopupBuffer();
+
+protected:
+    // frame being painted, spares are reused once no sink holds them
+    CefRefPtr<UBrowserFrame> frame_;
+    Vector<CefRefPtr<UBrowserFrame> > spareFrames_;
+    unsigned frameNumber_;
+    IntVector2 dirtyRows_;
+    IntVector2 scrollOffset_;
+
+    // alpha hit-test mask
+    PODVector<unsigned> alphaMask_;
+    IntVector2 alphaMaskBlocks_;
+    unsigned alphaMaskStride_;
+    unsigned char hitTestAlpha_;
+    bool alphaMaskUpdated_;
+
+    // tile occupancy - or'ed and and'ed alpha per tile
+    PODVector<unsigned char> tileAlpha_;
+    PODVector<unsigned char> tileMap_;
+    IntVector2 tiles_;
+
+    // popup
+    SharedArrayPtr<unsigned char> popupBuffer_;
+    int popupWidth_;
+    int popupHeight_;
+    IntRect popupRect_;
+    bool popupVisible_;
+    bool popupUpdated_;
 
     int width_;
     int height_;
@@ -81,18 +190,27 @@ protected:
 
     bool bufferUpdated_;
     bool isShuttingDown_;
+    unsigned paintCount_;
 
-    Mutex copyMutex_;
+    // begin frame sync
+    long long beginFrameUSec_;
+    long long paintPhaseUSec_;
+    static HiresTimer frameClock_;
 
-    // dbg for cpy
-    HiresTimer htimer_;
+    // hibernated browsers still closing, their paints are ignored
+    PODVector<int> retiredBrowserIds_;
+    Mutex copyMutex_;
 
-    Timer copyTimer_;
+    // staging memory
+    unsigned idleFrames_;
+    unsigned reclaimIdleFrames_;
+    static Mutex    stagingMutex_;
+    static unsigned residentStagingBytes_;
 };
 
 //=============================================================================
 //=============================================================================
-class UBrowserImage : public BorderImage
+class UBrowserImage : public BorderImage, public UFrameSink
 {
     URHO3D_OBJECT(UBrowserImage, BorderImage);
 public:
@@ -102,9 +220,94 @@ public:
 
     void Init(UCefRenderHandle *cefRenderHandler, int width, int height);
     void ClearCefHandler();
+
+    // baked pages - InitBaked() shows a cached frame without a browser, SetBakeUrl() stores
+    // the frame of a live browser once the page has loaded and stopped painting
+    bool InitBaked(const String &url, int width, int height);
+    void SetBakeUrl(const String &url)  { bakeUrl_ = url; baked_ = false; bakeIdleCount_ = 0; }
+    const String& GetBakeUrl() const    { return bakeUrl_; }
+    bool IsBaked() const                { return baked_; }
+
+    // number of textures rotated for uploads, 1 uploads into the sampled texture
+    void SetTextureRingSize(unsigned size);
+    unsigned GetTextureRingSize() const { return textureRingSize_; }
+
+    // cpu generated mip levels for in-world browsers, rebuilt on a worker for the dirty rows only
+    void SetMipmaps(bool enable);
+    bool GetMipmaps() const             { return mipmaps_; }
+
+    // block compress a page that hasn't painted for N frames on a worker, 0 frames disables it.
+    // the last frame isn't reclaimed until the compressor has taken it
+    void SetCompressIdleFrames(unsigned frames) { compressIdleFrames_ = frames; }
+    unsigned GetCompressIdleFrames() const      { return compressIdleFrames_; }
+    bool IsCompressed() const                   { return compressed_; }
+
+    // hibernation - 0 msec disables it
+    void SetHibernateTime(unsigned msec) { hibernateTimeMS_ = msec; }
+    unsigned GetHibernateTime() const    { return hibernateTimeMS_; }
+    bool IsHibernated() const            { return hibernated_; }
+    void Hibernate();
+    void WakeUp();
+
+    // frame sinks - every frame is handed to the texture path and then to each sink, no copies
+    void AddFrameSink(UFrameSink *frameSink);
+    void RemoveFrameSink(UFrameSink *frameSink);
+    virtual void OnFrame(UBrowserFrame *frame);
+    CefRefPtr<UBrowserFrame> GetFrame() const { return frame_; }
+
+    // upload scheduling
+    bool HasPendingUpload() const;
+    unsigned UploadPending(unsigned maxBytes);
+    unsigned GetUploadPriority(unsigned maxStarveFrames) const;
+    static unsigned GetAvgUploadUSec(bool reset);
+
+    // frame rate scheduling - a video frame rate of 0 lets the scheduler detect animated content
+    void SetVideoFrameRate(int fps)         { videoFrameRate_ = fps; }
+    int GetVideoFrameRate() const           { return videoFrameRate_; }
+    FrameRateRole GetFrameRateRole() const  { return frameRateRole_; }
+    int GetFrameRate() const                { return frameRate_; }
+    unsigned GetPaintRate() const           { return paintRate_; }
+    void UpdatePaintRate(unsigned msec);
+    void ApplyFrameRate(FrameRateRole role, int frameRate);
+    CefRefPtr<CefBrowser> GetBrowser() const { return cefBrowser_; }
+
+    // interaction - focused, or mouse/key input routed here within CEFBUF_INTERACTIVE_MSEC.
+    // UIElement's hovering is reset by GetBatches() before the next update reads it
+    void NotifyInput();
+    bool IsInteractive() const;
+
+    // alpha hit-test - clicks on transparent pixels fall through to whatever is underneath
+    void SetAlphaHitTest(bool enable)       { alphaHitTest_ = enable; }
+    bool GetAlphaHitTest() const            { return alphaHitTest_; }
+    virtual bool IsInside(IntVector2 position, bool isScreen);
+
+    // tile batching - empty tiles are not drawn, opaque tiles are drawn without blending
+    void SetTileBatching(bool enable)       { tileBatching_ = enable; }
+    bool GetTileBatching() const            { return tileBatching_; }
+    virtual void GetBatches(PODVector<UIBatch>& batches, PODVector<float>& vertexData, const IntRect& currentScissor);
+
+    // begin frame sync stats
+    float GetPaintLatencyUSec() const       { return paintLatencyUSec_; }
+    float GetEngineIntervalUSec() const     { return engineIntervalUSec_; }
+
 protected:
     void InitTexture(int width, int height);
+    void CreateTextureRing();
+    void AddDirtyRows(IntVector2 &dirty, const IntVector2 &rows);
     void UpdateBuffer();
+    unsigned UploadRows(Texture2D *texture, int top, int rows);
+    void UpdatePopup();
+    void UpdateHibernation();
+    void UpdateMips();
+    void WaitForMips();
+    static void MipWorkFunction(const WorkItem *item, unsigned threadIndex);
+    void UpdateCompression();
+    void UpdateBake();
+    bool IsFrameNeeded() const;
+    void ApplyCompressed();
+    void RestoreUncompressed();
+    void WaitForCompress();
+    static void CompressWorkFunction(const WorkItem *item, unsigned threadIndex);
 
     bool IsAppReady() const;
     void RegisterHandlers();
@@ -112,7 +315,8 @@ protected:
 
     // renderer
     void HandleScreenMode(StringHash eventType, VariantMap& eventData);
-    //void HandleBeginFrame(StringHash eventType, VariantMap& eventData);
+    void HandleBeginFrame(StringHash eventType, VariantMap& eventData);
+    void UpdateFramePhase();
     //void HandlePostUpdate(StringHash eventType, VariantMap& eventData);
     //void HandlePostRenderUpdate(StringHash eventType, VariantMap& eventData);
 
@@ -137,12 +341,95 @@ protected:
     CefRefPtr<CefBrowser>       cefBrowser_;
     CefRefPtr<UCefRenderHandle> cefRendererHandle_;
     SharedPtr<Texture2D>        texture_;
+    Vector<SharedPtr<Texture2D> > textureRing_;
+    unsigned                    textureRingSize_;
+    unsigned                    ringIndex_;
+    PODVector<IntVector2>       ringDirty_;
+    unsigned                    pendingFrames_;
+
+    // frames
+    CefRefPtr<UBrowserFrame>    frame_;
+    PODVector<UFrameSink*>      frameSinks_;
+
+    // upload stats
+    HiresTimer                  uploadTimer_;
+    static long long            uploadUSec_;
+    static unsigned             uploadCount_;
+
+    // mip levels, mipRows_ are being built while mipItem_ is in flight
+    bool                        mipmaps_;
+    SharedPtr<UMipChain>        mipChain_;
+    SharedPtr<WorkItem>         mipItem_;
+    CefRefPtr<UBrowserFrame>    mipFrame_;
+    IntVector2                  mipDirty_;
+    IntVector2                  mipRows_;
+    bool                        mipBuilt_;
+
+    // block compression - level 0 is read from the frame, mips are rgba snapshots,
+    // levels are replaced by blocks on the worker
+    unsigned                            compressIdleFrames_;
+    unsigned                            compressIdleCount_;
+    bool                                compressed_;
+    bool                                compressDiscard_;
+    BlockFormat                         compressFormat_;
+    CefRefPtr<UBrowserFrame>            compressFrame_;
+    Vector<PODVector<unsigned char> >   compressLevels_;
+    PODVector<IntVector2>               compressSizes_;
+    SharedPtr<WorkItem>                 compressItem_;
+
+    // baking
+    String      bakeUrl_;
+    bool        baked_;
+    unsigned    bakeIdleCount_;
+
+    // popup layer
+    SharedPtr<BorderImage>      popupImage_;
+    SharedPtr<Texture2D>        popupTexture_;
+
+    // frame rate scheduling
+    int             videoFrameRate_;
+    FrameRateRole   frameRateRole_;
+    int             frameRate_;
+    int             frameRateBrowserId_;
+    unsigned        paintRate_;
+
+    // begin frame sync
+    long long       lastBeginFrameUSec_;
+    float           engineIntervalUSec_;
+    float           paintLatencyUSec_;
+    float           armedPhaseUSec_;
+    bool            phaseArmed_;
+    unsigned        phaseMisses_;
+    Timer           rearmTimer_;
 
     int width_;
     int height_;
-    Timer copyTimer_;
+    bool firstFrameShown_;
+
+    // alpha hit-test mask, copied from the render handler on each paint
+    bool                alphaHitTest_;
+    PODVector<unsigned> hitMask_;
+    IntVector2          hitMaskBlocks_;
+
+    // tile occupancy, pending until the ring swaps to the texture holding that paint
+    bool                        tileBatching_;
+    PODVector<unsigned char>    tileMap_;
+    PODVector<unsigned char>    pendingTileMap_;
+    IntVector2                  tiles_;
+    IntVector2                  pendingTiles_;
+
+    // hibernation
+    unsigned    hibernateTimeMS_;
+    Timer       idleTimer_;
+    bool        hibernated_;
+    bool        wakeOnVisible_;
+    bool        restoring_;
+    String      hibernateUrl_;
+    IntVector2  hibernateScroll_;
 
     // interface
+    unsigned    lastInputMSec_;
+    bool        hadInput_;
     IntVector2  lastMousePos_;
     IntVector2  initalOffset_;
     Vector2     scaleDiff_;
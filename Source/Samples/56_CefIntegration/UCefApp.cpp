@@ -14,6 +14,14 @@
 
 #include "UCefApp.h"
 #include "UBrowserImage.h"
+#include "UUploadScheduler.h"
+#include "UFrameRateScheduler.h"
+#include "UBakedTextureCache.h"
+#include "UFrameShmSink.h"
+#include "UFrameNetServer.h"
+#include "UCefQueryBridge.h"
+#include "UCefPubSub.h"
+#include "UNativeBindings.h"
 #include "cefsimple/simple_app.h"
 
 #include <Urho3D/DebugNew.h>
@@ -24,22 +32,133 @@ UCefApp::UCefApp(Context *context)
     : Object(context)
     , uBrowserImage_(NULL)
     , uCefRenderHandler_(NULL)
+    , cefStarted_(false)
+    , frameShmSink_(NULL)
 {
 }
 
 UCefApp::~UCefApp()
 {
     uBrowserImage_ = NULL;
+
+    delete frameShmSink_;
+    frameShmSink_ = NULL;
 }
 
-int UCefApp::CreateAppBrowser()
+void UCefApp::CompressIdlePage(unsigned idleFrames)
 {
+    if ( uBrowserImage_ )
+    {
+        uBrowserImage_->SetCompressIdleFrames(idleFrames);
+    }
+}
+
+bool UCefApp::ExportFrames(const String &name)
+{
+    if ( uBrowserImage_ == NULL || !cefStarted_ )
+    {
+        return false;
+    }
+
+    if ( frameShmSink_ == NULL )
+    {
+        frameShmSink_ = new UFrameShmSink();
+    }
+
+    if ( !frameShmSink_->Open(name, CEFBUF_WIDTH, CEFBUF_HEIGHT, CEFBUF_COMPONENTS) )
+    {
+        return false;
+    }
+
+    uBrowserImage_->AddFrameSink(frameShmSink_);
+
+    return true;
+}
+
+bool UCefApp::ReplicateFrames(unsigned short port)
+{
+    if ( uBrowserImage_ == NULL || !cefStarted_ || frameNetServer_ )
+    {
+        return false;
+    }
+
+    frameNetServer_ = new UFrameNetServer(context_);
+
+    if ( !frameNetServer_->Start(port) )
+    {
+        frameNetServer_ = NULL;
+        return false;
+    }
+
+    uBrowserImage_->AddFrameSink(frameNetServer_.Get());
+
+    return true;
+}
+
+bool UCefApp::SendPayload(const String &topic, const String &payload)
+{
+    SimpleHandler *simpleHandler = SimpleHandler::GetInstance();
+
+    if ( !cefStarted_ || !uBrowserImage_ || simpleHandler == NULL )
+    {
+        return false;
+    }
+
+    return simpleHandler->SendPayload(uBrowserImage_->GetBrowser(), topic.CString(), payload.CString(), payload.Length());
+}
+
+int UCefApp::CreateAppBrowser(const String &bakeUrl)
+{
+    if ( GetSubsystem<UBakedTextureCache>() == NULL )
+    {
+        context_->RegisterSubsystem(new UBakedTextureCache(context_));
+    }
+
     UI* ui = GetSubsystem<UI>();
+
+    // baked page, no cef
+    if ( !bakeUrl.Empty() )
+    {
+        SharedPtr<UBrowserImage> bakedImage(new UBrowserImage(context_));
+
+        if ( bakedImage->InitBaked(bakeUrl, BROWSER_RENDER_WIDTH, BROWSER_RENDER_HEIGTH) )
+        {
+            uBrowserImage_ = bakedImage;
+            ui->GetRoot()->AddChild(uBrowserImage_);
+            return 0;
+        }
+    }
+
+    // shared by all browsers
+    if ( GetSubsystem<UUploadScheduler>() == NULL )
+    {
+        context_->RegisterSubsystem(new UUploadScheduler(context_));
+    }
+    if ( GetSubsystem<UFrameRateScheduler>() == NULL )
+    {
+        context_->RegisterSubsystem(new UFrameRateScheduler(context_));
+    }
+    if ( GetSubsystem<UCefQueryBridge>() == NULL )
+    {
+        context_->RegisterSubsystem(new UCefQueryBridge(context_));
+    }
+    if ( GetSubsystem<UCefPubSub>() == NULL )
+    {
+        context_->RegisterSubsystem(new UCefPubSub(context_));
+    }
+    if ( GetSubsystem<UNativeBindings>() == NULL )
+    {
+        context_->RegisterSubsystem(new UNativeBindings(context_));
+    }
+
     uBrowserImage_ = new UBrowserImage(context_);
     ui->GetRoot()->AddChild(uBrowserImage_);
 
     uCefRenderHandler_ = new UCefRenderHandle(CEFBUF_WIDTH, CEFBUF_HEIGHT, CEFBUF_COMPONENTS);
     uBrowserImage_->Init(uCefRenderHandler_, BROWSER_RENDER_WIDTH, BROWSER_RENDER_HEIGTH);
+    GetSubsystem<UFrameRateScheduler>()->Add(uBrowserImage_);
+    GetSubsystem<UCefPubSub>()->AddView(uBrowserImage_);
+    uBrowserImage_->SetBakeUrl(bakeUrl);
 
     CefMainArgs main_args(NULL);
 
@@ -49,20 +168,36 @@ int UCefApp::CreateAppBrowser()
     settings.windowless_rendering_enabled = true;
 
     CefRefPtr<SimpleHandler> simpHandler = new SimpleHandler((CefRenderHandler *)uCefRenderHandler_);
+    simpHandler->AddQueryHandler(GetSubsystem<UCefQueryBridge>());
+    // subscribing is rare, a page looping on it gets throttled
+    simpHandler->SetRouteRateLimit("pubsub:", 50, 100);
 
     // SimpleApp implements application-level callbacks for the browser process.
     // It will create the first browser instance in OnContextInitialized() after
     // CEF has initialized.
     CefRefPtr<SimpleApp> sApp = new SimpleApp(simpHandler);
+    sApp->startUrl_ = bakeUrl.Empty() ? startUrl_.CString() : bakeUrl.CString();
 
     // Initialize CEF.
     CefInitialize(main_args, settings, sApp.get(), NULL);
+    cefStarted_ = true;
 
     return 0;
 }
 
 void UCefApp::DestroyAppBrowser()
 {
+    // a baked page has nothing to close
+    if ( !cefStarted_ )
+    {
+        if ( uBrowserImage_ )
+        {
+            uBrowserImage_->Remove();
+            uBrowserImage_ = NULL;
+        }
+        return;
+    }
+
     // flag the handler from copying its buffer
     if ( uCefRenderHandler_ )
     {
@@ -93,6 +228,19 @@ void UCefApp::DestroyAppBrowser()
 
     SDL_Log( "onBeforeClose itr = %d", itr );
 
+    if ( uBrowserImage_ && frameShmSink_ )
+    {
+        uBrowserImage_->RemoveFrameSink(frameShmSink_);
+        frameShmSink_->Close();
+    }
+
+    if ( uBrowserImage_ && frameNetServer_ )
+    {
+        uBrowserImage_->RemoveFrameSink(frameNetServer_.Get());
+        frameNetServer_->Stop();
+        frameNetServer_ = NULL;
+    }
+
     if ( uBrowserImage_ )
     {
         uBrowserImage_->ClearCefHandler();
@@ -9,6 +9,8 @@ using namespace Urho3D;
 
 class UCefRenderHandle;
 class UBrowserImage;
+class UFrameShmSink;
+class UFrameNetServer;
 
 //=============================================================================
 //=============================================================================
@@ -19,11 +21,34 @@ public:
     UCefApp(Context *context);
     virtual ~UCefApp();
 
-    int CreateAppBrowser();
+    // a bake url that's already cached is shown without starting cef,
+    // otherwise the browser opens it and bakes it once it has settled
+    int CreateAppBrowser(const String &bakeUrl = String::EMPTY);
     void DestroyAppBrowser();
+    bool IsCefStarted() const { return cefStarted_; }
+
+    // page to open when there's no bake url, call before CreateAppBrowser()
+    void SetStartUrl(const String &url) { startUrl_ = url; }
+
+    // publish the browser's frames to a shared memory ring for external readers
+    bool ExportFrames(const String &name);
+
+    // replicate the browser's frames to networked clients (UFrameNetClient)
+    bool ReplicateFrames(unsigned short port);
+
+    // block compress the page once it hasn't painted for idleFrames, 0 disables it
+    void CompressIdlePage(unsigned idleFrames);
+
+    // hands a payload to window.onUrhoPayload(topic, text) in the page, large
+    // ones go through shared memory instead of the process message
+    bool SendPayload(const String &topic, const String &payload);
 
 protected:
     UCefRenderHandle         *uCefRenderHandler_;
     SharedPtr<UBrowserImage> uBrowserImage_;
+    bool                     cefStarted_;
+    String                   startUrl_;
+    UFrameShmSink            *frameShmSink_;
+    SharedPtr<UFrameNetServer> frameNetServer_;
 };
 
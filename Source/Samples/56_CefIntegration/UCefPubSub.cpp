@@ -0,0 +1,570 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Urho3D.h>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Math/Vector2.h>
+#include <SDL/SDL_log.h>
+
+#include <string.h>
+#include <cmath>
+
+#include "UCefPubSub.h"
+#include "UCefQueryBridge.h"
+#include "UBrowserImage.h"
+
+#include <Urho3D/DebugNew.h>
+
+//=============================================================================
+//=============================================================================
+#define PUBSUB_ROUTE                "pubsub"
+#define PUBSUB_ERROR_NO_TOPICS      -3
+
+#define BENCHMARK_MARKERS           32
+#define BENCHMARK_MARKERS_MOVED     8
+
+static const char *clientScript_ =
+    "window.urhoState = {};"
+    "window.urhoSubscribe = function(topics, onChange) {"
+    "  return window.cefQuery({ request: '" PUBSUB_ROUTE ":' + topics.join(','), persistent: true,"
+    "    onSuccess: function(json) {"
+    "      var delta = JSON.parse(json);"
+    "      for (var t in delta) {"
+    "        var state = window.urhoState[t] || (window.urhoState[t] = {});"
+    "        var fields = delta[t];"
+    "        for (var f in fields) {"
+    "          if (fields[f] === null) delete state[f]; else state[f] = fields[f];"
+    "        }"
+    "      }"
+    "      if (onChange) onChange(delta, window.urhoState);"
+    "    },"
+    "    onFailure: function(code, msg) {} });"
+    "};";
+
+// no '#' or '%' in the page, it's a plain data url
+static const char *benchmarkPageHead_ =
+    "data:text/html;charset=utf-8,<html><body style='background:white'><pre id='out'>pubsub benchmark</pre><script>";
+
+static const char *benchmarkPageTail_ =
+    "var deltas = 0, t0 = Date.now();"
+    "urhoSubscribe(['hud', 'quest', 'markers'], function(delta, state) { ++deltas; });"
+    "setInterval(function() {"
+    "  var now = Date.now(), hud = urhoState.hud || {};"
+    "  document.getElementById('out').textContent ="
+    "    'deltas/sec: ' + Math.round(deltas*1000/(now - t0)) +"
+    "    '\\nhealth: ' + hud.health + ' ammo: ' + hud.ammo +"
+    "    '\\nquest: ' + JSON.stringify(urhoState.quest) +"
+    "    '\\nmarker 0: ' + JSON.stringify((urhoState.markers || {}).m0);"
+    "  deltas = 0; t0 = now;"
+    "}, 1000);"
+    "</script></body></html>";
+
+//=============================================================================
+//=============================================================================
+static void AppendJsonString(String &json, const String &text)
+{
+    json += '"';
+
+    for ( unsigned i = 0; i < text.Length(); ++i )
+    {
+        char c = text[i];
+
+        switch ( c )
+        {
+        case '"':  json += "\\\""; break;
+        case '\\': json += "\\\\"; break;
+        case '\n': json += "\\n";  break;
+        case '\r': json += "\\r";  break;
+        case '\t': json += "\\t";  break;
+        default:
+            if ( (unsigned char)c < 0x20 )
+            {
+                json.AppendWithFormat("\\u%04x", (unsigned char)c);
+            }
+            else
+            {
+                json += c;
+            }
+            break;
+        }
+    }
+
+    json += '"';
+}
+
+// json has no NaN or Infinity, JSON.parse() would reject the whole message
+template <typename T>
+static void AppendJsonNumber(String &json, T value)
+{
+    if ( std::isfinite(value) )
+    {
+        json += String(value);
+    }
+    else
+    {
+        json += "null";
+    }
+}
+
+static void AppendJsonFloats(String &json, const float *data, unsigned count)
+{
+    json += '[';
+
+    for ( unsigned i = 0; i < count; ++i )
+    {
+        if ( i )
+        {
+            json += ',';
+        }
+        AppendJsonNumber(json, data[i]);
+    }
+
+    json += ']';
+}
+
+static void AppendJsonValue(String &json, const Variant &value)
+{
+    switch ( value.GetType() )
+    {
+    case VAR_NONE:
+        json += "null";
+        break;
+
+    case VAR_BOOL:
+        json += value.GetBool() ? "true" : "false";
+        break;
+
+    case VAR_INT:
+        json += String(value.GetInt());
+        break;
+
+    case VAR_FLOAT:
+        AppendJsonNumber(json, value.GetFloat());
+        break;
+
+    case VAR_DOUBLE:
+        AppendJsonNumber(json, value.GetDouble());
+        break;
+
+    case VAR_VECTOR2:
+        AppendJsonFloats(json, value.GetVector2().Data(), 2);
+        break;
+
+    case VAR_VECTOR3:
+        AppendJsonFloats(json, value.GetVector3().Data(), 3);
+        break;
+
+    case VAR_VECTOR4:
+        AppendJsonFloats(json, value.GetVector4().Data(), 4);
+        break;
+
+    case VAR_COLOR:
+        AppendJsonFloats(json, value.GetColor().Data(), 4);
+        break;
+
+    case VAR_STRING:
+        AppendJsonString(json, value.GetString());
+        break;
+
+    default:
+        AppendJsonString(json, value.ToString());
+        break;
+    }
+}
+
+//=============================================================================
+//=============================================================================
+UCefPubSub::UCefPubSub(Context *context)
+    : Object(context)
+    , benchmark_(false)
+    , benchmarkFrame_(0)
+{
+    UCefQueryBridge *bridge = GetSubsystem<UCefQueryBridge>();
+
+    if ( bridge )
+    {
+        SubscribeToEvent(bridge->AddRoute(PUBSUB_ROUTE), URHO3D_HANDLER(UCefPubSub, HandleQuery));
+        SubscribeToEvent(E_CEFQUERYCANCELED, URHO3D_HANDLER(UCefPubSub, HandleQueryCanceled));
+    }
+    else
+    {
+        SDL_Log("UCefPubSub: no query bridge, nothing will be delivered");
+    }
+
+    SubscribeToEvent(E_POSTRENDERUPDATE, URHO3D_HANDLER(UCefPubSub, HandlePostRenderUpdate));
+}
+
+UCefPubSub::~UCefPubSub()
+{
+    topics_.Clear();
+    subscribers_.Clear();
+    views_.Clear();
+}
+
+UCefPubSub::Topic& UCefPubSub::GetTopic(const String &topic)
+{
+    StringHash key(topic);
+    HashMap<StringHash, Topic>::Iterator it = topics_.Find(key);
+
+    if ( it != topics_.End() )
+    {
+        return it->second_;
+    }
+
+    Topic &entry = topics_[key];
+    entry.name_ = topic;
+    entry.version_ = 0;
+    memset(&entry.stats_, 0, sizeof(entry.stats_));
+    entry.windowMessages_ = 0;
+    entry.windowBytes_ = 0;
+
+    return entry;
+}
+
+void UCefPubSub::SetField(Topic &topic, const String &name, const Variant &value)
+{
+    StringHash key(name);
+    HashMap<StringHash, Field>::Iterator it = topic.fields_.Find(key);
+
+    if ( it == topic.fields_.End() )
+    {
+        Field &field = topic.fields_[key];
+        field.name_ = name;
+        field.value_ = value;
+        field.version_ = ++topic.version_;
+        field.removed_ = false;
+        return;
+    }
+
+    Field &field = it->second_;
+
+    // republishing the same value is free
+    if ( !field.removed_ && field.value_ == value )
+    {
+        return;
+    }
+
+    // coalesced, only the value at the end of the frame is sent
+    field.value_ = value;
+    field.removed_ = false;
+    field.version_ = ++topic.version_;
+}
+
+void UCefPubSub::Publish(const String &topic, const String &field, const Variant &value)
+{
+    SetField(GetTopic(topic), field, value);
+}
+
+void UCefPubSub::Unpublish(const String &topic, const String &field)
+{
+    HashMap<StringHash, Topic>::Iterator it = topics_.Find(StringHash(topic));
+
+    if ( it == topics_.End() )
+    {
+        return;
+    }
+
+    Topic &entry = it->second_;
+    HashMap<StringHash, Field>::Iterator itField = entry.fields_.Find(StringHash(field));
+
+    if ( itField == entry.fields_.End() || itField->second_.removed_ )
+    {
+        return;
+    }
+
+    itField->second_.value_.Clear();
+    itField->second_.removed_ = true;
+    itField->second_.version_ = ++entry.version_;
+}
+
+void UCefPubSub::AddView(UBrowserImage *view)
+{
+    views_.Push(WeakPtr<UBrowserImage>(view));
+}
+
+void UCefPubSub::RemoveView(UBrowserImage *view)
+{
+    views_.Remove(WeakPtr<UBrowserImage>(view));
+}
+
+void UCefPubSub::GetHiddenBrowsers(HashSet<int> &hidden)
+{
+    for ( unsigned i = 0; i < views_.Size(); )
+    {
+        UBrowserImage *view = views_[i];
+
+        if ( view == NULL )
+        {
+            views_.Erase(i);
+            continue;
+        }
+
+        CefRefPtr<CefBrowser> browser = view->GetBrowser();
+
+        if ( browser && !view->IsVisibleEffective() )
+        {
+            hidden.Insert(browser->GetIdentifier());
+        }
+        ++i;
+    }
+}
+
+void UCefPubSub::HandleQuery(StringHash eventType, VariantMap& eventData)
+{
+    using namespace CefQuery;
+
+    unsigned queryId = eventData[P_QUERYID].GetUInt();
+    Vector<String> topics = eventData[P_REQUEST].GetString().Split(',');
+
+    if ( topics.Empty() || !eventData[P_PERSISTENT].GetBool() )
+    {
+        GetSubsystem<UCefQueryBridge>()->Failure(queryId, PUBSUB_ERROR_NO_TOPICS, "subscribe with a persistent query and a topic list");
+        return;
+    }
+
+    Subscriber &subscriber = subscribers_[queryId];
+    subscriber.browserId_ = eventData[P_BROWSERID].GetInt();
+
+    for ( unsigned i = 0; i < topics.Size(); ++i )
+    {
+        String name = topics[i].Trimmed();
+
+        if ( !name.Empty() )
+        {
+            GetTopic(name);
+            subscriber.topics_.Push(StringHash(name));
+        }
+    }
+
+    // the current state goes out with this frame's deltas
+}
+
+void UCefPubSub::HandleQueryCanceled(StringHash eventType, VariantMap& eventData)
+{
+    using namespace CefQueryCanceled;
+
+    if ( eventData[P_ROUTE].GetString() == PUBSUB_ROUTE )
+    {
+        subscribers_.Erase(eventData[P_QUERYID].GetUInt());
+    }
+}
+
+bool UCefPubSub::AppendDelta(StringHash key, Topic &topic, Subscriber &subscriber, String &json)
+{
+    unsigned &sentVersion = subscriber.sentVersions_[key];
+
+    if ( sentVersion == topic.version_ )
+    {
+        return false;
+    }
+
+    unsigned start = json.Length();
+    bool empty = true;
+
+    if ( start > 1 )
+    {
+        json += ',';
+    }
+    AppendJsonString(json, topic.name_);
+    json += ":{";
+
+    for ( HashMap<StringHash, Field>::ConstIterator it = topic.fields_.Begin(); it != topic.fields_.End(); ++it )
+    {
+        const Field &field = it->second_;
+
+        // a new subscriber has nothing to remove
+        if ( field.version_ <= sentVersion || ( field.removed_ && sentVersion == 0 ) )
+        {
+            continue;
+        }
+
+        if ( !empty )
+        {
+            json += ',';
+        }
+        AppendJsonString(json, field.name_);
+        json += ':';
+
+        if ( field.removed_ )
+        {
+            json += "null";
+        }
+        else
+        {
+            AppendJsonValue(json, field.value_);
+        }
+        empty = false;
+    }
+
+    sentVersion = topic.version_;
+
+    if ( empty )
+    {
+        json.Resize(start);
+        return false;
+    }
+
+    json += '}';
+
+    unsigned bytes = json.Length() - start;
+    ++topic.stats_.messages_;
+    topic.stats_.bytes_ += bytes;
+    ++topic.windowMessages_;
+    topic.windowBytes_ += bytes;
+
+    return true;
+}
+
+void UCefPubSub::HandlePostRenderUpdate(StringHash eventType, VariantMap& eventData)
+{
+    UCefQueryBridge *bridge = GetSubsystem<UCefQueryBridge>();
+
+    if ( bridge && subscribers_.Size() )
+    {
+        HashSet<int> hidden;
+        GetHiddenBrowsers(hidden);
+
+        for ( HashMap<unsigned, Subscriber>::Iterator it = subscribers_.Begin(); it != subscribers_.End(); )
+        {
+            Subscriber &subscriber = it->second_;
+
+            // skipped, not sent, it catches up once visible
+            if ( hidden.Contains(subscriber.browserId_) )
+            {
+                ++it;
+                continue;
+            }
+
+            String json("{");
+            bool changed = false;
+
+            for ( unsigned i = 0; i < subscriber.topics_.Size(); ++i )
+            {
+                HashMap<StringHash, Topic>::Iterator itTopic = topics_.Find(subscriber.topics_[i]);
+
+                if ( itTopic != topics_.End() )
+                {
+                    changed |= AppendDelta(itTopic->first_, itTopic->second_, subscriber, json);
+                }
+            }
+
+            if ( changed )
+            {
+                json += '}';
+
+                // gone without a cancel, the page navigated away
+                if ( !bridge->Success(it->first_, json) )
+                {
+                    it = subscribers_.Erase(it);
+                    continue;
+                }
+            }
+            ++it;
+        }
+    }
+
+    if ( statsTimer_.GetMSec(false) >= 1000 )
+    {
+        for ( HashMap<StringHash, Topic>::Iterator it = topics_.Begin(); it != topics_.End(); ++it )
+        {
+            Topic &topic = it->second_;
+            topic.stats_.messagesPerSec_ = topic.windowMessages_;
+            topic.stats_.bytesPerSec_ = topic.windowBytes_;
+            topic.windowMessages_ = 0;
+            topic.windowBytes_ = 0;
+        }
+
+        if ( benchmark_ )
+        {
+            LogStats();
+        }
+
+        statsTimer_.Reset();
+    }
+}
+
+const UCefPubSub::TopicStats* UCefPubSub::GetTopicStats(const String &topic) const
+{
+    HashMap<StringHash, Topic>::ConstIterator it = topics_.Find(StringHash(topic));
+
+    return it != topics_.End() ? &it->second_.stats_ : NULL;
+}
+
+void UCefPubSub::LogStats() const
+{
+    for ( HashMap<StringHash, Topic>::ConstIterator it = topics_.Begin(); it != topics_.End(); ++it )
+    {
+        const TopicStats &stats = it->second_.stats_;
+
+        SDL_Log("pubsub %s: %u msgs/s, %u bytes/s, total %u msgs %lld bytes, %u fields",
+                it->second_.name_.CString(), stats.messagesPerSec_, stats.bytesPerSec_,
+                stats.messages_, stats.bytes_, it->second_.fields_.Size());
+    }
+
+    SDL_Log("pubsub subscribers: %u", subscribers_.Size());
+}
+
+String UCefPubSub::GetClientScript()
+{
+    return String(clientScript_);
+}
+
+void UCefPubSub::EnableBenchmark()
+{
+    if ( benchmark_ )
+    {
+        return;
+    }
+
+    SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(UCefPubSub, HandleBenchmark));
+    benchmark_ = true;
+}
+
+String UCefPubSub::GetBenchmarkUrl()
+{
+    return String(benchmarkPageHead_) + clientScript_ + benchmarkPageTail_;
+}
+
+void UCefPubSub::HandleBenchmark(StringHash eventType, VariantMap& eventData)
+{
+    unsigned frame = ++benchmarkFrame_;
+
+    // health ticks every frame, ammo now and then, the quest rarely
+    Publish("hud", "health", (int)(50 + (frame % 50)));
+    Publish("hud", "ammo", (int)(30 - (frame / 10) % 30));
+
+    if ( frame % 300 == 1 )
+    {
+        Publish("quest", "title", "Mushroom hunt");
+        Publish("quest", "step", (int)((frame / 300) % 5));
+    }
+
+    // a few markers move per frame, the same value published twice is dropped
+    for ( unsigned i = 0; i < BENCHMARK_MARKERS_MOVED; ++i )
+    {
+        unsigned marker = ( frame * BENCHMARK_MARKERS_MOVED + i ) % BENCHMARK_MARKERS;
+        Publish("markers", "m" + String(marker), Vector2((float)(frame % 100), (float)marker));
+        Publish("markers", "m" + String(marker), Vector2((float)(frame % 100), (float)marker));
+    }
+}
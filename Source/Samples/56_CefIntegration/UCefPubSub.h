@@ -0,0 +1,126 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/HashSet.h>
+
+using namespace Urho3D;
+
+class UBrowserImage;
+
+//=============================================================================
+// Publish/subscribe channel from engine code to web pages, on top of the
+// query bridge. A page subscribes with a persistent "pubsub:topic,topic"
+// query (see GetClientScript()), engine code publishes topic fields any
+// number of times per frame. Once per frame every visible subscriber gets
+// a json delta of the fields that changed since what it was last sent:
+//   {"hud":{"health":90,"ammo":12},"quest":{"step":null}}
+// null is a removed field. Hidden subscribers are skipped and catch up with
+// a single delta when they show again. All the answers of a frame leave in
+// one bridge task and the router sends one message per browser.
+//=============================================================================
+class UCefPubSub : public Object
+{
+    URHO3D_OBJECT(UCefPubSub, Object);
+public:
+
+    struct TopicStats
+    {
+        unsigned  messages_;
+        long long bytes_;
+        unsigned  messagesPerSec_;
+        unsigned  bytesPerSec_;
+    };
+
+    UCefPubSub(Context *context);
+    virtual ~UCefPubSub();
+
+    // main thread, values are coalesced until the end of the frame
+    void Publish(const String &topic, const String &field, const Variant &value);
+    void Unpublish(const String &topic, const String &field);
+
+    // subscribers in a hidden view are skipped
+    void AddView(UBrowserImage *view);
+    void RemoveView(UBrowserImage *view);
+
+    unsigned GetNumSubscribers() const              { return subscribers_.Size(); }
+    const TopicStats* GetTopicStats(const String &topic) const;
+    void LogStats() const;
+
+    // defines urhoSubscribe(topics, onChange(delta, state)) for a page
+    static String GetClientScript();
+
+    // hud-like topics published every frame and a page that shows them
+    void EnableBenchmark();
+    static String GetBenchmarkUrl();
+
+protected:
+    // a removed field stays as a tombstone so subscribers get its null
+    struct Field
+    {
+        String      name_;
+        Variant     value_;
+        unsigned    version_;
+        bool        removed_;
+    };
+
+    struct Topic
+    {
+        String                      name_;
+        HashMap<StringHash, Field>  fields_;
+        unsigned                    version_;
+        TopicStats                  stats_;
+        unsigned                    windowMessages_;
+        unsigned                    windowBytes_;
+    };
+
+    struct Subscriber
+    {
+        int                             browserId_;
+        PODVector<StringHash>           topics_;
+        // topic versions as last sent, fields changed after that go out
+        HashMap<StringHash, unsigned>   sentVersions_;
+    };
+
+    void HandleQuery(StringHash eventType, VariantMap& eventData);
+    void HandleQueryCanceled(StringHash eventType, VariantMap& eventData);
+    void HandlePostRenderUpdate(StringHash eventType, VariantMap& eventData);
+    void HandleBenchmark(StringHash eventType, VariantMap& eventData);
+
+    Topic& GetTopic(const String &topic);
+    void SetField(Topic &topic, const String &name, const Variant &value);
+    bool AppendDelta(StringHash key, Topic &topic, Subscriber &subscriber, String &json);
+    void GetHiddenBrowsers(HashSet<int> &hidden);
+
+protected:
+    HashMap<StringHash, Topic>      topics_;
+    HashMap<unsigned, Subscriber>   subscribers_;
+    Vector<WeakPtr<UBrowserImage> > views_;
+    Timer                           statsTimer_;
+    bool                            benchmark_;
+    unsigned                        benchmarkFrame_;
+};
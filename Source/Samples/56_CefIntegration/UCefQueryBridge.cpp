@@ -0,0 +1,452 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Urho3D.h>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <SDL/SDL_log.h>
+
+#include <string.h>
+
+#include "include/cef_task.h"
+#include "UCefQueryBridge.h"
+#include "cefsimple/simple_handler.h"
+
+#include <Urho3D/DebugNew.h>
+
+//=============================================================================
+//=============================================================================
+#define BENCHMARK_ROUTE     "echo"
+#define BENCHMARK_INFLIGHT  "256"
+
+// no '#' or '%' in the page, it's a plain data url
+static const char *benchmarkPage_ =
+    "data:text/html;charset=utf-8,<html><body style='background:white'><pre id='out'>cefQuery benchmark</pre><script>"
+    "var inflight = 0, done = 0, sent = 0, t0 = Date.now();"
+    "function pump() {"
+    "  while (inflight < " BENCHMARK_INFLIGHT ") {"
+    "    ++inflight; ++sent;"
+    "    window.cefQuery({ request: '" BENCHMARK_ROUTE ":' + sent, persistent: false,"
+    "      onSuccess: function(r) { --inflight; ++done; pump(); },"
+    "      onFailure: function(c, m) { --inflight; } });"
+    "  }"
+    "}"
+    "setInterval(function() {"
+    "  var now = Date.now();"
+    "  document.getElementById('out').textContent = 'queries/sec: ' + Math.round(done*1000/(now - t0));"
+    "  done = 0; t0 = now; pump();"
+    "}, 1000);"
+    "pump();"
+    "</script></body></html>";
+
+//=============================================================================
+// runs a frame's worth of answers on the cef ui thread, where the callbacks
+// go straight into the router
+//=============================================================================
+class UQueryResponseTask : public CefTask
+{
+public:
+    UQueryResponseTask(Vector<UCefQueryBridge::Response> &responses)
+    {
+        responses_.Swap(responses);
+    }
+
+    virtual void Execute()
+    {
+        for ( unsigned i = 0; i < responses_.Size(); ++i )
+        {
+            UCefQueryBridge::Response &response = responses_[i];
+
+            if ( response.success_ )
+            {
+                response.callback_->Success(response.text_);
+            }
+            else
+            {
+                response.callback_->Failure(response.errorCode_, response.text_);
+            }
+        }
+
+        responses_.Clear();
+    }
+
+protected:
+    Vector<UCefQueryBridge::Response> responses_;
+
+    IMPLEMENT_REFCOUNTING(UQueryResponseTask);
+};
+
+//=============================================================================
+//=============================================================================
+UCefQueryBridge::UCefQueryBridge(Context *context)
+    : Object(context)
+    , responseTasks_(0)
+    , responsesSent_(0)
+    , nextQueryId_(0)
+    , benchmark_(false)
+{
+    SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(UCefQueryBridge, HandleUpdate));
+    SubscribeToEvent(E_ENDFRAME, URHO3D_HANDLER(UCefQueryBridge, HandleEndFrame));
+}
+
+UCefQueryBridge::~UCefQueryBridge()
+{
+    FlushResponses();
+
+    routes_.Clear();
+    pending_.Clear();
+
+    MutexLock lock(mutex_);
+    routeKeys_.Clear();
+    incoming_.Clear();
+    canceled_.Clear();
+}
+
+StringHash UCefQueryBridge::AddRoute(const String &route)
+{
+    StringHash key(route);
+
+    if ( !routes_.Contains(key) )
+    {
+        Route &entry = routes_[key];
+        entry.name_ = route;
+        entry.event_ = StringHash("CefQuery:" + route);
+        memset(&entry.stats_, 0, sizeof(entry.stats_));
+        entry.windowQueries_ = 0;
+        entry.windowResponses_ = 0;
+
+        MutexLock lock(mutex_);
+        routeKeys_.Insert(key);
+    }
+
+    return routes_[key].event_;
+}
+
+void UCefQueryBridge::RemoveRoute(const String &route)
+{
+    StringHash key(route);
+
+    routes_.Erase(key);
+
+    MutexLock lock(mutex_);
+    routeKeys_.Erase(key);
+}
+
+bool UCefQueryBridge::OnQuery(CefRefPtr<CefBrowser> browser,
+                              CefRefPtr<CefFrame> frame,
+                              int64 query_id,
+                              const CefString& request,
+                              bool persistent,
+                              CefRefPtr<Callback> callback)
+{
+    String text(request.ToString().c_str());
+    int colon = text.Find(':');
+    StringHash route(colon == String::NPOS ? text : text.Substring(0, colon));
+
+    MutexLock lock(mutex_);
+
+    // let other handlers have it
+    if ( !routeKeys_.Contains(route) )
+    {
+        return false;
+    }
+
+    incoming_.Resize(incoming_.Size() + 1);
+    Query &query = incoming_.Back();
+    query.route_ = route;
+    query.request_ = colon == String::NPOS ? String::EMPTY : text.Substring(colon + 1);
+    query.cefQueryId_ = query_id;
+    query.browserId_ = browser->GetIdentifier();
+    query.persistent_ = persistent;
+    query.answered_ = false;
+    query.callback_ = callback;
+    query.timer_.Reset();
+
+    return true;
+}
+
+void UCefQueryBridge::OnQueryCanceled(CefRefPtr<CefBrowser> browser,
+                                      CefRefPtr<CefFrame> frame,
+                                      int64 query_id)
+{
+    MutexLock lock(mutex_);
+    canceled_.Push(query_id);
+}
+
+void UCefQueryBridge::HandleUpdate(StringHash eventType, VariantMap& eventData)
+{
+    Vector<Query> incoming;
+    PODVector<int64> canceled;
+    {
+        MutexLock lock(mutex_);
+        incoming.Swap(incoming_);
+        canceled.Swap(canceled_);
+    }
+
+    // a cancel is always for a query queued earlier, dispatch those first
+    for ( unsigned i = 0; i < incoming.Size(); ++i )
+    {
+        DispatchQuery(incoming[i]);
+    }
+
+    for ( unsigned i = 0; i < canceled.Size(); ++i )
+    {
+        CancelQuery(canceled[i]);
+    }
+
+    if ( statsTimer_.GetMSec(false) >= 1000 )
+    {
+        for ( HashMap<StringHash, Route>::Iterator it = routes_.Begin(); it != routes_.End(); ++it )
+        {
+            Route &route = it->second_;
+            route.stats_.queriesPerSec_ = route.windowQueries_;
+            route.stats_.responsesPerSec_ = route.windowResponses_;
+            route.windowQueries_ = 0;
+            route.windowResponses_ = 0;
+        }
+
+        if ( benchmark_ )
+        {
+            LogStats();
+        }
+
+        statsTimer_.Reset();
+    }
+}
+
+void UCefQueryBridge::HandleEndFrame(StringHash eventType, VariantMap& eventData)
+{
+    FlushResponses();
+}
+
+void UCefQueryBridge::QueueResponse(Query &query, bool success, int errorCode, const String &text)
+{
+    outgoing_.Resize(outgoing_.Size() + 1);
+    Response &response = outgoing_.Back();
+    response.callback_ = query.callback_;
+    response.success_ = success;
+    response.errorCode_ = errorCode;
+    response.text_ = text.CString();
+}
+
+void UCefQueryBridge::FlushResponses()
+{
+    if ( outgoing_.Empty() )
+    {
+        return;
+    }
+
+    ++responseTasks_;
+    responsesSent_ += outgoing_.Size();
+
+    // swaps outgoing_ empty
+    CefPostTask(TID_UI, new UQueryResponseTask(outgoing_));
+}
+
+void UCefQueryBridge::DispatchQuery(Query &query)
+{
+    HashMap<StringHash, Route>::Iterator it = routes_.Find(query.route_);
+
+    // removed after it was queued
+    if ( it == routes_.End() )
+    {
+        query.callback_->Failure(QUERY_ERROR_NO_ROUTE, "no route");
+        return;
+    }
+
+    Route &route = it->second_;
+    ++route.stats_.queries_;
+    ++route.windowQueries_;
+
+    if ( ++nextQueryId_ == 0 )
+    {
+        ++nextQueryId_;
+    }
+
+    // in the table before the event, handlers may answer right away
+    unsigned queryId = nextQueryId_;
+    Query &pending = pending_[queryId];
+    pending = query;
+
+    using namespace CefQuery;
+
+    VariantMap& eventData = GetEventDataMap();
+    eventData[P_ROUTE] = route.name_;
+    eventData[P_REQUEST] = pending.request_;
+    eventData[P_QUERYID] = queryId;
+    eventData[P_PERSISTENT] = pending.persistent_;
+    eventData[P_BROWSERID] = pending.browserId_;
+
+    SendEvent(route.event_, eventData);
+}
+
+void UCefQueryBridge::CancelQuery(int64 cefQueryId)
+{
+    // rare, a scan will do
+    for ( HashMap<unsigned, Query>::Iterator it = pending_.Begin(); it != pending_.End(); ++it )
+    {
+        if ( it->second_.cefQueryId_ != cefQueryId )
+        {
+            continue;
+        }
+
+        unsigned queryId = it->first_;
+        HashMap<StringHash, Route>::Iterator itRoute = routes_.Find(it->second_.route_);
+        String routeName;
+
+        if ( itRoute != routes_.End() )
+        {
+            ++itRoute->second_.stats_.canceled_;
+            routeName = itRoute->second_.name_;
+        }
+
+        // the callback is already detached by the router
+        pending_.Erase(it);
+
+        using namespace CefQueryCanceled;
+
+        VariantMap& eventData = GetEventDataMap();
+        eventData[P_ROUTE] = routeName;
+        eventData[P_QUERYID] = queryId;
+        SendEvent(E_CEFQUERYCANCELED, eventData);
+        break;
+    }
+}
+
+void UCefQueryBridge::AddLatency(Query &query, RouteStats &stats)
+{
+    if ( query.answered_ )
+    {
+        return;
+    }
+
+    long long usec = query.timer_.GetUSec(false);
+
+    ++stats.latencySamples_;
+    stats.totalLatencyUSec_ += usec;
+    stats.maxLatencyUSec_ = Max(stats.maxLatencyUSec_, usec);
+    query.answered_ = true;
+}
+
+bool UCefQueryBridge::Success(unsigned queryId, const String &response)
+{
+    HashMap<unsigned, Query>::Iterator it = pending_.Find(queryId);
+
+    if ( it == pending_.End() )
+    {
+        return false;
+    }
+
+    Query &query = it->second_;
+    HashMap<StringHash, Route>::Iterator itRoute = routes_.Find(query.route_);
+
+    if ( itRoute != routes_.End() )
+    {
+        AddLatency(query, itRoute->second_.stats_);
+        ++itRoute->second_.stats_.responses_;
+        ++itRoute->second_.windowResponses_;
+    }
+
+    QueueResponse(query, true, 0, response);
+
+    if ( !query.persistent_ )
+    {
+        pending_.Erase(it);
+    }
+
+    return true;
+}
+
+bool UCefQueryBridge::Failure(unsigned queryId, int errorCode, const String &errorMessage)
+{
+    HashMap<unsigned, Query>::Iterator it = pending_.Find(queryId);
+
+    if ( it == pending_.End() )
+    {
+        return false;
+    }
+
+    Query &query = it->second_;
+    HashMap<StringHash, Route>::Iterator itRoute = routes_.Find(query.route_);
+
+    if ( itRoute != routes_.End() )
+    {
+        AddLatency(query, itRoute->second_.stats_);
+        ++itRoute->second_.stats_.failures_;
+    }
+
+    // ends persistent queries too
+    QueueResponse(query, false, errorCode, errorMessage);
+    pending_.Erase(it);
+
+    return true;
+}
+
+const UCefQueryBridge::RouteStats* UCefQueryBridge::GetRouteStats(const String &route) const
+{
+    HashMap<StringHash, Route>::ConstIterator it = routes_.Find(StringHash(route));
+
+    return it != routes_.End() ? &it->second_.stats_ : NULL;
+}
+
+void UCefQueryBridge::LogStats() const
+{
+    for ( HashMap<StringHash, Route>::ConstIterator it = routes_.Begin(); it != routes_.End(); ++it )
+    {
+        const RouteStats &stats = it->second_.stats_;
+        long long avg = stats.latencySamples_ ? stats.totalLatencyUSec_/stats.latencySamples_ : 0;
+
+        SDL_Log("cefQuery %s: %u q/s, %u r/s, latency avg %lld us max %lld us, total %u ok %u fail %u canceled %u, pending %u",
+                it->second_.name_.CString(), stats.queriesPerSec_, stats.responsesPerSec_, avg, stats.maxLatencyUSec_,
+                stats.queries_, stats.responses_, stats.failures_, stats.canceled_, pending_.Size());
+    }
+
+    SDL_Log("cefQuery answers: %u in %u ui tasks", responsesSent_, responseTasks_);
+
+    if ( SimpleHandler::GetInstance() )
+    {
+        SimpleHandler::GetInstance()->LogRouterStats();
+    }
+}
+
+void UCefQueryBridge::EnableBenchmark()
+{
+    if ( benchmark_ )
+    {
+        return;
+    }
+
+    SubscribeToEvent(AddRoute(BENCHMARK_ROUTE), URHO3D_HANDLER(UCefQueryBridge, HandleEcho));
+    benchmark_ = true;
+}
+
+String UCefQueryBridge::GetBenchmarkUrl()
+{
+    return String(benchmarkPage_);
+}
+
+void UCefQueryBridge::HandleEcho(StringHash eventType, VariantMap& eventData)
+{
+    using namespace CefQuery;
+
+    Success(eventData[P_QUERYID].GetUInt(), eventData[P_REQUEST].GetString());
+}
@@ -0,0 +1,174 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/HashSet.h>
+
+#include "include/wrapper/cef_message_router.h"
+
+using namespace Urho3D;
+
+//=============================================================================
+// Query events. Every route sends its own event type, returned by AddRoute(),
+// with these parameters
+//=============================================================================
+URHO3D_EVENT(E_CEFQUERY, CefQuery)
+{
+    URHO3D_PARAM(P_ROUTE, Route);               // String
+    URHO3D_PARAM(P_REQUEST, Request);           // String, what follows "route:"
+    URHO3D_PARAM(P_QUERYID, QueryId);           // unsigned, answer with Success() / Failure()
+    URHO3D_PARAM(P_PERSISTENT, Persistent);     // bool
+    URHO3D_PARAM(P_BROWSERID, BrowserId);       // int
+}
+
+URHO3D_EVENT(E_CEFQUERYCANCELED, CefQueryCanceled)
+{
+    URHO3D_PARAM(P_ROUTE, Route);               // String
+    URHO3D_PARAM(P_QUERYID, QueryId);           // unsigned
+}
+
+#define QUERY_ERROR_NO_ROUTE    -2
+
+//=============================================================================
+// Bridges window.cefQuery({request: "route:payload"}) to Urho events.
+// The router calls OnQuery() on the cef ui thread, queries are queued and
+// sent as events on the main thread where engine code answers them, right
+// away or later. Persistent queries can be answered any number of times
+// until Failure(). Routes are looked up by hash and sent as their own event
+// type, a query only reaches the subscribers of its route. Answers given
+// during a frame go back to the cef ui thread together in one task at the
+// end of the frame.
+//=============================================================================
+class UCefQueryBridge : public Object, public CefMessageRouterBrowserSide::Handler
+{
+    URHO3D_OBJECT(UCefQueryBridge, Object);
+    friend class UQueryResponseTask;
+public:
+
+    struct RouteStats
+    {
+        unsigned  queries_;
+        unsigned  responses_;
+        unsigned  failures_;
+        unsigned  canceled_;
+        unsigned  queriesPerSec_;
+        unsigned  responsesPerSec_;
+
+        // from OnQuery() to the first answer
+        unsigned  latencySamples_;
+        long long totalLatencyUSec_;
+        long long maxLatencyUSec_;
+    };
+
+    UCefQueryBridge(Context *context);
+    virtual ~UCefQueryBridge();
+
+    // returns the event type to subscribe to for this route
+    StringHash AddRoute(const String &route);
+    void RemoveRoute(const String &route);
+
+    // main thread
+    bool Success(unsigned queryId, const String &response);
+    bool Failure(unsigned queryId, int errorCode, const String &errorMessage);
+
+    unsigned GetNumPending() const                  { return pending_.Size(); }
+    const RouteStats* GetRouteStats(const String &route) const;
+    void LogStats() const;
+
+    // echo route and a page that floods it, stats are logged every second
+    void EnableBenchmark();
+    static String GetBenchmarkUrl();
+
+    // CefMessageRouterBrowserSide::Handler, cef ui thread
+    virtual bool OnQuery(CefRefPtr<CefBrowser> browser,
+                         CefRefPtr<CefFrame> frame,
+                         int64 query_id,
+                         const CefString& request,
+                         bool persistent,
+                         CefRefPtr<Callback> callback);
+
+    virtual void OnQueryCanceled(CefRefPtr<CefBrowser> browser,
+                                 CefRefPtr<CefFrame> frame,
+                                 int64 query_id);
+
+protected:
+    struct Route
+    {
+        String      name_;
+        StringHash  event_;
+        RouteStats  stats_;
+        unsigned    windowQueries_;
+        unsigned    windowResponses_;
+    };
+
+    struct Response
+    {
+        CefRefPtr<Callback> callback_;
+        bool                success_;
+        int                 errorCode_;
+        CefString           text_;
+    };
+
+    struct Query
+    {
+        StringHash          route_;
+        String              request_;
+        int64               cefQueryId_;
+        int                 browserId_;
+        bool                persistent_;
+        bool                answered_;
+        CefRefPtr<Callback> callback_;
+        HiresTimer          timer_;
+    };
+
+    void HandleUpdate(StringHash eventType, VariantMap& eventData);
+    void HandleEndFrame(StringHash eventType, VariantMap& eventData);
+    void HandleEcho(StringHash eventType, VariantMap& eventData);
+
+    void DispatchQuery(Query &query);
+    void CancelQuery(int64 cefQueryId);
+    void AddLatency(Query &query, RouteStats &stats);
+    void QueueResponse(Query &query, bool success, int errorCode, const String &text);
+    void FlushResponses();
+
+protected:
+    // main thread
+    HashMap<StringHash, Route>  routes_;
+    HashMap<unsigned, Query>    pending_;
+    Vector<Response>            outgoing_;
+    unsigned                    responseTasks_;
+    unsigned                    responsesSent_;
+    unsigned                    nextQueryId_;
+    bool                        benchmark_;
+    Timer                       statsTimer_;
+
+    // shared with the cef ui thread
+    Mutex                       mutex_;
+    HashSet<StringHash>         routeKeys_;
+    Vector<Query>               incoming_;
+    PODVector<int64>            canceled_;
+};
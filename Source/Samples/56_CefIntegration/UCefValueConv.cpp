@@ -0,0 +1,1010 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Urho3D.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Math/Matrix3x4.h>
+#include <SDL/SDL_log.h>
+
+#include <string.h>
+
+#include "UCefValueConv.h"
+
+#include <Urho3D/DebugNew.h>
+
+//=============================================================================
+//=============================================================================
+#define INTERN_MAX_LENGTH       64
+#define INTERN_MAX_STRINGS      4096
+#define BULK_MIN_ELEMENTS       4       // shorter numeric vectors stay lists
+
+// entries of a map message before its values
+#define MAP_LAYOUT_ID           0
+#define MAP_LAYOUT_DEFINITION   1
+#define MAP_VALUES              2
+
+// bytes of the math types sent as blobs, 0 for the rest
+static unsigned GetRawSize(VariantType type)
+{
+    switch ( type )
+    {
+    case VAR_VECTOR2:       return sizeof(Vector2);
+    case VAR_VECTOR3:       return sizeof(Vector3);
+    case VAR_VECTOR4:       return sizeof(Vector4);
+    case VAR_QUATERNION:    return sizeof(Quaternion);
+    case VAR_COLOR:         return sizeof(Color);
+    case VAR_INTRECT:       return sizeof(IntRect);
+    case VAR_INTVECTOR2:    return sizeof(IntVector2);
+    case VAR_MATRIX3:       return sizeof(Matrix3);
+    case VAR_MATRIX3X4:     return sizeof(Matrix3x4);
+    case VAR_MATRIX4:       return sizeof(Matrix4);
+    default:                return 0;
+    }
+}
+
+static const void* GetRawData(const Variant &value)
+{
+    switch ( value.GetType() )
+    {
+    case VAR_VECTOR2:       return value.GetVector2().Data();
+    case VAR_VECTOR3:       return value.GetVector3().Data();
+    case VAR_VECTOR4:       return value.GetVector4().Data();
+    case VAR_QUATERNION:    return value.GetQuaternion().Data();
+    case VAR_COLOR:         return value.GetColor().Data();
+    case VAR_INTRECT:       return value.GetIntRect().Data();
+    case VAR_INTVECTOR2:    return value.GetIntVector2().Data();
+    case VAR_MATRIX3:       return value.GetMatrix3().Data();
+    case VAR_MATRIX3X4:     return value.GetMatrix3x4().Data();
+    case VAR_MATRIX4:       return value.GetMatrix4().Data();
+    default:                return NULL;
+    }
+}
+
+static Variant FromRawData(VariantType type, const void *data)
+{
+    const float *f = (const float*)data;
+    const int *i = (const int*)data;
+
+    switch ( type )
+    {
+    case VAR_VECTOR2:       return Variant(Vector2(f));
+    case VAR_VECTOR3:       return Variant(Vector3(f));
+    case VAR_VECTOR4:       return Variant(Vector4(f));
+    case VAR_QUATERNION:    return Variant(Quaternion(f));
+    case VAR_COLOR:         return Variant(Color(f));
+    case VAR_INTRECT:       return Variant(IntRect(i));
+    case VAR_INTVECTOR2:    return Variant(IntVector2(i));
+    case VAR_MATRIX3:       return Variant(Matrix3(f));
+    case VAR_MATRIX3X4:     return Variant(Matrix3x4(f));
+    case VAR_MATRIX4:       return Variant(Matrix4(f));
+    default:                return Variant();
+    }
+}
+
+// all ints or all floats, the element type, or VAR_NONE
+static VariantType GetBulkType(const VariantVector &vector)
+{
+    if ( vector.Size() < BULK_MIN_ELEMENTS )
+    {
+        return VAR_NONE;
+    }
+
+    VariantType type = vector[0].GetType();
+
+    if ( type != VAR_INT && type != VAR_FLOAT )
+    {
+        return VAR_NONE;
+    }
+
+    for ( unsigned i = 1; i < vector.Size(); ++i )
+    {
+        if ( vector[i].GetType() != type )
+        {
+            return VAR_NONE;
+        }
+    }
+
+    return type;
+}
+
+//=============================================================================
+// UCefValueWriter
+//=============================================================================
+UCefValueWriter::UCefValueWriter()
+    : nextLayoutId_(0)
+{
+}
+
+CefRefPtr<CefListValue> UCefValueWriter::Write(const VariantMap &map)
+{
+    CefRefPtr<CefListValue> list = CefListValue::Create();
+    WriteMap(map, list);
+    return list;
+}
+
+UCefValueWriter::Layout& UCefValueWriter::GetLayout(const VariantMap &map)
+{
+    unsigned signature = map.Size();
+
+    for ( VariantMap::ConstIterator it = map.Begin(); it != map.End(); ++it )
+    {
+        signature = signature*31 + it->first_.Value();
+        signature = signature*31 + it->second_.GetType();
+    }
+
+    HashMap<unsigned, Layout>::Iterator it = layouts_.Find(signature);
+
+    // a hit is checked, two shapes sharing a signature just take turns
+    if ( it != layouts_.End() )
+    {
+        Layout &layout = it->second_;
+        bool same = layout.keys_.Size() == map.Size();
+        unsigned i = 0;
+
+        for ( VariantMap::ConstIterator itMap = map.Begin(); same && itMap != map.End(); ++itMap, ++i )
+        {
+            same = layout.keys_[i] == itMap->first_ && layout.types_[i] == itMap->second_.GetType();
+        }
+
+        if ( same )
+        {
+            return layout;
+        }
+    }
+
+    Layout &layout = layouts_[signature];
+    layout.keys_.Clear();
+    layout.types_.Clear();
+
+    for ( VariantMap::ConstIterator itMap = map.Begin(); itMap != map.End(); ++itMap )
+    {
+        layout.keys_.Push(itMap->first_);
+        layout.types_.Push((unsigned char)itMap->second_.GetType());
+    }
+
+    layout.id_ = nextLayoutId_++;
+    layout.sent_ = false;
+
+    return layout;
+}
+
+void UCefValueWriter::WriteMap(const VariantMap &map, CefRefPtr<CefListValue> list)
+{
+    Layout &layout = GetLayout(map);
+
+    list->SetSize(MAP_VALUES + map.Size());
+    list->SetInt(MAP_LAYOUT_ID, layout.id_);
+
+    // keys then types, once per layout
+    if ( !layout.sent_ )
+    {
+        unsigned count = layout.keys_.Size();
+        PODVector<unsigned char> definition(count * 5);
+        unsigned char *dest = definition.Buffer();
+
+        for ( unsigned i = 0; i < count; ++i )
+        {
+            unsigned key = layout.keys_[i].Value();
+            memcpy(dest + i*4, &key, 4);
+        }
+        if ( count )
+        {
+            memcpy(dest + count*4, &layout.types_[0], count);
+        }
+
+        list->SetBinary(MAP_LAYOUT_DEFINITION, CefBinaryValue::Create(definition.Buffer(), definition.Size()));
+        layout.sent_ = true;
+    }
+    else
+    {
+        list->SetNull(MAP_LAYOUT_DEFINITION);
+    }
+
+    size_t index = MAP_VALUES;
+
+    for ( VariantMap::ConstIterator it = map.Begin(); it != map.End(); ++it, ++index )
+    {
+        WriteValue(it->second_, list, index);
+    }
+}
+
+void UCefValueWriter::WriteValue(const Variant &value, CefRefPtr<CefListValue> list, size_t index)
+{
+    VariantType type = value.GetType();
+
+    switch ( type )
+    {
+    case VAR_INT:
+        list->SetInt(index, value.GetInt());
+        break;
+
+    case VAR_BOOL:
+        list->SetBool(index, value.GetBool());
+        break;
+
+    case VAR_FLOAT:
+        list->SetDouble(index, value.GetFloat());
+        break;
+
+    case VAR_DOUBLE:
+        list->SetDouble(index, value.GetDouble());
+        break;
+
+    case VAR_STRING:
+        WriteString(value.GetString(), list, index);
+        break;
+
+    case VAR_BUFFER:
+        {
+            const PODVector<unsigned char> &buffer = value.GetBuffer();
+
+            if ( buffer.Size() )
+            {
+                list->SetBinary(index, CefBinaryValue::Create(buffer.Buffer(), buffer.Size()));
+            }
+            else
+            {
+                list->SetNull(index);
+            }
+        }
+        break;
+
+    case VAR_VARIANTVECTOR:
+        WriteVector(value.GetVariantVector(), list, index);
+        break;
+
+    case VAR_VARIANTMAP:
+        {
+            CefRefPtr<CefListValue> child = CefListValue::Create();
+            WriteMap(value.GetVariantMap(), child);
+            list->SetList(index, child);
+        }
+        break;
+
+    case VAR_STRINGVECTOR:
+        {
+            const StringVector &strings = value.GetStringVector();
+            CefRefPtr<CefListValue> child = CefListValue::Create();
+            child->SetSize(strings.Size());
+
+            for ( unsigned i = 0; i < strings.Size(); ++i )
+            {
+                WriteString(strings[i], child, i);
+            }
+            list->SetList(index, child);
+        }
+        break;
+
+    default:
+        if ( GetRawSize(type) )
+        {
+            list->SetBinary(index, CefBinaryValue::Create(GetRawData(value), GetRawSize(type)));
+        }
+        else
+        {
+            list->SetNull(index);
+        }
+        break;
+    }
+}
+
+void UCefValueWriter::WriteVector(const VariantVector &vector, CefRefPtr<CefListValue> list, size_t index)
+{
+    if ( vector.Empty() )
+    {
+        list->SetNull(index);
+        return;
+    }
+
+    VariantType bulkType = GetBulkType(vector);
+
+    // element type then the packed ints or floats
+    if ( bulkType != VAR_NONE )
+    {
+        unsigned count = vector.Size();
+        PODVector<unsigned char> blob(4 + count*4);
+        unsigned char *dest = blob.Buffer();
+        unsigned tag = bulkType;
+        memcpy(dest, &tag, 4);
+
+        if ( bulkType == VAR_INT )
+        {
+            int *values = (int*)(dest + 4);
+            for ( unsigned i = 0; i < count; ++i )
+            {
+                values[i] = vector[i].GetInt();
+            }
+        }
+        else
+        {
+            float *values = (float*)(dest + 4);
+            for ( unsigned i = 0; i < count; ++i )
+            {
+                values[i] = vector[i].GetFloat();
+            }
+        }
+
+        list->SetBinary(index, CefBinaryValue::Create(blob.Buffer(), blob.Size()));
+        return;
+    }
+
+    // mixed, element types as a blob in front of the values
+    CefRefPtr<CefListValue> child = CefListValue::Create();
+    PODVector<unsigned char> types(vector.Size());
+    child->SetSize(1 + vector.Size());
+
+    for ( unsigned i = 0; i < vector.Size(); ++i )
+    {
+        types[i] = (unsigned char)vector[i].GetType();
+        WriteValue(vector[i], child, 1 + i);
+    }
+
+    child->SetBinary(0, CefBinaryValue::Create(types.Buffer(), types.Size()));
+    list->SetList(index, child);
+}
+
+void UCefValueWriter::WriteString(const String &text, CefRefPtr<CefListValue> list, size_t index)
+{
+    if ( text.Length() <= INTERN_MAX_LENGTH )
+    {
+        HashMap<String, int>::ConstIterator it = internIds_.Find(text);
+
+        if ( it != internIds_.End() )
+        {
+            list->SetInt(index, it->second_);
+            return;
+        }
+
+        // the reader adds it on its side when it reads it
+        if ( internIds_.Size() < INTERN_MAX_STRINGS )
+        {
+            int id = (int)internIds_.Size();
+            internIds_[text] = id;
+        }
+    }
+
+    list->SetString(index, CefString(text.CString()));
+}
+
+//=============================================================================
+// UCefValueReader
+//=============================================================================
+UCefValueReader::UCefValueReader()
+{
+}
+
+bool UCefValueReader::Read(CefRefPtr<CefListValue> list, VariantMap &map)
+{
+    map.Clear();
+    return list && ReadMap(list, map);
+}
+
+bool UCefValueReader::ReadMap(CefRefPtr<CefListValue> list, VariantMap &map)
+{
+    if ( list->GetSize() < MAP_VALUES || list->GetType(MAP_LAYOUT_ID) != VTYPE_INT )
+    {
+        return false;
+    }
+
+    int id = list->GetInt(MAP_LAYOUT_ID);
+
+    if ( list->GetType(MAP_LAYOUT_DEFINITION) == VTYPE_BINARY )
+    {
+        CefRefPtr<CefBinaryValue> definition = list->GetBinary(MAP_LAYOUT_DEFINITION);
+        unsigned count = (unsigned)definition->GetSize() / 5;
+        PODVector<unsigned char> bytes(count * 5);
+
+        if ( count )
+        {
+            definition->GetData(bytes.Buffer(), bytes.Size(), 0);
+        }
+
+        Layout &layout = layouts_[id];
+        layout.keys_.Resize(count);
+        layout.types_.Resize(count);
+
+        for ( unsigned i = 0; i < count; ++i )
+        {
+            unsigned key;
+            memcpy(&key, &bytes[i*4], 4);
+            layout.keys_[i] = StringHash(key);
+            layout.types_[i] = bytes[count*4 + i];
+        }
+    }
+
+    HashMap<int, Layout>::ConstIterator it = layouts_.Find(id);
+
+    if ( it == layouts_.End() || list->GetSize() != MAP_VALUES + it->second_.keys_.Size() )
+    {
+        return false;
+    }
+
+    const Layout &layout = it->second_;
+
+    for ( unsigned i = 0; i < layout.keys_.Size(); ++i )
+    {
+        if ( !ReadValue(list, MAP_VALUES + i, (VariantType)layout.types_[i], map[layout.keys_[i]]) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool UCefValueReader::ReadValue(CefRefPtr<CefListValue> list, size_t index, VariantType type, Variant &value)
+{
+    switch ( type )
+    {
+    case VAR_INT:
+        value = list->GetInt(index);
+        return true;
+
+    case VAR_BOOL:
+        value = list->GetBool(index);
+        return true;
+
+    case VAR_FLOAT:
+        value = (float)list->GetDouble(index);
+        return true;
+
+    case VAR_DOUBLE:
+        value = list->GetDouble(index);
+        return true;
+
+    case VAR_STRING:
+        {
+            String text;
+            if ( !ReadString(list, index, text) )
+            {
+                return false;
+            }
+            value = text;
+        }
+        return true;
+
+    case VAR_BUFFER:
+        {
+            PODVector<unsigned char> buffer;
+
+            if ( list->GetType(index) == VTYPE_BINARY )
+            {
+                CefRefPtr<CefBinaryValue> blob = list->GetBinary(index);
+                buffer.Resize((unsigned)blob->GetSize());
+                blob->GetData(buffer.Buffer(), buffer.Size(), 0);
+            }
+            value = buffer;
+        }
+        return true;
+
+    case VAR_VARIANTVECTOR:
+        {
+            VariantVector vector;
+            if ( !ReadVector(list, index, vector) )
+            {
+                return false;
+            }
+            value = vector;
+        }
+        return true;
+
+    case VAR_VARIANTMAP:
+        {
+            VariantMap child;
+            if ( list->GetType(index) != VTYPE_LIST || !ReadMap(list->GetList(index), child) )
+            {
+                return false;
+            }
+            value = child;
+        }
+        return true;
+
+    case VAR_STRINGVECTOR:
+        {
+            if ( list->GetType(index) != VTYPE_LIST )
+            {
+                return false;
+            }
+
+            CefRefPtr<CefListValue> child = list->GetList(index);
+            StringVector strings(child->GetSize());
+
+            for ( unsigned i = 0; i < strings.Size(); ++i )
+            {
+                if ( !ReadString(child, i, strings[i]) )
+                {
+                    return false;
+                }
+            }
+            value = strings;
+        }
+        return true;
+
+    default:
+        break;
+    }
+
+    unsigned size = GetRawSize(type);
+
+    if ( size == 0 )
+    {
+        value = Variant::EMPTY;
+        return true;
+    }
+
+    if ( list->GetType(index) != VTYPE_BINARY )
+    {
+        return false;
+    }
+
+    CefRefPtr<CefBinaryValue> blob = list->GetBinary(index);
+    float raw[16];
+
+    if ( blob->GetSize() != size || blob->GetData(raw, size, 0) != size )
+    {
+        return false;
+    }
+
+    value = FromRawData(type, raw);
+    return true;
+}
+
+bool UCefValueReader::ReadVector(CefRefPtr<CefListValue> list, size_t index, VariantVector &vector)
+{
+    cef_value_type_t valueType = list->GetType(index);
+
+    if ( valueType == VTYPE_NULL )
+    {
+        return true;
+    }
+
+    if ( valueType == VTYPE_BINARY )
+    {
+        CefRefPtr<CefBinaryValue> blob = list->GetBinary(index);
+        unsigned size = (unsigned)blob->GetSize();
+
+        if ( size < 4 || ( size - 4 ) % 4 )
+        {
+            return false;
+        }
+
+        PODVector<unsigned char> bytes(size);
+        blob->GetData(bytes.Buffer(), size, 0);
+
+        unsigned tag;
+        memcpy(&tag, bytes.Buffer(), 4);
+        unsigned count = ( size - 4 ) / 4;
+        vector.Resize(count);
+
+        if ( tag == VAR_INT )
+        {
+            const int *values = (const int*)(bytes.Buffer() + 4);
+            for ( unsigned i = 0; i < count; ++i )
+            {
+                vector[i] = values[i];
+            }
+        }
+        else if ( tag == VAR_FLOAT )
+        {
+            const float *values = (const float*)(bytes.Buffer() + 4);
+            for ( unsigned i = 0; i < count; ++i )
+            {
+                vector[i] = values[i];
+            }
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    if ( valueType != VTYPE_LIST )
+    {
+        return false;
+    }
+
+    CefRefPtr<CefListValue> child = list->GetList(index);
+
+    if ( child->GetSize() < 1 || child->GetType(0) != VTYPE_BINARY )
+    {
+        return false;
+    }
+
+    CefRefPtr<CefBinaryValue> typesBlob = child->GetBinary(0);
+    unsigned count = (unsigned)typesBlob->GetSize();
+
+    if ( child->GetSize() != 1 + count )
+    {
+        return false;
+    }
+
+    PODVector<unsigned char> types(count);
+    typesBlob->GetData(types.Buffer(), count, 0);
+    vector.Resize(count);
+
+    for ( unsigned i = 0; i < count; ++i )
+    {
+        if ( !ReadValue(child, 1 + i, (VariantType)types[i], vector[i]) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool UCefValueReader::ReadString(CefRefPtr<CefListValue> list, size_t index, String &text)
+{
+    cef_value_type_t valueType = list->GetType(index);
+
+    if ( valueType == VTYPE_INT )
+    {
+        int id = list->GetInt(index);
+
+        if ( id < 0 || id >= (int)interned_.Size() )
+        {
+            return false;
+        }
+
+        text = interned_[id];
+        return true;
+    }
+
+    if ( valueType != VTYPE_STRING )
+    {
+        return false;
+    }
+
+    text = list->GetString(index).ToString().c_str();
+
+    // same rule as the writer
+    if ( text.Length() <= INTERN_MAX_LENGTH && interned_.Size() < INTERN_MAX_STRINGS )
+    {
+        interned_.Push(text);
+    }
+
+    return true;
+}
+
+//=============================================================================
+// benchmark, against the naive conversion: a dictionary keyed "hash:type",
+// every number its own entry
+//=============================================================================
+static CefRefPtr<CefDictionaryValue> NaiveWriteMap(const VariantMap &map);
+static bool NaiveReadMap(CefRefPtr<CefDictionaryValue> dict, VariantMap &map);
+
+static CefRefPtr<CefValue> NaiveWrite(const Variant &value)
+{
+    CefRefPtr<CefValue> out = CefValue::Create();
+    VariantType type = value.GetType();
+
+    switch ( type )
+    {
+    case VAR_INT:       out->SetInt(value.GetInt()); break;
+    case VAR_BOOL:      out->SetBool(value.GetBool()); break;
+    case VAR_FLOAT:     out->SetDouble(value.GetFloat()); break;
+    case VAR_DOUBLE:    out->SetDouble(value.GetDouble()); break;
+    case VAR_STRING:    out->SetString(CefString(value.GetString().CString())); break;
+    case VAR_VARIANTMAP: out->SetDictionary(NaiveWriteMap(value.GetVariantMap())); break;
+
+    case VAR_VARIANTVECTOR:
+        {
+            const VariantVector &vector = value.GetVariantVector();
+            CefRefPtr<CefListValue> list = CefListValue::Create();
+
+            for ( unsigned i = 0; i < vector.Size(); ++i )
+            {
+                CefRefPtr<CefListValue> pair = CefListValue::Create();
+                pair->SetInt(0, vector[i].GetType());
+                pair->SetValue(1, NaiveWrite(vector[i]));
+                list->SetList(i, pair);
+            }
+            out->SetList(list);
+        }
+        break;
+
+    case VAR_STRINGVECTOR:
+        {
+            const StringVector &strings = value.GetStringVector();
+            CefRefPtr<CefListValue> list = CefListValue::Create();
+
+            for ( unsigned i = 0; i < strings.Size(); ++i )
+            {
+                list->SetString(i, CefString(strings[i].CString()));
+            }
+            out->SetList(list);
+        }
+        break;
+
+    case VAR_BUFFER:
+        {
+            const PODVector<unsigned char> &buffer = value.GetBuffer();
+            CefRefPtr<CefListValue> list = CefListValue::Create();
+
+            for ( unsigned i = 0; i < buffer.Size(); ++i )
+            {
+                list->SetInt(i, buffer[i]);
+            }
+            out->SetList(list);
+        }
+        break;
+
+    default:
+        if ( GetRawSize(type) )
+        {
+            CefRefPtr<CefListValue> list = CefListValue::Create();
+            unsigned count = GetRawSize(type) / 4;
+            const float *f = (const float*)GetRawData(value);
+            const int *n = (const int*)GetRawData(value);
+            bool ints = type == VAR_INTRECT || type == VAR_INTVECTOR2;
+
+            for ( unsigned i = 0; i < count; ++i )
+            {
+                list->SetDouble(i, ints ? (double)n[i] : (double)f[i]);
+            }
+            out->SetList(list);
+        }
+        else
+        {
+            out->SetNull();
+        }
+        break;
+    }
+
+    return out;
+}
+
+static Variant NaiveRead(CefRefPtr<CefValue> in, VariantType type)
+{
+    switch ( type )
+    {
+    case VAR_INT:       return Variant(in->GetInt());
+    case VAR_BOOL:      return Variant(in->GetBool());
+    case VAR_FLOAT:     return Variant((float)in->GetDouble());
+    case VAR_DOUBLE:    return Variant(in->GetDouble());
+    case VAR_STRING:    return Variant(String(in->GetString().ToString().c_str()));
+
+    case VAR_VARIANTMAP:
+        {
+            VariantMap map;
+            NaiveReadMap(in->GetDictionary(), map);
+            return Variant(map);
+        }
+
+    case VAR_VARIANTVECTOR:
+        {
+            CefRefPtr<CefListValue> list = in->GetList();
+            VariantVector vector(list->GetSize());
+
+            for ( unsigned i = 0; i < vector.Size(); ++i )
+            {
+                CefRefPtr<CefListValue> pair = list->GetList(i);
+                vector[i] = NaiveRead(pair->GetValue(1), (VariantType)pair->GetInt(0));
+            }
+            return Variant(vector);
+        }
+
+    case VAR_STRINGVECTOR:
+        {
+            CefRefPtr<CefListValue> list = in->GetList();
+            StringVector strings(list->GetSize());
+
+            for ( unsigned i = 0; i < strings.Size(); ++i )
+            {
+                strings[i] = list->GetString(i).ToString().c_str();
+            }
+            return Variant(strings);
+        }
+
+    case VAR_BUFFER:
+        {
+            CefRefPtr<CefListValue> list = in->GetList();
+            PODVector<unsigned char> buffer(list->GetSize());
+
+            for ( unsigned i = 0; i < buffer.Size(); ++i )
+            {
+                buffer[i] = (unsigned char)list->GetInt(i);
+            }
+            return Variant(buffer);
+        }
+
+    default:
+        break;
+    }
+
+    if ( GetRawSize(type) == 0 )
+    {
+        return Variant::EMPTY;
+    }
+
+    CefRefPtr<CefListValue> list = in->GetList();
+    unsigned count = GetRawSize(type) / 4;
+    bool ints = type == VAR_INTRECT || type == VAR_INTVECTOR2;
+    float f[16];
+    int n[16];
+
+    for ( unsigned i = 0; i < count; ++i )
+    {
+        f[i] = (float)list->GetDouble(i);
+        n[i] = (int)list->GetDouble(i);
+    }
+
+    return FromRawData(type, ints ? (const void*)n : (const void*)f);
+}
+
+static CefRefPtr<CefDictionaryValue> NaiveWriteMap(const VariantMap &map)
+{
+    CefRefPtr<CefDictionaryValue> dict = CefDictionaryValue::Create();
+
+    for ( VariantMap::ConstIterator it = map.Begin(); it != map.End(); ++it )
+    {
+        String key = String(it->first_.Value()) + ":" + String((int)it->second_.GetType());
+        dict->SetValue(CefString(key.CString()), NaiveWrite(it->second_));
+    }
+
+    return dict;
+}
+
+static bool NaiveReadMap(CefRefPtr<CefDictionaryValue> dict, VariantMap &map)
+{
+    CefDictionaryValue::KeyList keys;
+    dict->GetKeys(keys);
+
+    for ( unsigned i = 0; i < keys.size(); ++i )
+    {
+        Vector<String> parts = String(keys[i].ToString().c_str()).Split(':');
+
+        if ( parts.Size() != 2 )
+        {
+            return false;
+        }
+
+        map[StringHash(ToUInt(parts[0]))] = NaiveRead(dict->GetValue(keys[i]), (VariantType)ToInt(parts[1]));
+    }
+
+    return true;
+}
+
+// the kind of messages a hud, an inventory and a minimap send, values
+// change with |frame|, shapes don't
+static void MakeSamples(unsigned frame, Vector<VariantMap> &samples)
+{
+    static const char *itemNames[] = { "Sword", "Shield", "Potion", "Arrow", "Mushroom", "Key" };
+
+    samples.Resize(4);
+
+    VariantMap &hud = samples[0];
+    hud["Health"] = (int)(100 - frame % 100);
+    hud["Ammo"] = (int)(frame % 30);
+    hud["Player"] = "Jack";
+    hud["Position"] = Vector3((float)frame, 1.5f, -(float)frame * 0.25f);
+    hud["Alive"] = frame % 7 != 0;
+    hud["Speed"] = 3.25f + (float)(frame % 10);
+
+    VariantMap &inventory = samples[1];
+    VariantVector items;
+    for ( unsigned i = 0; i < 24; ++i )
+    {
+        VariantMap item;
+        item["Id"] = (int)i;
+        item["Name"] = itemNames[(i + frame) % 6];
+        item["Count"] = (int)((i * frame) % 99);
+        items.Push(item);
+    }
+    inventory["Items"] = items;
+    inventory["Gold"] = (int)frame * 3;
+
+    VariantMap &tile = samples[2];
+    VariantVector heights;
+    VariantVector markers;
+    for ( unsigned i = 0; i < 256; ++i )
+    {
+        heights.Push((float)((i * 37 + frame) % 100) * 0.125f);
+    }
+    for ( unsigned i = 0; i < 64; ++i )
+    {
+        markers.Push((int)(i * frame));
+    }
+    tile["Tile"] = IntVector2(frame % 16, frame / 16);
+    tile["Heights"] = heights;
+    tile["Markers"] = markers;
+
+    VariantMap &misc = samples[3];
+    PODVector<unsigned char> buffer(48);
+    for ( unsigned i = 0; i < buffer.Size(); ++i )
+    {
+        buffer[i] = (unsigned char)(i + frame);
+    }
+    StringVector tags;
+    tags.Push("quest");
+    tags.Push(String("step") + String(frame % 4));
+    VariantVector mixed;
+    mixed.Push(1);
+    mixed.Push("two");
+    mixed.Push(3.0f);
+    mixed.Push(Color(0.1f, 0.2f, 0.3f, (float)(frame % 2)));
+    misc["Color"] = Color(1.0f, 0.5f, 0.25f, 1.0f);
+    misc["Rotation"] = Quaternion((float)(frame % 360), Vector3::UP);
+    misc["Transform"] = Matrix3x4(Vector3((float)frame, 0.0f, 1.0f), Quaternion::IDENTITY, 2.0f);
+    misc["Rect"] = IntRect(0, 0, (int)frame, 32);
+    misc["Buffer"] = buffer;
+    misc["Time"] = (double)frame * 0.016;
+    misc["Tags"] = tags;
+    misc["Mixed"] = mixed;
+    misc["Empty"] = VariantVector();
+    misc["Hud"] = samples[0];
+}
+
+bool RunValueConvBench(unsigned iterations)
+{
+    UCefValueWriter writer;
+    UCefValueReader reader;
+    Vector<VariantMap> samples;
+    VariantMap decoded;
+    unsigned mismatches = 0;
+    long long usecCompact = 0;
+    long long usecNaive = 0;
+    HiresTimer timer;
+
+    for ( unsigned frame = 0; frame < iterations; ++frame )
+    {
+        MakeSamples(frame, samples);
+
+        for ( unsigned i = 0; i < samples.Size(); ++i )
+        {
+            timer.Reset();
+            bool read = reader.Read(writer.Write(samples[i]), decoded);
+            usecCompact += timer.GetUSec(false);
+
+            if ( !read || decoded != samples[i] )
+            {
+                if ( mismatches++ < 4 )
+                {
+                    SDL_Log("value conv: layout round trip of sample %u failed at frame %u", i, frame);
+                }
+            }
+
+            decoded.Clear();
+            timer.Reset();
+            bool naiveRead = NaiveReadMap(NaiveWriteMap(samples[i]), decoded);
+            usecNaive += timer.GetUSec(false);
+
+            if ( !naiveRead || decoded != samples[i] )
+            {
+                if ( mismatches++ < 4 )
+                {
+                    SDL_Log("value conv: naive round trip of sample %u failed at frame %u", i, frame);
+                }
+            }
+        }
+    }
+
+    unsigned messages = iterations * samples.Size();
+
+    SDL_Log("value conv: %u messages, layouts %.2f us/msg, naive %.2f us/msg, %u layouts, %u interned, %u mismatches",
+            messages, (double)usecCompact / Max(messages, 1U), (double)usecNaive / Max(messages, 1U),
+            writer.GetNumLayouts(), writer.GetNumInterned(), mismatches);
+
+    return mismatches == 0;
+}
@@ -0,0 +1,107 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Core/Variant.h>
+#include <Urho3D/Container/HashMap.h>
+
+#include "include/cef_values.h"
+
+using namespace Urho3D;
+
+//=============================================================================
+// VariantMap <-> CefListValue for process messages.
+//
+// A map's shape, its keys and value types in order, is compiled once into a
+// layout and given an id. The layout's definition goes out with the first
+// message that uses it, later messages only carry the id and the values in
+// layout order, without keys or types. Math types, buffers and numeric
+// VariantVectors are CefBinaryValue blobs instead of a list entry per
+// number. Short strings are interned, a string already sent is an int id.
+//
+// Writer and reader are stateful: use one pair per direction and read the
+// messages in the order they were written, as process messages arrive.
+// Pointers and resource refs don't cross processes and are read back empty.
+//=============================================================================
+class UCefValueWriter
+{
+public:
+    UCefValueWriter();
+
+    CefRefPtr<CefListValue> Write(const VariantMap &map);
+
+    unsigned GetNumLayouts() const                  { return layouts_.Size(); }
+    unsigned GetNumInterned() const                 { return internIds_.Size(); }
+
+protected:
+    struct Layout
+    {
+        PODVector<StringHash>   keys_;
+        PODVector<unsigned char> types_;
+        int                     id_;
+        bool                    sent_;
+    };
+
+    void WriteMap(const VariantMap &map, CefRefPtr<CefListValue> list);
+    void WriteValue(const Variant &value, CefRefPtr<CefListValue> list, size_t index);
+    void WriteVector(const VariantVector &vector, CefRefPtr<CefListValue> list, size_t index);
+    void WriteString(const String &text, CefRefPtr<CefListValue> list, size_t index);
+    Layout& GetLayout(const VariantMap &map);
+
+protected:
+    HashMap<unsigned, Layout>   layouts_;       // by shape signature
+    HashMap<String, int>        internIds_;
+    int                         nextLayoutId_;
+};
+
+//=============================================================================
+//=============================================================================
+class UCefValueReader
+{
+public:
+    UCefValueReader();
+
+    // false when the message doesn't follow what was read before
+    bool Read(CefRefPtr<CefListValue> list, VariantMap &map);
+
+protected:
+    struct Layout
+    {
+        PODVector<StringHash>   keys_;
+        PODVector<unsigned char> types_;
+    };
+
+    bool ReadMap(CefRefPtr<CefListValue> list, VariantMap &map);
+    bool ReadValue(CefRefPtr<CefListValue> list, size_t index, VariantType type, Variant &value);
+    bool ReadVector(CefRefPtr<CefListValue> list, size_t index, VariantVector &vector);
+    bool ReadString(CefRefPtr<CefListValue> list, size_t index, String &text);
+
+protected:
+    HashMap<int, Layout>    layouts_;
+    Vector<String>          interned_;
+};
+
+// round trips sample shapes through both, then times them against a naive
+// element by element CefDictionaryValue conversion, results are logged
+bool RunValueConvBench(unsigned iterations);
@@ -0,0 +1,55 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+//=============================================================================
+// Browser surface replication, server runs the browser and clients only show
+// its frames. Messages ride on the regular Urho connection:
+//
+//  HELLO   client -> server  UInt max bytes/sec (0 = server's rate)
+//  SURFACE server -> client  Int width, Int height, UInt components, UByte tile shift
+//  TILES   server -> client  UInt frame number, VLE count, then per tile:
+//                            VLE tile index, UByte encoding, payload
+//
+// Tiles are numbered row-major, edge tiles are clipped to the surface. The
+// server keeps the hash of every tile a client holds and only sends tiles
+// whose hash differs, so a client that's capped or falls behind just gets
+// the latest content of the tiles it's missing, never a backlog.
+//=============================================================================
+#define FRAMENET_MSG_HELLO      0x4350
+#define FRAMENET_MSG_SURFACE    0x4351
+#define FRAMENET_MSG_TILES      0x4352
+
+#define FRAMENET_TILE_SHIFT     6
+#define FRAMENET_TILE_SIZE      (1 << FRAMENET_TILE_SHIFT)
+#define FRAMENET_MAX_MESSAGE    (32*1024)           // tiles message split size
+#define FRAMENET_DEFAULT_RATE   (2*1024*1024)       // bytes/sec per client
+#define FRAMENET_BURST_MSEC     100                 // budget a client can bank
+#define FRAMENET_MAX_SURFACE    8192                // widest/tallest surface a client accepts
+
+enum FrameNetEncoding
+{
+    ENCODE_RAW = 0,     // tw*th*components bytes
+    ENCODE_FILL,        // one pixel, single color tile
+    ENCODE_LZ4,         // UInt size, lz4 block
+};
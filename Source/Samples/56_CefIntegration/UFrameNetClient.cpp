@@ -0,0 +1,286 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Urho3D.h>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Graphics/Graphics.h>
+#include <Urho3D/Graphics/Texture2D.h>
+#include <Urho3D/IO/MemoryBuffer.h>
+#include <Urho3D/IO/VectorBuffer.h>
+#include <Urho3D/Network/Connection.h>
+#include <Urho3D/Network/Network.h>
+#include <Urho3D/Network/NetworkEvents.h>
+#include <Urho3D/UI/BorderImage.h>
+#include <Urho3D/UI/UI.h>
+#include <SDL/SDL_log.h>
+#include <LZ4/lz4.h>
+
+#include <string.h>
+
+#include "UFrameNetClient.h"
+
+#include <Urho3D/DebugNew.h>
+
+//=============================================================================
+//=============================================================================
+UFrameNetClient::UFrameNetClient(Context *context)
+    : Object(context)
+    , requestedRate_(0)
+    , width_(0)
+    , height_(0)
+    , components_(0)
+    , tileShift_(FRAMENET_TILE_SHIFT)
+    , tilesX_(0)
+    , bytesReceived_(0)
+    , tilesReceived_(0)
+    , frameNumber_(0)
+{
+}
+
+UFrameNetClient::~UFrameNetClient()
+{
+    Disconnect();
+}
+
+bool UFrameNetClient::Connect(const String &address, unsigned short port, unsigned bytesPerSec)
+{
+    Network *network = GetSubsystem<Network>();
+
+    if ( network == NULL )
+    {
+        return false;
+    }
+
+    requestedRate_ = bytesPerSec;
+
+    SubscribeToEvent(E_SERVERCONNECTED, URHO3D_HANDLER(UFrameNetClient, HandleServerConnected));
+    SubscribeToEvent(E_SERVERDISCONNECTED, URHO3D_HANDLER(UFrameNetClient, HandleServerDisconnected));
+    SubscribeToEvent(E_CONNECTFAILED, URHO3D_HANDLER(UFrameNetClient, HandleServerDisconnected));
+    SubscribeToEvent(E_NETWORKMESSAGE, URHO3D_HANDLER(UFrameNetClient, HandleNetworkMessage));
+
+    // no scene, the connection only carries the surface
+    return network->Connect(address, port, NULL);
+}
+
+void UFrameNetClient::Disconnect()
+{
+    UnsubscribeFromAllEvents();
+
+    Network *network = GetSubsystem<Network>();
+
+    if ( network && network->GetServerConnection() )
+    {
+        network->Disconnect();
+    }
+
+    if ( image_ )
+    {
+        image_->Remove();
+        image_ = NULL;
+    }
+    texture_ = NULL;
+}
+
+void UFrameNetClient::HandleServerConnected(StringHash eventType, VariantMap& eventData)
+{
+    VectorBuffer msg;
+    msg.WriteUInt(requestedRate_);
+    GetSubsystem<Network>()->GetServerConnection()->SendMessage(FRAMENET_MSG_HELLO, true, true, msg);
+}
+
+void UFrameNetClient::HandleServerDisconnected(StringHash eventType, VariantMap& eventData)
+{
+    SDL_Log("UFrameNetClient: disconnected, received %u KB in %u tiles", bytesReceived_/1024, tilesReceived_);
+}
+
+void UFrameNetClient::HandleNetworkMessage(StringHash eventType, VariantMap& eventData)
+{
+    using namespace NetworkMessage;
+
+    Connection *connection = static_cast<Connection*>(eventData[P_CONNECTION].GetPtr());
+
+    // only from the server, a loopback test also sees the server's own traffic
+    if ( connection != GetSubsystem<Network>()->GetServerConnection() )
+    {
+        return;
+    }
+
+    int msgID = eventData[P_MESSAGEID].GetInt();
+    const PODVector<unsigned char> &data = eventData[P_DATA].GetBuffer();
+
+    if ( msgID == FRAMENET_MSG_SURFACE )
+    {
+        MemoryBuffer msg(data);
+        int width = msg.ReadInt();
+        int height = msg.ReadInt();
+        unsigned components = msg.ReadUInt();
+        unsigned tileShift = msg.ReadUByte();
+
+        SetSurface(width, height, components, tileShift);
+    }
+    else if ( msgID == FRAMENET_MSG_TILES )
+    {
+        bytesReceived_ += data.Size();
+        ReadTiles(data);
+    }
+}
+
+void UFrameNetClient::SetSurface(int width, int height, unsigned components, unsigned tileShift)
+{
+    // the texture is rgba, and the size comes off the wire so it's capped to what a
+    // texture can be before it sizes the tile math and the allocations
+    if ( components != 4 || width <= 0 || height <= 0 || tileShift > 8 ||
+         width > FRAMENET_MAX_SURFACE || height > FRAMENET_MAX_SURFACE )
+    {
+        SDL_Log("UFrameNetClient: unsupported surface %dx%dx%u", width, height, components);
+        return;
+    }
+
+    width_ = width;
+    height_ = height;
+    components_ = components;
+    tileShift_ = tileShift;
+    tilesX_ = (width + (1 << tileShift) - 1) >> tileShift;
+    tileBuffer_.Resize((1 << tileShift)*(1 << tileShift)*components);
+
+    texture_ = new Texture2D(context_);
+    texture_->SetNumLevels(1);
+
+    if ( !texture_->SetSize(width_, height_, Graphics::GetRGBAFormat()) )
+    {
+        SDL_Log("UFrameNetClient: failed to create a %dx%d texture", width_, height_);
+        texture_ = NULL;
+        return;
+    }
+
+    texture_->SetFilterMode(FILTER_BILINEAR);
+    texture_->SetAddressMode(COORD_U, ADDRESS_CLAMP);
+    texture_->SetAddressMode(COORD_V, ADDRESS_CLAMP);
+
+    if ( image_ == NULL )
+    {
+        image_ = GetSubsystem<UI>()->GetRoot()->CreateChild<BorderImage>();
+        image_->SetPosition(40, 40);
+        image_->SetOpacity(0.95f);
+    }
+
+    image_->SetTexture(texture_);
+    image_->SetFullImageRect();
+    image_->SetSize(width_, height_);
+}
+
+void UFrameNetClient::ReadTiles(const PODVector<unsigned char> &data)
+{
+    if ( texture_ == NULL )
+    {
+        return;
+    }
+
+    MemoryBuffer msg(data);
+    frameNumber_ = msg.ReadUInt();
+    unsigned count = msg.ReadVLE();
+    unsigned tileSize = 1 << tileShift_;
+    unsigned numTiles = tilesX_*((height_ + tileSize - 1) >> tileShift_);
+
+    // the rest of a malformed message is dropped, tiles before it are good
+    for ( unsigned i = 0; i < count; ++i )
+    {
+        if ( msg.IsEof() )
+        {
+            SDL_Log("UFrameNetClient: truncated message, %u of %u tiles", i, count);
+            return;
+        }
+
+        unsigned tile = msg.ReadVLE();
+        unsigned encoding = msg.ReadUByte();
+
+        if ( tile >= numTiles )
+        {
+            SDL_Log("UFrameNetClient: bad tile %u", tile);
+            return;
+        }
+
+        int left = (tile % tilesX_) << tileShift_;
+        int top = (tile / tilesX_) << tileShift_;
+        int tw = Min(left + (int)tileSize, width_) - left;
+        int th = Min(top + (int)tileSize, height_) - top;
+        unsigned size = tw*th*components_;
+        unsigned remaining = msg.GetSize() - msg.GetPosition();
+
+        if ( encoding == ENCODE_FILL )
+        {
+            if ( remaining < components_ )
+            {
+                SDL_Log("UFrameNetClient: truncated tile %u", tile);
+                return;
+            }
+
+            unsigned char pixel[4];
+            msg.Read(pixel, components_);
+
+            for ( unsigned p = 0; p < size; p += components_ )
+            {
+                memcpy(&tileBuffer_[p], pixel, components_);
+            }
+        }
+        else if ( encoding == ENCODE_LZ4 )
+        {
+            unsigned packed = remaining >= sizeof(unsigned) ? msg.ReadUInt() : 0;
+
+            if ( packed == 0 || packed > remaining - sizeof(unsigned) )
+            {
+                SDL_Log("UFrameNetClient: truncated tile %u", tile);
+                return;
+            }
+
+            // the bounded decoder, it never reads past packed nor writes past size
+            int unpacked = LZ4_decompress_safe((const char*)data.Buffer() + msg.GetPosition(),
+                                               (char*)&tileBuffer_[0], (int)packed, (int)size);
+
+            if ( unpacked != (int)size )
+            {
+                SDL_Log("UFrameNetClient: corrupt tile %u", tile);
+                return;
+            }
+
+            msg.Seek(msg.GetPosition() + packed);
+        }
+        else if ( encoding == ENCODE_RAW )
+        {
+            if ( remaining < size )
+            {
+                SDL_Log("UFrameNetClient: truncated tile %u", tile);
+                return;
+            }
+
+            msg.Read(&tileBuffer_[0], size);
+        }
+        else
+        {
+            SDL_Log("UFrameNetClient: unknown encoding %u of tile %u", encoding, tile);
+            return;
+        }
+
+        texture_->SetData(0, left, top, tw, th, &tileBuffer_[0]);
+        ++tilesReceived_;
+    }
+}
@@ -0,0 +1,83 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Container/Ptr.h>
+
+#include "UFrameNet.h"
+
+namespace Urho3D
+{
+class BorderImage;
+class Texture2D;
+}
+
+using namespace Urho3D;
+
+//=============================================================================
+// Shows a browser surface replicated by a UFrameNetServer without running
+// cef. Tiles are uploaded straight into the texture as they arrive.
+//=============================================================================
+class UFrameNetClient : public Object
+{
+    URHO3D_OBJECT(UFrameNetClient, Object);
+public:
+
+    UFrameNetClient(Context *context);
+    virtual ~UFrameNetClient();
+
+    // bytesPerSec caps what the server sends us, 0 takes the server's rate
+    bool Connect(const String &address, unsigned short port, unsigned bytesPerSec = 0);
+    void Disconnect();
+
+    BorderImage* GetImage() const               { return image_; }
+    unsigned GetBytesReceived() const           { return bytesReceived_; }
+    unsigned GetTilesReceived() const           { return tilesReceived_; }
+    unsigned GetFrameNumber() const             { return frameNumber_; }
+
+protected:
+    void HandleServerConnected(StringHash eventType, VariantMap& eventData);
+    void HandleServerDisconnected(StringHash eventType, VariantMap& eventData);
+    void HandleNetworkMessage(StringHash eventType, VariantMap& eventData);
+
+    void SetSurface(int width, int height, unsigned components, unsigned tileShift);
+    void ReadTiles(const PODVector<unsigned char> &data);
+
+protected:
+    SharedPtr<Texture2D>        texture_;
+    SharedPtr<BorderImage>      image_;
+    PODVector<unsigned char>    tileBuffer_;
+    unsigned                    requestedRate_;
+
+    int                         width_;
+    int                         height_;
+    unsigned                    components_;
+    unsigned                    tileShift_;
+    int                         tilesX_;
+
+    // stats
+    unsigned                    bytesReceived_;
+    unsigned                    tilesReceived_;
+    unsigned                    frameNumber_;
+};
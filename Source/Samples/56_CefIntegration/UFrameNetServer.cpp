@@ -0,0 +1,410 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Urho3D.h>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/IO/Compression.h>
+#include <Urho3D/IO/MemoryBuffer.h>
+#include <Urho3D/IO/VectorBuffer.h>
+#include <Urho3D/Network/Connection.h>
+#include <Urho3D/Network/Network.h>
+#include <Urho3D/Network/NetworkEvents.h>
+#include <SDL/SDL_log.h>
+
+#include <string.h>
+
+#include "UFrameNetServer.h"
+
+#include <Urho3D/DebugNew.h>
+
+//=============================================================================
+//=============================================================================
+UFrameNetServer::UFrameNetServer(Context *context)
+    : Object(context)
+    , clientRate_(FRAMENET_DEFAULT_RATE)
+    , startedServer_(false)
+    , width_(0)
+    , height_(0)
+    , components_(0)
+    , tilesX_(0)
+    , tilesY_(0)
+    , bytesSent_(0)
+    , tilesSent_(0)
+{
+}
+
+UFrameNetServer::~UFrameNetServer()
+{
+    Stop();
+}
+
+bool UFrameNetServer::Start(unsigned short port)
+{
+    Network *network = GetSubsystem<Network>();
+
+    if ( network == NULL )
+    {
+        return false;
+    }
+
+    // share a game server that's already running
+    if ( !network->IsServerRunning() )
+    {
+        if ( !network->StartServer(port) )
+        {
+            SDL_Log("UFrameNetServer: failed to start server on port %u", port);
+            return false;
+        }
+        startedServer_ = true;
+    }
+
+    SubscribeToEvent(E_CLIENTDISCONNECTED, URHO3D_HANDLER(UFrameNetServer, HandleClientDisconnected));
+    SubscribeToEvent(E_NETWORKMESSAGE, URHO3D_HANDLER(UFrameNetServer, HandleNetworkMessage));
+    SubscribeToEvent(E_NETWORKUPDATE, URHO3D_HANDLER(UFrameNetServer, HandleNetworkUpdate));
+    sendTimer_.Reset();
+
+    return true;
+}
+
+void UFrameNetServer::Stop()
+{
+    UnsubscribeFromAllEvents();
+    clients_.Clear();
+    frame_ = NULL;
+
+    if ( startedServer_ )
+    {
+        Network *network = GetSubsystem<Network>();
+
+        if ( network )
+        {
+            network->StopServer();
+        }
+        startedServer_ = false;
+    }
+}
+
+void UFrameNetServer::OnFrame(UBrowserFrame *frame)
+{
+    frame_ = frame;
+
+    if ( frame->GetWidth() != width_ || frame->GetHeight() != height_ || frame->GetComponents() != components_ )
+    {
+        SetSurface(frame->GetWidth(), frame->GetHeight(), frame->GetComponents());
+        return;
+    }
+
+    const IntVector2 &rows = frame->GetDirtyRows();
+
+    if ( rows.y_ > rows.x_ )
+    {
+        HashTiles(rows.x_, rows.y_);
+    }
+}
+
+void UFrameNetServer::SetSurface(int width, int height, unsigned components)
+{
+    width_ = width;
+    height_ = height;
+    components_ = components;
+    tilesX_ = (width + FRAMENET_TILE_SIZE - 1) >> FRAMENET_TILE_SHIFT;
+    tilesY_ = (height + FRAMENET_TILE_SIZE - 1) >> FRAMENET_TILE_SHIFT;
+
+    unsigned numTiles = tilesX_*tilesY_;
+    tileHashes_.Resize(numTiles);
+    encodedHashes_.Resize(numTiles);
+    encodedTiles_.Resize(numTiles);
+    tileBuffer_.Resize(FRAMENET_TILE_SIZE*FRAMENET_TILE_SIZE*components);
+
+    for ( unsigned i = 0; i < numTiles; ++i )
+    {
+        encodedHashes_[i] = 0;
+    }
+
+    HashTiles(0, height_);
+
+    // clients start over
+    for ( unsigned i = 0; i < clients_.Size(); ++i )
+    {
+        SendSurface(clients_[i]);
+    }
+}
+
+void UFrameNetServer::SendSurface(ClientState &client)
+{
+    if ( width_ == 0 )
+    {
+        return;
+    }
+
+    VectorBuffer msg;
+    msg.WriteInt(width_);
+    msg.WriteInt(height_);
+    msg.WriteUInt(components_);
+    msg.WriteUByte(FRAMENET_TILE_SHIFT);
+    client.connection_->SendMessage(FRAMENET_MSG_SURFACE, true, true, msg);
+
+    client.hashes_.Resize(tileHashes_.Size());
+    for ( unsigned i = 0; i < client.hashes_.Size(); ++i )
+    {
+        client.hashes_[i] = 0;
+    }
+    client.cursor_ = 0;
+}
+
+IntRect UFrameNetServer::GetTileRect(unsigned tile) const
+{
+    int left = (tile % tilesX_) << FRAMENET_TILE_SHIFT;
+    int top = (tile / tilesX_) << FRAMENET_TILE_SHIFT;
+
+    return IntRect(left, top, Min(left + FRAMENET_TILE_SIZE, width_), Min(top + FRAMENET_TILE_SIZE, height_));
+}
+
+void UFrameNetServer::HashTiles(int top, int bottom)
+{
+    int tileTop = Max(top, 0) >> FRAMENET_TILE_SHIFT;
+    int tileBottom = Min((bottom - 1) >> FRAMENET_TILE_SHIFT, tilesY_ - 1);
+    unsigned pixelBytes = components_;
+
+    for ( int ty = tileTop; ty <= tileBottom; ++ty )
+    {
+        for ( int tx = 0; tx < tilesX_; ++tx )
+        {
+            unsigned tile = ty*tilesX_ + tx;
+            IntRect rect = GetTileRect(tile);
+            unsigned rowBytes = rect.Width()*pixelBytes;
+            unsigned hash = 2166136261U;
+
+            // fnv over 32-bit words
+            for ( int y = rect.top_; y < rect.bottom_; ++y )
+            {
+                const unsigned char *row = frame_->GetRow(y) + rect.left_*pixelBytes;
+                unsigned word;
+
+                for ( unsigned x = 0; x + 4 <= rowBytes; x += 4 )
+                {
+                    memcpy(&word, row + x, 4);
+                    hash = (hash ^ word) * 16777619U;
+                }
+            }
+
+            // 0 is reserved for tiles a client doesn't have
+            tileHashes_[tile] = hash ? hash : 1;
+        }
+    }
+}
+
+const PODVector<unsigned char>& UFrameNetServer::EncodeTile(unsigned tile)
+{
+    PODVector<unsigned char> &encoded = encodedTiles_[tile];
+
+    if ( encodedHashes_[tile] == tileHashes_[tile] )
+    {
+        return encoded;
+    }
+
+    IntRect rect = GetTileRect(tile);
+    unsigned rowBytes = rect.Width()*components_;
+    unsigned size = rowBytes*rect.Height();
+    unsigned char *dst = &tileBuffer_[0];
+    bool fill = true;
+
+    for ( int y = rect.top_; y < rect.bottom_; ++y )
+    {
+        memcpy(dst, frame_->GetRow(y) + rect.left_*components_, rowBytes);
+        dst += rowBytes;
+    }
+
+    for ( unsigned i = components_; i < size && fill; i += components_ )
+    {
+        fill = memcmp(&tileBuffer_[0], &tileBuffer_[i], components_) == 0;
+    }
+
+    if ( fill )
+    {
+        encoded.Resize(1 + components_);
+        encoded[0] = ENCODE_FILL;
+        memcpy(&encoded[1], &tileBuffer_[0], components_);
+    }
+    else
+    {
+        encoded.Resize(1 + 4 + EstimateCompressBound(size));
+        unsigned packed = CompressData(&encoded[5], &tileBuffer_[0], size);
+
+        if ( packed && packed < size )
+        {
+            encoded[0] = ENCODE_LZ4;
+            memcpy(&encoded[1], &packed, 4);
+            encoded.Resize(1 + 4 + packed);
+        }
+        else
+        {
+            encoded.Resize(1 + size);
+            encoded[0] = ENCODE_RAW;
+            memcpy(&encoded[1], &tileBuffer_[0], size);
+        }
+    }
+
+    encodedHashes_[tile] = tileHashes_[tile];
+
+    return encoded;
+}
+
+void UFrameNetServer::SendTiles(ClientState &client, float elapsed)
+{
+    unsigned numTiles = tileHashes_.Size();
+
+    if ( frame_ == NULL || client.hashes_.Size() != numTiles )
+    {
+        return;
+    }
+
+    float burst = (float)client.rate_*FRAMENET_BURST_MSEC/1000.0f;
+    client.budget_ = Min(client.budget_ + (float)client.rate_*elapsed, burst);
+
+    VectorBuffer records;
+    unsigned count = 0;
+
+    for ( unsigned i = 0; i < numTiles; ++i )
+    {
+        unsigned tile = (client.cursor_ + i) % numTiles;
+
+        if ( client.hashes_[tile] == tileHashes_[tile] )
+        {
+            continue;
+        }
+
+        const PODVector<unsigned char> &encoded = EncodeTile(tile);
+        unsigned bytes = encoded.Size() + 4;
+
+        // out of budget, resume from this tile next time. a tile larger than
+        // the whole burst still goes out once the bucket is full
+        if ( (float)bytes > client.budget_ && client.budget_ < burst )
+        {
+            client.cursor_ = tile;
+            break;
+        }
+
+        if ( records.GetSize() + bytes > FRAMENET_MAX_MESSAGE )
+        {
+            FlushTiles(client, records, count);
+            count = 0;
+        }
+
+        records.WriteVLE(tile);
+        records.Write(&encoded[0], encoded.Size());
+        client.hashes_[tile] = tileHashes_[tile];
+        client.budget_ -= (float)bytes;
+        ++count;
+    }
+
+    FlushTiles(client, records, count);
+}
+
+void UFrameNetServer::FlushTiles(ClientState &client, VectorBuffer &records, unsigned count)
+{
+    if ( count == 0 )
+    {
+        return;
+    }
+
+    VectorBuffer msg;
+    msg.WriteUInt(frame_->GetFrameNumber());
+    msg.WriteVLE(count);
+    msg.Write(records.GetData(), records.GetSize());
+    client.connection_->SendMessage(FRAMENET_MSG_TILES, true, true, msg);
+
+    client.bytesSent_ += msg.GetSize();
+    bytesSent_ += msg.GetSize();
+    tilesSent_ += count;
+
+    records.Clear();
+}
+
+void UFrameNetServer::HandleClientDisconnected(StringHash eventType, VariantMap& eventData)
+{
+    using namespace ClientDisconnected;
+
+    Connection *connection = static_cast<Connection*>(eventData[P_CONNECTION].GetPtr());
+
+    for ( unsigned i = 0; i < clients_.Size(); ++i )
+    {
+        if ( clients_[i].connection_ == connection )
+        {
+            SDL_Log("UFrameNetServer: client left, sent %u KB", clients_[i].bytesSent_/1024);
+            clients_.Erase(i);
+            break;
+        }
+    }
+}
+
+void UFrameNetServer::HandleNetworkMessage(StringHash eventType, VariantMap& eventData)
+{
+    using namespace NetworkMessage;
+
+    if ( eventData[P_MESSAGEID].GetInt() != FRAMENET_MSG_HELLO )
+    {
+        return;
+    }
+
+    Connection *connection = static_cast<Connection*>(eventData[P_CONNECTION].GetPtr());
+
+    // only from our own clients, not from a server we're connected to
+    if ( connection == GetSubsystem<Network>()->GetServerConnection() )
+    {
+        return;
+    }
+
+    for ( unsigned i = 0; i < clients_.Size(); ++i )
+    {
+        if ( clients_[i].connection_ == connection )
+        {
+            return;
+        }
+    }
+
+    const PODVector<unsigned char> &data = eventData[P_DATA].GetBuffer();
+    MemoryBuffer msg(data);
+    unsigned rate = msg.ReadUInt();
+
+    ClientState client;
+    client.connection_ = connection;
+    client.rate_ = ( rate && rate < clientRate_ ) ? rate : clientRate_;
+    client.budget_ = 0.0f;
+    client.cursor_ = 0;
+    client.bytesSent_ = 0;
+
+    clients_.Push(client);
+    SendSurface(clients_.Back());
+
+    SDL_Log("UFrameNetServer: client joined, %u KB/s", client.rate_/1024);
+}
+
+void UFrameNetServer::HandleNetworkUpdate(StringHash eventType, VariantMap& eventData)
+{
+    float elapsed = (float)sendTimer_.GetMSec(true)/1000.0f;
+
+    for ( unsigned i = 0; i < clients_.Size(); ++i )
+    {
+        SendTiles(clients_[i], elapsed);
+    }
+}
@@ -0,0 +1,116 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/Rect.h>
+
+#include "UFrameSink.h"
+#include "UFrameNet.h"
+
+namespace Urho3D
+{
+class Connection;
+class VectorBuffer;
+}
+
+using namespace Urho3D;
+
+//=============================================================================
+// Frame sink that replicates the browser surface to networked clients as
+// tile deltas. Tiles are hashed once per frame and encoded once per change,
+// then shared by every client that needs them. Each client gets a token
+// bucket of bytes/sec, tiles that don't fit wait for the next network update.
+//=============================================================================
+class UFrameNetServer : public Object, public UFrameSink
+{
+    URHO3D_OBJECT(UFrameNetServer, Object);
+public:
+
+    UFrameNetServer(Context *context);
+    virtual ~UFrameNetServer();
+
+    // starts the network server unless one is already running
+    bool Start(unsigned short port);
+    void Stop();
+
+    // cap per client, a client can ask for less in its hello
+    void SetClientRate(unsigned bytesPerSec)    { clientRate_ = bytesPerSec; }
+    unsigned GetClientRate() const              { return clientRate_; }
+
+    virtual void OnFrame(UBrowserFrame *frame);
+
+    unsigned GetNumClients() const              { return clients_.Size(); }
+    unsigned GetBytesSent() const               { return bytesSent_; }
+    unsigned GetTilesSent() const               { return tilesSent_; }
+
+protected:
+    struct ClientState
+    {
+        SharedPtr<Connection> connection_;
+        PODVector<unsigned>   hashes_;          // what the client holds, 0 = nothing
+        unsigned              rate_;
+        float                 budget_;
+        unsigned              cursor_;          // first tile to check, round robin
+        unsigned              bytesSent_;
+    };
+
+    void HandleClientDisconnected(StringHash eventType, VariantMap& eventData);
+    void HandleNetworkMessage(StringHash eventType, VariantMap& eventData);
+    void HandleNetworkUpdate(StringHash eventType, VariantMap& eventData);
+
+    void SetSurface(int width, int height, unsigned components);
+    void SendSurface(ClientState &client);
+    void SendTiles(ClientState &client, float elapsed);
+    void FlushTiles(ClientState &client, VectorBuffer &msg, unsigned count);
+
+    void HashTiles(int top, int bottom);
+    const PODVector<unsigned char>& EncodeTile(unsigned tile);
+    IntRect GetTileRect(unsigned tile) const;
+
+protected:
+    CefRefPtr<UBrowserFrame>            frame_;
+    Vector<ClientState>                 clients_;
+    unsigned                            clientRate_;
+    bool                                startedServer_;
+    Timer                               sendTimer_;
+
+    // surface
+    int                                 width_;
+    int                                 height_;
+    unsigned                            components_;
+    int                                 tilesX_;
+    int                                 tilesY_;
+
+    // per tile hash of the latest frame and the encoding of that hash
+    PODVector<unsigned>                 tileHashes_;
+    PODVector<unsigned>                 encodedHashes_;
+    Vector<PODVector<unsigned char> >   encodedTiles_;
+    PODVector<unsigned char>            tileBuffer_;
+
+    // stats
+    unsigned                            bytesSent_;
+    unsigned                            tilesSent_;
+};
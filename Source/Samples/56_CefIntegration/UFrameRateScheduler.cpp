@@ -0,0 +1,242 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Urho3D.h>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <SDL/SDL_log.h>
+
+#include "UFrameRateScheduler.h"
+#include "UBrowserImage.h"
+
+#include <Urho3D/DebugNew.h>
+
+//=============================================================================
+//=============================================================================
+static const char* frameRateRoleNames[] =
+{
+    "focused",
+    "video",
+    "passive",
+    "background"
+};
+
+//=============================================================================
+//=============================================================================
+UFrameRateScheduler::UFrameRateScheduler(Context *context)
+    : Object(context)
+    , loadFPS_(FRAMERATE_LOAD_FPS)
+    , engineLoaded_(false)
+    , engineFPS_(0.0f)
+    , loadTime_(0.0f)
+    , loadFrames_(0)
+    , logDecisions_(true)
+    , checkInteractive_(false)
+{
+    roleFrameRates_[FRR_FOCUSED]    = FRAMERATE_FOCUSED;
+    roleFrameRates_[FRR_VIDEO]      = FRAMERATE_VIDEO;
+    roleFrameRates_[FRR_PASSIVE]    = FRAMERATE_PASSIVE;
+    roleFrameRates_[FRR_BACKGROUND] = FRAMERATE_BACKGROUND;
+
+    SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(UFrameRateScheduler, HandleUpdate));
+}
+
+UFrameRateScheduler::~UFrameRateScheduler()
+{
+    browsers_.Clear();
+}
+
+void UFrameRateScheduler::Add(UBrowserImage *browserImage)
+{
+    BrowserEntry entry;
+    entry.browserImage_ = browserImage;
+    entry.animatedWindows_ = 0;
+
+    browsers_.Push(entry);
+}
+
+void UFrameRateScheduler::Remove(UBrowserImage *browserImage)
+{
+    for ( unsigned i = 0; i < browsers_.Size(); ++i )
+    {
+        if ( browsers_[i].browserImage_ == browserImage )
+        {
+            browsers_.Erase(i--);
+        }
+    }
+}
+
+void UFrameRateScheduler::SetRoleFrameRate(FrameRateRole role, int frameRate)
+{
+    if ( role < MAX_FRAMERATE_ROLES )
+    {
+        roleFrameRates_[role] = Max(frameRate, 1);
+    }
+}
+
+int UFrameRateScheduler::GetRoleFrameRate(FrameRateRole role) const
+{
+    return role < MAX_FRAMERATE_ROLES ? roleFrameRates_[role] : 0;
+}
+
+const char* UFrameRateScheduler::GetRoleName(FrameRateRole role)
+{
+    return role < MAX_FRAMERATE_ROLES ? frameRateRoleNames[role] : "";
+}
+
+void UFrameRateScheduler::HandleUpdate(StringHash eventType, VariantMap& eventData)
+{
+    using namespace Update;
+
+    UpdateEngineLoad(eventData[P_TIMESTEP].GetFloat());
+
+    if ( paintTimer_.GetMSec(false) >= FRAMERATE_PAINT_UPDATE_MS )
+    {
+        UpdatePaintRates();
+    }
+
+    // roles are cheap to evaluate, focus and visibility changes are picked up on the next frame
+    for ( unsigned i = 0; i < browsers_.Size(); ++i )
+    {
+        UBrowserImage *browserImage = browsers_[i].browserImage_;
+
+        if ( browserImage == NULL )
+        {
+            browsers_.Erase(i--);
+            continue;
+        }
+
+        if ( checkInteractive_ && browserImage->IsVisible() && !browserImage->IsHibernated() )
+        {
+            CheckInteractiveRole(browsers_[i]);
+        }
+
+        FrameRateRole role = GetRole(browsers_[i]);
+        int frameRate = roleFrameRates_[role];
+
+        if ( browserImage->GetVideoFrameRate() > 0 && role == FRR_VIDEO )
+        {
+            frameRate = browserImage->GetVideoFrameRate();
+        }
+
+        if ( engineLoaded_ && ( role == FRR_PASSIVE || role == FRR_BACKGROUND ) )
+        {
+            frameRate = Max(frameRate / 2, 1);
+        }
+
+        if ( logDecisions_ && ( role != browserImage->GetFrameRateRole() || frameRate != browserImage->GetFrameRate() ) )
+        {
+            SDL_Log("framerate: %s role=%s rate=%d paints=%u loaded=%d", 
+                    browserImage->GetName().CString(), GetRoleName(role), frameRate, 
+                    browserImage->GetPaintRate(), engineLoaded_ ? 1 : 0);
+        }
+
+        browserImage->ApplyFrameRate(role, frameRate);
+    }
+}
+
+void UFrameRateScheduler::UpdateEngineLoad(float timeStep)
+{
+    loadTime_ += timeStep;
+    ++loadFrames_;
+
+    if ( loadTime_ * 1000.0f < FRAMERATE_LOAD_UPDATE_MS )
+    {
+        return;
+    }
+
+    engineFPS_ = (float)loadFrames_ / loadTime_;
+    engineLoaded_ = ( loadFPS_ > 0 && engineFPS_ < (float)loadFPS_ );
+
+    loadTime_ = 0.0f;
+    loadFrames_ = 0;
+}
+
+void UFrameRateScheduler::UpdatePaintRates()
+{
+    unsigned msec = paintTimer_.GetMSec(true);
+
+    for ( unsigned i = 0; i < browsers_.Size(); ++i )
+    {
+        UBrowserImage *browserImage = browsers_[i].browserImage_;
+
+        if ( browserImage == NULL )
+        {
+            continue;
+        }
+
+        browserImage->UpdatePaintRate(msec);
+
+        // a page painting at its full assigned rate for a while is treated as video
+        int frameRate = browserImage->GetFrameRate();
+
+        if ( frameRate > 1 && browserImage->GetPaintRate() * 10 >= (unsigned)frameRate * 8 )
+        {
+            ++browsers_[i].animatedWindows_;
+        }
+        else
+        {
+            browsers_[i].animatedWindows_ = 0;
+        }
+    }
+}
+
+FrameRateRole UFrameRateScheduler::GetRole(const BrowserEntry &entry) const
+{
+    UBrowserImage *browserImage = entry.browserImage_;
+
+    if ( !browserImage->IsVisible() || browserImage->IsHibernated() )
+    {
+        return FRR_BACKGROUND;
+    }
+
+    if ( browserImage->IsInteractive() )
+    {
+        return FRR_FOCUSED;
+    }
+
+    if ( browserImage->GetVideoFrameRate() > 0 || entry.animatedWindows_ >= FRAMERATE_ANIMATED_WINDOWS )
+    {
+        return FRR_VIDEO;
+    }
+
+    return FRR_PASSIVE;
+}
+
+bool UFrameRateScheduler::CheckInteractiveRole(const BrowserEntry &entry)
+{
+    UBrowserImage *browserImage = entry.browserImage_;
+
+    // the same call the mouse and key handlers make
+    browserImage->NotifyInput();
+
+    FrameRateRole role = GetRole(entry);
+    bool ok = ( role == FRR_FOCUSED );
+
+    SDL_Log("framerate check: %s after input role=%s, %s",
+            browserImage->GetName().CString(), GetRoleName(role), ok ? "ok" : "FAILED");
+
+    checkInteractive_ = false;
+
+    return ok;
+}
+
@@ -0,0 +1,105 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Container/Ptr.h>
+
+#include "UBrowserImage.h"
+
+using namespace Urho3D;
+
+//=============================================================================
+//=============================================================================
+#define FRAMERATE_FOCUSED           60
+#define FRAMERATE_VIDEO             30
+#define FRAMERATE_PASSIVE           15
+#define FRAMERATE_BACKGROUND        1
+#define FRAMERATE_LOAD_FPS          30
+#define FRAMERATE_LOAD_UPDATE_MS    500
+#define FRAMERATE_PAINT_UPDATE_MS   1000
+#define FRAMERATE_ANIMATED_WINDOWS  2
+
+//=============================================================================
+// Assigns each browser's windowless frame rate from its role: interactive
+// (focused or recent input), visible video, visible passive or hidden. The roles are re-evaluated every
+// frame and a rate is only sent to cef when it changes. While the engine runs
+// below the load fps, the passive and background rates are halved.
+//=============================================================================
+class UFrameRateScheduler : public Object
+{
+    URHO3D_OBJECT(UFrameRateScheduler, Object);
+public:
+
+    UFrameRateScheduler(Context *context);
+    virtual ~UFrameRateScheduler();
+
+    void Add(UBrowserImage *browserImage);
+    void Remove(UBrowserImage *browserImage);
+
+    void SetRoleFrameRate(FrameRateRole role, int frameRate);
+    int GetRoleFrameRate(FrameRateRole role) const;
+
+    // engine fps under which the engine is considered loaded, 0 disables it
+    void SetLoadFPS(int fps)            { loadFPS_ = fps; }
+    int GetLoadFPS() const              { return loadFPS_; }
+    bool IsEngineLoaded() const         { return engineLoaded_; }
+    float GetEngineFPS() const          { return engineFPS_; }
+
+    // decisions for tuning
+    static const char* GetRoleName(FrameRateRole role);
+    void SetLogDecisions(bool log)      { logDecisions_ = log; }
+
+    // once the first browser shows, feeds it input and checks that it gets the focused role
+    void EnableInteractiveCheck()       { checkInteractive_ = true; }
+
+protected:
+    void HandleUpdate(StringHash eventType, VariantMap& eventData);
+    void UpdateEngineLoad(float timeStep);
+    void UpdatePaintRates();
+
+protected:
+    struct BrowserEntry
+    {
+        WeakPtr<UBrowserImage> browserImage_;
+        unsigned animatedWindows_;
+    };
+
+    FrameRateRole GetRole(const BrowserEntry &entry) const;
+    bool CheckInteractiveRole(const BrowserEntry &entry);
+
+    Vector<BrowserEntry> browsers_;
+    int roleFrameRates_[MAX_FRAMERATE_ROLES];
+
+    int   loadFPS_;
+    bool  engineLoaded_;
+    float engineFPS_;
+    float loadTime_;
+    int   loadFrames_;
+
+    Timer paintTimer_;
+    bool  logDecisions_;
+    bool  checkInteractive_;
+};
+
@@ -0,0 +1,84 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+//=============================================================================
+// Shared memory layout of exported browser frames. Kept free of engine types
+// so that external readers (see FrameReader/) only need this header.
+//
+// The producer never waits on readers. Each slot is guarded by a sequence
+// number that is odd while the slot is written; a reader checks it before and
+// after using the pixels in place and drops the frame if it changed. A reader
+// that's too slow only skips frames, seen as gaps in frameNumber_.
+//=============================================================================
+#define FRAMESHM_MAGIC          0x314d5246  // 'FRM1'
+#define FRAMESHM_VERSION        1
+#define FRAMESHM_SLOTS          3
+#define FRAMESHM_MAX_DIRTY      8
+#define FRAMESHM_CHECKSUM_STEP  64          // every n-th pixel goes into the checksum
+
+#include <atomic>
+
+#define FRAMESHM_BARRIER()      std::atomic_thread_fence(std::memory_order_seq_cst)
+
+struct FrameShmSlot
+{
+    volatile unsigned sequence_;
+    unsigned frameNumber_;
+    int      width_;
+    int      height_;
+    unsigned rowBytes_;
+    unsigned checksum_;
+
+    // dirty rects since the previous frame, left, top, right, bottom
+    unsigned numDirty_;
+    int      dirty_[FRAMESHM_MAX_DIRTY][4];
+};
+
+struct FrameShmHeader
+{
+    unsigned magic_;
+    unsigned version_;
+    unsigned numSlots_;
+    unsigned headerBytes_;          // pixels of slot i start at headerBytes_ + i*slotBytes_
+    unsigned slotBytes_;
+    volatile unsigned latestSlot_;
+    volatile unsigned published_;   // frames published, 0 before the first one
+    FrameShmSlot slots_[FRAMESHM_SLOTS];
+};
+
+// sparse checksum of a slot's pixels, to catch tearing the sequence check would miss
+inline unsigned FrameShmChecksum(const unsigned char *pixels, unsigned size)
+{
+    const unsigned *words = (const unsigned*)pixels;
+    unsigned numWords = size / 4;
+    unsigned sum = 0;
+
+    for ( unsigned i = 0; i < numWords; i += FRAMESHM_CHECKSUM_STEP )
+    {
+        sum = (sum << 5) + sum + words[i];
+    }
+
+    return sum;
+}
+
@@ -0,0 +1,227 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Urho3D.h>
+#include <Urho3D/Math/MathDefs.h>
+#include <SDL/SDL_log.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <string.h>
+
+#include "UFrameShmSink.h"
+
+#include <Urho3D/DebugNew.h>
+
+//=============================================================================
+//=============================================================================
+UFrameShmSink::UFrameShmSink()
+    : header_(NULL)
+    , pixels_(NULL)
+    , mapBytes_(0)
+    , dropped_(0)
+    , mapping_(NULL)
+    , fd_(-1)
+{
+}
+
+UFrameShmSink::~UFrameShmSink()
+{
+    Close();
+}
+
+bool UFrameShmSink::Open(const String &name, int maxWidth, int maxHeight, unsigned components)
+{
+    Close();
+
+    unsigned headerBytes = (sizeof(FrameShmHeader) + 63) & ~63U;
+    unsigned slotBytes = maxWidth*maxHeight*components;
+    mapBytes_ = headerBytes + slotBytes*FRAMESHM_SLOTS;
+
+    void *mem = NULL;
+
+    #if defined(_WIN32)
+    name_ = "Local\\" + name;
+    mapping_ = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, mapBytes_, name_.CString());
+
+    if ( mapping_ )
+    {
+        mem = MapViewOfFile((HANDLE)mapping_, FILE_MAP_ALL_ACCESS, 0, 0, mapBytes_);
+    }
+    #else
+    name_ = "/" + name;
+    fd_ = shm_open(name_.CString(), O_CREAT | O_RDWR, 0600);
+
+    if ( fd_ >= 0 && ftruncate(fd_, mapBytes_) == 0 )
+    {
+        mem = mmap(NULL, mapBytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+
+        if ( mem == MAP_FAILED )
+        {
+            mem = NULL;
+        }
+    }
+    #endif
+
+    if ( mem == NULL )
+    {
+        SDL_Log("frame export: failed to map %s", name_.CString());
+        Close();
+        return false;
+    }
+
+    // readers check the magic last, so it's written after the rest of the header
+    header_ = (FrameShmHeader*)mem;
+    memset(header_, 0, headerBytes);
+    header_->version_ = FRAMESHM_VERSION;
+    header_->numSlots_ = FRAMESHM_SLOTS;
+    header_->headerBytes_ = headerBytes;
+    header_->slotBytes_ = slotBytes;
+    FRAMESHM_BARRIER();
+    header_->magic_ = FRAMESHM_MAGIC;
+
+    pixels_ = (unsigned char*)mem + headerBytes;
+
+    for ( unsigned i = 0; i < FRAMESHM_SLOTS; ++i )
+    {
+        slotDirty_[i] = IntVector2::ZERO;
+    }
+
+    SDL_Log("frame export: %s, %u bytes", name_.CString(), mapBytes_);
+
+    return true;
+}
+
+void UFrameShmSink::Close()
+{
+    #if defined(_WIN32)
+    if ( header_ )
+    {
+        UnmapViewOfFile(header_);
+    }
+    if ( mapping_ )
+    {
+        CloseHandle((HANDLE)mapping_);
+    }
+    #else
+    if ( header_ )
+    {
+        munmap(header_, mapBytes_);
+    }
+    if ( fd_ >= 0 )
+    {
+        close(fd_);
+        shm_unlink(name_.CString());
+    }
+    #endif
+
+    header_ = NULL;
+    pixels_ = NULL;
+    mapping_ = NULL;
+    fd_ = -1;
+}
+
+void UFrameShmSink::AddDirtyRows(unsigned slot, int top, int bottom)
+{
+    IntVector2 &dirty = slotDirty_[slot];
+
+    if ( dirty.x_ >= dirty.y_ )
+    {
+        dirty = IntVector2(top, bottom);
+    }
+    else
+    {
+        dirty.x_ = Min(dirty.x_, top);
+        dirty.y_ = Max(dirty.y_, bottom);
+    }
+}
+
+void UFrameShmSink::OnFrame(UBrowserFrame *frame)
+{
+    if ( header_ == NULL )
+    {
+        return;
+    }
+
+    if ( frame->GetDataSize() > header_->slotBytes_ )
+    {
+        ++dropped_;
+        return;
+    }
+
+    const IntVector2 &rows = frame->GetDirtyRows();
+
+    for ( unsigned i = 0; i < FRAMESHM_SLOTS; ++i )
+    {
+        AddDirtyRows(i, rows.x_, rows.y_);
+    }
+
+    unsigned index = (header_->latestSlot_ + 1) % FRAMESHM_SLOTS;
+    FrameShmSlot &slot = header_->slots_[index];
+    unsigned char *pixels = pixels_ + index*header_->slotBytes_;
+
+    // a slot last written with another size is refreshed in full
+    if ( slot.width_ != frame->GetWidth() || slot.height_ != frame->GetHeight() )
+    {
+        slotDirty_[index] = IntVector2(0, frame->GetHeight());
+    }
+
+    // odd while writing
+    ++slot.sequence_;
+    FRAMESHM_BARRIER();
+
+    IntVector2 &dirty = slotDirty_[index];
+
+    if ( dirty.x_ < dirty.y_ )
+    {
+        unsigned rowBytes = frame->GetRowBytes();
+        memcpy(pixels + dirty.x_*rowBytes, frame->GetRow(dirty.x_), (dirty.y_ - dirty.x_)*rowBytes);
+    }
+
+    slot.frameNumber_ = frame->GetFrameNumber();
+    slot.width_ = frame->GetWidth();
+    slot.height_ = frame->GetHeight();
+    slot.rowBytes_ = frame->GetRowBytes();
+    slot.numDirty_ = ( rows.x_ < rows.y_ ) ? 1 : 0;
+    slot.dirty_[0][0] = 0;
+    slot.dirty_[0][1] = rows.x_;
+    slot.dirty_[0][2] = frame->GetWidth();
+    slot.dirty_[0][3] = rows.y_;
+    slot.checksum_ = FrameShmChecksum(pixels, frame->GetDataSize());
+
+    dirty = IntVector2::ZERO;
+
+    FRAMESHM_BARRIER();
+    ++slot.sequence_;
+
+    // publish
+    header_->latestSlot_ = index;
+    FRAMESHM_BARRIER();
+    ++header_->published_;
+}
+
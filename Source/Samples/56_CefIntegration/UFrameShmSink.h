@@ -0,0 +1,71 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Container/Str.h>
+#include <Urho3D/Container/Vector.h>
+
+#include "UFrameSink.h"
+#include "UFrameShm.h"
+
+using namespace Urho3D;
+
+//=============================================================================
+// Frame sink that publishes frames into a shared memory ring for external
+// local processes (spectator encoders, visual tests, overlays). Each slot
+// only receives the rows that changed since that slot was last written.
+//=============================================================================
+class UFrameShmSink : public UFrameSink
+{
+public:
+
+    UFrameShmSink();
+    virtual ~UFrameShmSink();
+
+    // maps "Local\name" on windows, "/name" elsewhere, sized for frames up to maxWidth x maxHeight
+    bool Open(const String &name, int maxWidth, int maxHeight, unsigned components);
+    void Close();
+    bool IsOpen() const                 { return header_ != NULL; }
+
+    virtual void OnFrame(UBrowserFrame *frame);
+
+    // frames too large for a slot are dropped
+    unsigned GetPublished() const       { return header_ ? header_->published_ : 0; }
+    unsigned GetDropped() const         { return dropped_; }
+
+protected:
+    void AddDirtyRows(unsigned slot, int top, int bottom);
+
+protected:
+    String          name_;
+    FrameShmHeader  *header_;
+    unsigned char   *pixels_;
+    unsigned        mapBytes_;
+    unsigned        dropped_;
+    IntVector2      slotDirty_[FRAMESHM_SLOTS];
+
+    // file mapping handle on windows, shm descriptor elsewhere
+    void            *mapping_;
+    int             fd_;
+};
+
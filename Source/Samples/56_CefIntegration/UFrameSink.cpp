@@ -0,0 +1,60 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Urho3D.h>
+
+#include "UFrameSink.h"
+
+#include <Urho3D/DebugNew.h>
+
+//=============================================================================
+//=============================================================================
+Mutex    UBrowserFrame::residentMutex_;
+unsigned UBrowserFrame::residentBytes_ = 0;
+
+UBrowserFrame::UBrowserFrame(int width, int height, unsigned components)
+    : width_(width)
+    , height_(height)
+    , components_(components)
+    , frameNumber_(0)
+{
+    data_ = new unsigned char[GetDataSize()];
+
+    MutexLock lock(residentMutex_);
+    residentBytes_ += GetDataSize();
+}
+
+UBrowserFrame::~UBrowserFrame()
+{
+    delete [] data_;
+    data_ = NULL;
+
+    MutexLock lock(residentMutex_);
+    residentBytes_ -= GetDataSize();
+}
+
+unsigned UBrowserFrame::GetResidentBytes()
+{
+    MutexLock lock(residentMutex_);
+    return residentBytes_;
+}
+
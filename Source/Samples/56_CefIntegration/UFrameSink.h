@@ -0,0 +1,131 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Math/Vector2.h>
+
+#include <cef_base.h>
+
+using namespace Urho3D;
+
+//=============================================================================
+// Immutable browser frame shared by all frame sinks. The render handler only
+// writes into a frame while it holds the sole reference, once published it's
+// read only and is freed with the last consumer's reference. The ref count is
+// cef's thread-safe one so sinks can hand frames to worker threads.
+//=============================================================================
+class UBrowserFrame : public virtual CefBase
+{
+    IMPLEMENT_REFCOUNTING(UBrowserFrame);
+    friend class UCefRenderHandle;
+public:
+
+    UBrowserFrame(int width, int height, unsigned components);
+    virtual ~UBrowserFrame();
+
+    const unsigned char* GetData() const        { return data_; }
+    const unsigned char* GetRow(int row) const  { return data_ + row*GetRowBytes(); }
+    int GetWidth() const                        { return width_; }
+    int GetHeight() const                       { return height_; }
+    unsigned GetComponents() const              { return components_; }
+    unsigned GetRowBytes() const                { return width_*components_; }
+    unsigned GetDataSize() const                { return width_*height_*components_; }
+
+    // rows painted since the previously published frame, every row is valid
+    const IntVector2& GetDirtyRows() const      { return dirtyRows_; }
+    unsigned GetFrameNumber() const             { return frameNumber_; }
+
+    // memory held by all frames alive
+    static unsigned GetResidentBytes();
+
+protected:
+    unsigned char   *data_;
+    int             width_;
+    int             height_;
+    unsigned        components_;
+    IntVector2      dirtyRows_;
+    unsigned        frameNumber_;
+
+    static Mutex    residentMutex_;
+    static unsigned residentBytes_;
+};
+
+//=============================================================================
+// Consumer of browser frames - ui texture, material, recorder, streamer.
+// OnFrame() is called on the main thread for every published frame in order,
+// keep a CefRefPtr to the frame for as long as its pixels are needed.
+//=============================================================================
+class UFrameSink
+{
+public:
+    virtual ~UFrameSink() {}
+
+    virtual void OnFrame(UBrowserFrame *frame) = 0;
+};
+
+//=============================================================================
+// Counts frames and dirty bytes, optionally keeping the last frame
+//=============================================================================
+class UNullFrameSink : public UFrameSink
+{
+public:
+
+    UNullFrameSink(bool keepLastFrame = false)
+        : keepLastFrame_(keepLastFrame)
+        , numFrames_(0)
+        , dirtyBytes_(0)
+    {
+    }
+
+    virtual void OnFrame(UBrowserFrame *frame)
+    {
+        const IntVector2 &rows = frame->GetDirtyRows();
+
+        ++numFrames_;
+        dirtyBytes_ += ( rows.y_ > rows.x_ ) ? (rows.y_ - rows.x_)*frame->GetRowBytes() : 0;
+
+        if ( keepLastFrame_ )
+        {
+            lastFrame_ = frame;
+        }
+    }
+
+    void Reset()
+    {
+        numFrames_ = 0;
+        dirtyBytes_ = 0;
+        lastFrame_ = NULL;
+    }
+
+    unsigned GetNumFrames() const               { return numFrames_; }
+    unsigned GetDirtyBytes() const              { return dirtyBytes_; }
+    CefRefPtr<UBrowserFrame> GetLastFrame() const { return lastFrame_; }
+
+protected:
+    bool                        keepLastFrame_;
+    unsigned                    numFrames_;
+    unsigned                    dirtyBytes_;
+    CefRefPtr<UBrowserFrame>    lastFrame_;
+};
+
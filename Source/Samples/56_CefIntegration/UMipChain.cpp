@@ -0,0 +1,183 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Urho3D.h>
+#include <Urho3D/Graphics/Texture2D.h>
+#include <Urho3D/Math/MathDefs.h>
+
+#ifdef URHO3D_SSE
+#include <emmintrin.h>
+#endif
+
+#include "UMipChain.h"
+
+#include <Urho3D/DebugNew.h>
+
+//=============================================================================
+//=============================================================================
+#define MIPCHAIN_COMPONENTS     4
+
+//=============================================================================
+//=============================================================================
+UMipChain::UMipChain()
+{
+}
+
+UMipChain::~UMipChain()
+{
+}
+
+void UMipChain::SetSize(int width, int height)
+{
+    levelSize_.Clear();
+    levelData_.Clear();
+
+    if ( width <= 0 || height <= 0 )
+    {
+        return;
+    }
+
+    levelSize_.Push(IntVector2(width, height));
+
+    // level 0 data isn't kept, levelData_[0] is level 1
+    while ( width > 1 || height > 1 )
+    {
+        width = Max(width >> 1, 1);
+        height = Max(height >> 1, 1);
+
+        levelSize_.Push(IntVector2(width, height));
+        levelData_.Push(PODVector<unsigned char>());
+        levelData_.Back().Resize(width*height*MIPCHAIN_COMPONENTS);
+    }
+}
+
+IntVector2 UMipChain::GetLevelSize(unsigned level) const
+{
+    return level < levelSize_.Size() ? levelSize_[level] : IntVector2::ZERO;
+}
+
+const unsigned char* UMipChain::GetLevelData(unsigned level) const
+{
+    return ( level > 0 && level < levelSize_.Size() ) ? &levelData_[level - 1][0] : NULL;
+}
+
+IntVector2 UMipChain::GetLevelRows(unsigned level, int top, int bottom) const
+{
+    // texel row r of a level covers level 0 rows [r << level, (r + 1) << level)
+    int levelTop = top >> level;
+    int levelBottom = (bottom + (1 << level) - 1) >> level;
+
+    return IntVector2(Clamp(levelTop, 0, levelSize_[level].y_), Clamp(levelBottom, 0, levelSize_[level].y_));
+}
+
+void UMipChain::Downsample(unsigned level, const unsigned char *src, int top, int bottom)
+{
+    if ( level == 0 || level >= levelSize_.Size() )
+    {
+        return;
+    }
+
+    const IntVector2 &srcSize = levelSize_[level - 1];
+    const IntVector2 &dstSize = levelSize_[level];
+    unsigned srcStride = srcSize.x_*MIPCHAIN_COMPONENTS;
+    unsigned dstStride = dstSize.x_*MIPCHAIN_COMPONENTS;
+    unsigned char *dst = &levelData_[level - 1][0];
+
+    int dstTop = Clamp(top >> 1, 0, dstSize.y_);
+    int dstBottom = Clamp((bottom + 1) >> 1, 0, dstSize.y_);
+
+    for ( int y = dstTop; y < dstBottom; ++y )
+    {
+        const unsigned char *row0 = src + (y*2)*srcStride;
+        const unsigned char *row1 = ( srcSize.y_ > 1 ) ? row0 + srcStride : row0;
+
+        DownsampleRow(row0, row1, dst + y*dstStride, srcSize.x_, dstSize.x_);
+    }
+}
+
+void UMipChain::DownsampleLevels(int top, int bottom)
+{
+    for ( unsigned level = 2; level < levelSize_.Size(); ++level )
+    {
+        IntVector2 rows = GetLevelRows(level - 1, top, bottom);
+        Downsample(level, &levelData_[level - 2][0], rows.x_, rows.y_);
+    }
+}
+
+void UMipChain::DownsampleRow(const unsigned char *row0, const unsigned char *row1, 
+                              unsigned char *dst, int srcWidth, int dstWidth)
+{
+    int x = 0;
+
+    #ifdef URHO3D_SSE
+    // 4 source texels per row -> 2 texels, rounding averages of the rows then of the pairs
+    for ( ; x + 2 <= dstWidth && srcWidth > 1; x += 2 )
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(row0 + x*8));
+        __m128i b = _mm_loadu_si128((const __m128i*)(row1 + x*8));
+        __m128i v = _mm_avg_epu8(a, b);
+        __m128i even = _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128i odd = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 1, 3, 1));
+
+        _mm_storel_epi64((__m128i*)(dst + x*4), _mm_avg_epu8(even, odd));
+    }
+    #endif
+
+    // a 1 texel wide source is filtered vertically only
+    int next = ( srcWidth > 1 ) ? MIPCHAIN_COMPONENTS : 0;
+
+    for ( ; x < dstWidth; ++x )
+    {
+        const unsigned char *s0 = row0 + x*2*MIPCHAIN_COMPONENTS;
+        const unsigned char *s1 = row1 + x*2*MIPCHAIN_COMPONENTS;
+
+        for ( int c = 0; c < MIPCHAIN_COMPONENTS; ++c )
+        {
+            dst[x*MIPCHAIN_COMPONENTS + c] = (unsigned char)((s0[c] + s0[c + next] + s1[c] + s1[c + next] + 2) >> 2);
+        }
+    }
+}
+
+unsigned UMipChain::Upload(Texture2D *texture, int top, int bottom) const
+{
+    unsigned bytes = 0;
+    unsigned numLevels = Min(levelSize_.Size(), texture->GetLevels());
+
+    for ( unsigned level = 1; level < numLevels; ++level )
+    {
+        IntVector2 rows = GetLevelRows(level, top, bottom);
+
+        if ( rows.x_ >= rows.y_ )
+        {
+            continue;
+        }
+
+        const IntVector2 &size = levelSize_[level];
+        unsigned stride = size.x_*MIPCHAIN_COMPONENTS;
+
+        texture->SetData(level, 0, rows.x_, size.x_, rows.y_ - rows.x_, &levelData_[level - 1][rows.x_*stride]);
+        bytes += (rows.y_ - rows.x_)*stride;
+    }
+
+    return bytes;
+}
+
@@ -0,0 +1,72 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Container/RefCounted.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/Vector2.h>
+
+namespace Urho3D
+{
+class Texture2D;
+}
+
+using namespace Urho3D;
+
+//=============================================================================
+// CPU side mip levels 1..n of a browser texture. Only the rows covered by a
+// paint's dirty rows are re-filtered (2x2 box) and uploaded, level 0 stays in
+// the browser frame.
+//=============================================================================
+class UMipChain : public RefCounted
+{
+public:
+
+    UMipChain();
+    virtual ~UMipChain();
+
+    // level 0 size, levels go down to 1x1
+    void SetSize(int width, int height);
+    unsigned GetNumLevels() const       { return levelSize_.Size(); }
+    IntVector2 GetLevelSize(unsigned level) const;
+    const unsigned char* GetLevelData(unsigned level) const;
+
+    // filters level from level - 1, src rows [top, bottom) are in level - 1 coords
+    void Downsample(unsigned level, const unsigned char *src, int top, int bottom);
+
+    // filters levels 2..n once level 1 is up to date, rows are in level 0 coords
+    void DownsampleLevels(int top, int bottom);
+
+    // uploads the rows of levels 1..n covered by level 0 rows [top, bottom)
+    unsigned Upload(Texture2D *texture, int top, int bottom) const;
+
+protected:
+    IntVector2 GetLevelRows(unsigned level, int top, int bottom) const;
+    static void DownsampleRow(const unsigned char *row0, const unsigned char *row1, 
+                              unsigned char *dst, int srcWidth, int dstWidth);
+
+protected:
+    PODVector<IntVector2>               levelSize_;
+    Vector<PODVector<unsigned char> >   levelData_;
+};
+
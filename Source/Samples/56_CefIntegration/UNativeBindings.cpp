@@ -0,0 +1,186 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Urho3D.h>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <SDL/SDL_log.h>
+
+#include "include/cef_parser.h"
+#include "UNativeBindings.h"
+#include "UCefQueryBridge.h"
+
+#include <Urho3D/DebugNew.h>
+
+//=============================================================================
+//=============================================================================
+#define BENCHMARK_ROUTE     "jsonadd"
+#define BENCHMARK_INFLIGHT  "256"
+
+// no '#' or '%' in the page, it's a plain data url. Both paths are frame locked, native calls
+// run on E_UPDATE and bridge answers go out on E_ENDFRAME, so calls/sec is about the engine
+// fps times the calls in flight. It compares the two paths at the same fps, it isn't the
+// per-call overhead
+static const char *benchmarkPage_ =
+    "data:text/html;charset=utf-8,<html><body style='background:white'><pre id='out'>binding benchmark</pre><script>"
+    "var modes = ['native', 'json'], mode = 0, inflight = 0, done = 0, sent = 0, bad = 0, t0 = Date.now(), lines = [];"
+    "var note = 'both paths answer once per engine frame: calls/sec = fps x " BENCHMARK_INFLIGHT " in flight at most';"
+    "function check(r, n) { if (r !== n + n) ++bad; --inflight; ++done; pump(); }"
+    "function fail() { ++bad; --inflight; pump(); }"
+    "function call(n) {"
+    "  if (modes[mode] == 'native') {"
+    "    urho.add(n, n, function(r) { check(r, n); });"
+    "  } else {"
+    "    window.cefQuery({ request: '" BENCHMARK_ROUTE ":' + JSON.stringify({ a: n, b: n }), persistent: false,"
+    "      onSuccess: function(r) { check(JSON.parse(r).sum, n); },"
+    "      onFailure: function(c, m) { fail(); } });"
+    "  }"
+    "}"
+    "function pump() {"
+    "  while (inflight < " BENCHMARK_INFLIGHT ") {"
+    "    ++inflight; call(++sent);"
+    "  }"
+    "}"
+    "setInterval(function() {"
+    "  var now = Date.now();"
+    "  lines[mode] = modes[mode] + ' calls/sec: ' + Math.round(done*1000/(now - t0)) + ', bad ' + bad;"
+    "  document.getElementById('out').textContent = [note].concat(lines).join('\\n');"
+    "  mode = 1 - mode;"
+    "  done = 0; bad = 0; t0 = now;"
+    "}, 3000);"
+    "pump();"
+    "</script></body></html>";
+
+static int NativeAdd(int a, int b)
+{
+    return a + b;
+}
+
+static NativeVec3 NativeScale(NativeVec3 v, double s)
+{
+    v.x_ *= s;
+    v.y_ *= s;
+    v.z_ *= s;
+    return v;
+}
+
+static std::string NativeEcho(const std::string &text)
+{
+    return text;
+}
+
+void RegisterNativeBindings()
+{
+    NativeBindings *bindings = NativeBindings::GetInstance();
+
+    // once per process
+    if ( bindings->GetCount() )
+    {
+        return;
+    }
+
+    bindings->Add("add", &NativeAdd);
+    bindings->Add("scale", &NativeScale);
+    bindings->Add("echo", &NativeEcho);
+}
+
+//=============================================================================
+//=============================================================================
+UNativeBindings::UNativeBindings(Context *context)
+    : Object(context)
+    , windowCalls_(0)
+    , windowFrames_(0)
+    , callsPerSec_(0)
+    , benchmark_(false)
+{
+    SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(UNativeBindings, HandleUpdate));
+}
+
+UNativeBindings::~UNativeBindings()
+{
+}
+
+void UNativeBindings::HandleUpdate(StringHash eventType, VariantMap& eventData)
+{
+    windowCalls_ += NativeBindings::GetInstance()->RunCalls();
+    ++windowFrames_;
+
+    if ( statsTimer_.GetMSec(false) >= 1000 )
+    {
+        if ( benchmark_ )
+        {
+            // the calls are run once per frame, per frame is what to compare
+            SDL_Log("native calls: %u/s, %.1f per frame", windowCalls_, windowFrames_ ? (float)windowCalls_ / windowFrames_ : 0.0f);
+        }
+
+        callsPerSec_ = windowCalls_;
+        windowCalls_ = 0;
+        windowFrames_ = 0;
+        statsTimer_.Reset();
+    }
+}
+
+void UNativeBindings::EnableBenchmark()
+{
+    UCefQueryBridge *bridge = GetSubsystem<UCefQueryBridge>();
+
+    if ( benchmark_ || bridge == NULL )
+    {
+        return;
+    }
+
+    SubscribeToEvent(bridge->AddRoute(BENCHMARK_ROUTE), URHO3D_HANDLER(UNativeBindings, HandleJsonAdd));
+    bridge->EnableBenchmark();
+    benchmark_ = true;
+}
+
+String UNativeBindings::GetBenchmarkUrl()
+{
+    return String(benchmarkPage_);
+}
+
+void UNativeBindings::HandleJsonAdd(StringHash eventType, VariantMap& eventData)
+{
+    using namespace CefQuery;
+
+    UCefQueryBridge *bridge = GetSubsystem<UCefQueryBridge>();
+    unsigned queryId = eventData[P_QUERYID].GetUInt();
+
+    // what a string protocol costs: parse the arguments, write the result
+    CefRefPtr<CefValue> request = CefParseJSON(eventData[P_REQUEST].GetString().CString(), JSON_PARSER_RFC);
+
+    if ( !request || request->GetType() != VTYPE_DICTIONARY )
+    {
+        bridge->Failure(queryId, -1, "bad json");
+        return;
+    }
+
+    CefRefPtr<CefDictionaryValue> args = request->GetDictionary();
+    CefRefPtr<CefDictionaryValue> result = CefDictionaryValue::Create();
+    result->SetInt("sum", NativeAdd(args->GetInt("a"), args->GetInt("b")));
+
+    CefRefPtr<CefValue> response = CefValue::Create();
+    response->SetDictionary(result);
+
+    bridge->Success(queryId, CefWriteJSON(response, JSON_WRITER_DEFAULT).ToString().c_str());
+}
@@ -0,0 +1,82 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+
+#include "cefsimple/native_bindings.h"
+
+using namespace Urho3D;
+
+//=============================================================================
+// Types and functions bound to window.urho, see cefsimple/native_bindings.h
+//=============================================================================
+struct NativeVec3
+{
+    double x_;
+    double y_;
+    double z_;
+};
+
+template <> struct NativeFields<NativeVec3>
+{
+    template <typename V> static void Visit(V &v, NativeVec3 &s)
+    {
+        v("x", s.x_);
+        v("y", s.y_);
+        v("z", s.z_);
+    }
+};
+
+// registers the functions, both processes call it before CefExecuteProcess()
+void RegisterNativeBindings();
+
+//=============================================================================
+// Runs the calls made from JS on the main thread, once per frame.
+//=============================================================================
+class UNativeBindings : public Object
+{
+    URHO3D_OBJECT(UNativeBindings, Object);
+public:
+    UNativeBindings(Context *context);
+    virtual ~UNativeBindings();
+
+    unsigned GetCallsPerSec() const                 { return callsPerSec_; }
+
+    // a json cefQuery route doing what urho.add() does and a page timing both
+    void EnableBenchmark();
+    static String GetBenchmarkUrl();
+
+protected:
+    void HandleUpdate(StringHash eventType, VariantMap& eventData);
+    void HandleJsonAdd(StringHash eventType, VariantMap& eventData);
+
+protected:
+    unsigned    windowCalls_;
+    unsigned    windowFrames_;
+    unsigned    callsPerSec_;
+    Timer       statsTimer_;
+    bool        benchmark_;
+};
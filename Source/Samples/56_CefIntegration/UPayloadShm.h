@@ -0,0 +1,562 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+//=============================================================================
+// Shared memory side channel for large payloads between the browser and
+// render processes. Kept free of engine and cef types, it's used by both
+// processes and by PayloadBench/.
+//
+// The sending process owns a ring of blocks. A payload is copied into a block
+// once and only its offset, length and serial travel in the process message.
+// The receiver maps the ring by name, reads the payload in place and drops
+// its reference. The writer reclaims blocks in ring order once their count
+// is back to zero. Blocks that will never be released, because the message
+// wasn't sent or its reader went away, are freed by the writer: Cancel() and
+// ReleaseOwner() right away, and any block older than the maximum age when it
+// reaches the tail. A reader that loses its block that way sees Release()
+// fail and drops the payload.
+//
+// The reference word of a block holds the low 24 bits of its serial and the
+// count, so a late release can't touch the block that reused the space.
+//
+// One writer per ring, any number of readers.
+//=============================================================================
+#define PAYLOADSHM_MAGIC        0x31594150  // 'PAY1'
+#define PAYLOADSHM_VERSION      2
+#define PAYLOADSHM_ALIGN        16
+
+// process message carrying a payload, either
+//   topic, text                                    small ones or when the ring is full
+//   topic, ring name, offset, length, serial       in a ring
+#define PAYLOADSHM_MESSAGE      "UrhoPayload"
+#define PAYLOADSHM_MIN_BYTES    (16*1024)   // smaller ones are cheaper inline
+#define PAYLOADSHM_RING_BYTES   (8*1024*1024)
+#define PAYLOADSHM_MAX_AGE_MS   5000        // unreleased blocks are freed after this
+#define PAYLOADSHM_MAX_READERS  0xff
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <deque>
+#include <atomic>
+
+#define PAYLOADSHM_BARRIER()    std::atomic_thread_fence(std::memory_order_seq_cst)
+
+struct PayloadShmHeader
+{
+    unsigned magic_;
+    unsigned version_;
+    unsigned headerBytes_;          // blocks start at headerBytes_
+    unsigned capacity_;             // bytes of blocks
+};
+
+struct PayloadShmBlock
+{
+    volatile int refs_;             // serial tag << 8 | readers yet to release, 0 is free
+    unsigned blockBytes_;           // aligned, header included
+    unsigned length_;               // payload bytes, 0 for the padding before a wrap
+    unsigned serial_;               // checked by readers against the message
+};
+
+// a padding block must fit in the smallest gap
+static_assert(sizeof(PayloadShmBlock) <= PAYLOADSHM_ALIGN, "PayloadShmBlock outgrew PAYLOADSHM_ALIGN");
+
+inline unsigned PayloadShmBlockBytes(unsigned length)
+{
+    unsigned size = (unsigned)sizeof(PayloadShmBlock) + length;
+    return (size + PAYLOADSHM_ALIGN - 1) & ~(unsigned)(PAYLOADSHM_ALIGN - 1);
+}
+
+inline int PayloadShmRefs(unsigned serial, unsigned readers)
+{
+    return (int)(((serial & 0xffffff) << 8) | (readers & PAYLOADSHM_MAX_READERS));
+}
+
+inline bool PayloadShmCompareAndSwap(PayloadShmBlock *block, int expected, int desired)
+{
+    #if defined(_WIN32)
+    return InterlockedCompareExchange((volatile LONG*)&block->refs_, desired, expected) == expected;
+    #else
+    return __sync_bool_compare_and_swap(&block->refs_, expected, desired);
+    #endif
+}
+
+// drops one reference of the block if it still belongs to |serial|,
+// false when the writer freed it in the meantime
+inline bool PayloadShmRelease(PayloadShmBlock *block, unsigned serial)
+{
+    for ( ;; )
+    {
+        const int refs = block->refs_;
+        if ( (refs & PAYLOADSHM_MAX_READERS) == 0 || ((unsigned)refs >> 8) != (serial & 0xffffff) )
+        {
+            return false;
+        }
+
+        const int readers = refs & PAYLOADSHM_MAX_READERS;
+        if ( PayloadShmCompareAndSwap(block, refs, readers == 1 ? 0 : refs - 1) )
+        {
+            return true;
+        }
+    }
+}
+
+// frees the block whatever its count, if it still belongs to |serial|
+inline bool PayloadShmForceFree(PayloadShmBlock *block, unsigned serial)
+{
+    for ( ;; )
+    {
+        const int refs = block->refs_;
+        if ( refs == 0 || ((unsigned)refs >> 8) != (serial & 0xffffff) )
+        {
+            return false;
+        }
+
+        if ( PayloadShmCompareAndSwap(block, refs, 0) )
+        {
+            return true;
+        }
+    }
+}
+
+inline unsigned long long PayloadShmNowMs()
+{
+    #if defined(_WIN32)
+    return (unsigned long long)GetTickCount64();
+    #else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    #endif
+}
+
+// one ring per sending process
+inline std::string PayloadShmName(const char *prefix)
+{
+    #if defined(_WIN32)
+    unsigned long pid = GetCurrentProcessId();
+    #else
+    unsigned long pid = (unsigned long)getpid();
+    #endif
+
+    return std::string(prefix) + std::to_string(pid);
+}
+
+//=============================================================================
+// named mapping, created by the writer and opened by readers
+//=============================================================================
+class PayloadShmMapping
+{
+public:
+    PayloadShmMapping() : mem_(NULL), mapBytes_(0), owner_(false), mapping_(NULL), fd_(-1) {}
+    ~PayloadShmMapping() { Close(); }
+
+    bool Create(const std::string &name, unsigned mapBytes)
+    {
+        Close();
+        owner_ = true;
+        mapBytes_ = mapBytes;
+
+        #if defined(_WIN32)
+        name_ = "Local\\" + name;
+        mapping_ = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, mapBytes_, name_.c_str());
+        if ( mapping_ )
+        {
+            mem_ = MapViewOfFile((HANDLE)mapping_, FILE_MAP_ALL_ACCESS, 0, 0, mapBytes_);
+        }
+        #else
+        name_ = "/" + name;
+        fd_ = shm_open(name_.c_str(), O_CREAT | O_RDWR, 0600);
+        if ( fd_ >= 0 && ftruncate(fd_, mapBytes_) == 0 )
+        {
+            mem_ = mmap(NULL, mapBytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+            if ( mem_ == MAP_FAILED )
+            {
+                mem_ = NULL;
+            }
+        }
+        #endif
+
+        if ( mem_ == NULL )
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    // readers map it writable too, they release blocks in place
+    bool Open(const std::string &name)
+    {
+        Close();
+        owner_ = false;
+
+        #if defined(_WIN32)
+        name_ = "Local\\" + name;
+        mapping_ = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name_.c_str());
+        if ( mapping_ )
+        {
+            mem_ = MapViewOfFile((HANDLE)mapping_, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+        }
+        #else
+        name_ = "/" + name;
+        fd_ = shm_open(name_.c_str(), O_RDWR, 0);
+        if ( fd_ >= 0 )
+        {
+            mapBytes_ = (unsigned)lseek(fd_, 0, SEEK_END);
+            mem_ = mmap(NULL, mapBytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+            if ( mem_ == MAP_FAILED )
+            {
+                mem_ = NULL;
+            }
+        }
+        #endif
+
+        if ( mem_ == NULL )
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close()
+    {
+        #if defined(_WIN32)
+        if ( mem_ )
+        {
+            UnmapViewOfFile(mem_);
+        }
+        if ( mapping_ )
+        {
+            CloseHandle((HANDLE)mapping_);
+        }
+        #else
+        if ( mem_ )
+        {
+            munmap(mem_, mapBytes_);
+        }
+        if ( fd_ >= 0 )
+        {
+            close(fd_);
+            if ( owner_ )
+            {
+                shm_unlink(name_.c_str());
+            }
+        }
+        #endif
+
+        mem_ = NULL;
+        mapping_ = NULL;
+        fd_ = -1;
+    }
+
+    void* GetMemory() const         { return mem_; }
+    unsigned GetSize() const        { return mapBytes_; }
+
+protected:
+    std::string name_;
+    void        *mem_;
+    unsigned    mapBytes_;
+    bool        owner_;
+    void        *mapping_;
+    int         fd_;
+};
+
+//=============================================================================
+// writer side, not thread safe, one thread writes a ring
+//=============================================================================
+class PayloadShmWriter
+{
+public:
+    PayloadShmWriter()
+        : header_(NULL), blocks_(NULL), head_(0), tail_(0), used_(0), nextSerial_(0)
+        , maxAgeMs_(PAYLOADSHM_MAX_AGE_MS), forced_(0) {}
+
+    bool Create(const std::string &name, unsigned capacity)
+    {
+        unsigned headerBytes = PayloadShmBlockBytes(sizeof(PayloadShmHeader));
+        capacity = (capacity + PAYLOADSHM_ALIGN - 1) & ~(unsigned)(PAYLOADSHM_ALIGN - 1);
+
+        if ( !mapping_.Create(name, headerBytes + capacity) )
+        {
+            return false;
+        }
+
+        // readers check the magic last
+        header_ = (PayloadShmHeader*)mapping_.GetMemory();
+        memset(header_, 0, headerBytes);
+        header_->version_ = PAYLOADSHM_VERSION;
+        header_->headerBytes_ = headerBytes;
+        header_->capacity_ = capacity;
+        PAYLOADSHM_BARRIER();
+        header_->magic_ = PAYLOADSHM_MAGIC;
+
+        blocks_ = (unsigned char*)header_ + headerBytes;
+        head_ = tail_ = used_ = 0;
+        outstanding_.clear();
+        return true;
+    }
+
+    bool IsOpen() const             { return header_ != NULL; }
+    unsigned GetCapacity() const    { return header_ ? header_->capacity_ : 0; }
+    unsigned GetUsed() const        { return used_; }
+
+    // blocks still referenced this long after they were written are freed
+    void SetMaxAge(unsigned ms)     { maxAgeMs_ = ms; }
+    // blocks freed without their readers releasing them
+    unsigned GetForcedCount() const { return forced_; }
+
+    // copies the payload into a block held by |readers| references, false
+    // when the ring is full or the payload doesn't fit at all. |owner| is the
+    // receiver's id for ReleaseOwner()
+    bool Write(const void *data, unsigned length, unsigned readers, unsigned &offset, unsigned &serial, int owner = 0)
+    {
+        if ( header_ == NULL || readers == 0 || readers > PAYLOADSHM_MAX_READERS )
+        {
+            return false;
+        }
+
+        Reclaim();
+
+        const unsigned capacity = header_->capacity_;
+        const unsigned need = PayloadShmBlockBytes(length);
+        const unsigned toEnd = capacity - head_;
+
+        if ( need > capacity )
+        {
+            return false;
+        }
+
+        // no room before the end, pad it out and wrap to the start
+        if ( need > toEnd )
+        {
+            if ( used_ + toEnd + need > capacity )
+            {
+                return false;
+            }
+
+            PayloadShmBlock *pad = GetBlock(head_);
+            pad->blockBytes_ = toEnd;
+            pad->length_ = 0;
+            pad->serial_ = 0;
+            pad->refs_ = 0;
+            used_ += toEnd;
+            head_ = 0;
+        }
+
+        if ( used_ + need > capacity )
+        {
+            return false;
+        }
+
+        PayloadShmBlock *block = GetBlock(head_);
+        block->blockBytes_ = need;
+        block->length_ = length;
+        // 0 marks padding
+        if ( ++nextSerial_ == 0 )
+        {
+            ++nextSerial_;
+        }
+        block->serial_ = nextSerial_;
+        memcpy(block + 1, data, length);
+
+        // published with the count, after the payload
+        PAYLOADSHM_BARRIER();
+        block->refs_ = PayloadShmRefs(block->serial_, readers);
+
+        offset = head_;
+        serial = block->serial_;
+
+        Outstanding written;
+        written.offset_ = offset;
+        written.serial_ = serial;
+        written.owner_ = owner;
+        written.writtenMs_ = PayloadShmNowMs();
+        outstanding_.push_back(written);
+
+        head_ = ( head_ + need ) % capacity;
+        used_ += need;
+        return true;
+    }
+
+    // frees the blocks at the tail whose readers are all done, or that are
+    // past the maximum age
+    void Reclaim()
+    {
+        const unsigned long long now = PayloadShmNowMs();
+
+        while ( used_ > 0 )
+        {
+            PayloadShmBlock *block = GetBlock(tail_);
+            const bool padding = block->serial_ == 0 || outstanding_.empty();
+
+            if ( !padding )
+            {
+                const Outstanding &oldest = outstanding_.front();
+
+                if ( block->refs_ != 0 && now - oldest.writtenMs_ >= maxAgeMs_ && PayloadShmForceFree(block, oldest.serial_) )
+                {
+                    ++forced_;
+                }
+
+                if ( block->refs_ != 0 )
+                {
+                    break;
+                }
+                outstanding_.pop_front();
+            }
+
+            used_ -= block->blockBytes_;
+            tail_ = ( tail_ + block->blockBytes_ ) % header_->capacity_;
+        }
+
+        if ( used_ == 0 )
+        {
+            head_ = tail_ = 0;
+        }
+    }
+
+    // frees a block whose message couldn't be sent
+    void Cancel(unsigned offset, unsigned serial)
+    {
+        if ( header_ && PayloadShmForceFree(GetBlock(offset), serial) )
+        {
+            ++forced_;
+        }
+        Reclaim();
+    }
+
+    // frees the blocks written for |owner|, its reader is gone
+    void ReleaseOwner(int owner)
+    {
+        for ( std::deque<Outstanding>::const_iterator it = outstanding_.begin(); it != outstanding_.end(); ++it )
+        {
+            if ( it->owner_ == owner && PayloadShmForceFree(GetBlock(it->offset_), it->serial_) )
+            {
+                ++forced_;
+            }
+        }
+        Reclaim();
+    }
+
+protected:
+    PayloadShmBlock* GetBlock(unsigned offset) const { return (PayloadShmBlock*)(blocks_ + offset); }
+
+    PayloadShmMapping   mapping_;
+    PayloadShmHeader    *header_;
+    unsigned char       *blocks_;
+    unsigned            head_;
+    unsigned            tail_;
+    unsigned            used_;
+    unsigned            nextSerial_;
+
+    // the written blocks in ring order, padding excluded
+    struct Outstanding
+    {
+        unsigned            offset_;
+        unsigned            serial_;
+        int                 owner_;
+        unsigned long long  writtenMs_;
+    };
+    std::deque<Outstanding> outstanding_;
+    unsigned            maxAgeMs_;
+    unsigned            forced_;
+};
+
+//=============================================================================
+// reader side
+//=============================================================================
+class PayloadShmReader
+{
+public:
+    PayloadShmReader() : header_(NULL), blocks_(NULL) {}
+
+    bool Open(const std::string &name)
+    {
+        if ( !mapping_.Open(name) )
+        {
+            return false;
+        }
+
+        header_ = (const PayloadShmHeader*)mapping_.GetMemory();
+        PAYLOADSHM_BARRIER();
+
+        if ( header_->magic_ != PAYLOADSHM_MAGIC || header_->version_ != PAYLOADSHM_VERSION )
+        {
+            mapping_.Close();
+            header_ = NULL;
+            return false;
+        }
+
+        blocks_ = (unsigned char*)mapping_.GetMemory() + header_->headerBytes_;
+        return true;
+    }
+
+    bool IsOpen() const { return header_ != NULL; }
+
+    // the payload in place, NULL if the message doesn't match the block.
+    // Release() it once done, the pointer is invalid after that
+    const char* Acquire(unsigned offset, unsigned length, unsigned serial) const
+    {
+        if ( header_ == NULL || offset + PayloadShmBlockBytes(length) > header_->capacity_ )
+        {
+            return NULL;
+        }
+
+        const PayloadShmBlock *block = (const PayloadShmBlock*)(blocks_ + offset);
+        PAYLOADSHM_BARRIER();
+
+        const int refs = block->refs_;
+        if ( (refs & PAYLOADSHM_MAX_READERS) == 0 || ((unsigned)refs >> 8) != (serial & 0xffffff) ||
+             block->serial_ != serial || block->length_ != length )
+        {
+            return NULL;
+        }
+
+        return (const char*)(block + 1);
+    }
+
+    // false if the writer freed the block before this, what was read from it
+    // may be torn and has to be dropped
+    bool Release(unsigned offset, unsigned serial)
+    {
+        PAYLOADSHM_BARRIER();
+        return PayloadShmRelease((PayloadShmBlock*)(blocks_ + offset), serial);
+    }
+
+protected:
+    PayloadShmMapping       mapping_;
+    const PayloadShmHeader  *header_;
+    unsigned char           *blocks_;
+};
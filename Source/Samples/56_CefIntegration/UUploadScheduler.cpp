@@ -0,0 +1,132 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Urho3D.h>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Container/Sort.h>
+#include <SDL/SDL_log.h>
+
+#include "UUploadScheduler.h"
+#include "UBrowserImage.h"
+
+#include <Urho3D/DebugNew.h>
+
+//=============================================================================
+//=============================================================================
+UUploadScheduler::UUploadScheduler(Context *context)
+    : Object(context)
+    , budgetBytes_(UPLOAD_BUDGET_BYTES)
+    , targetUSec_(UPLOAD_TARGET_USEC)
+    , maxStarveFrames_(UPLOAD_MAX_STARVE_FRAMES)
+    , uploadedBytes_(0)
+    , bytesPerUSec_(0.0f)
+{
+    SubscribeToEvent(E_POSTUPDATE, URHO3D_HANDLER(UUploadScheduler, HandlePostUpdate));
+}
+
+UUploadScheduler::~UUploadScheduler()
+{
+    requests_.Clear();
+}
+
+void UUploadScheduler::Request(UBrowserImage *browserImage)
+{
+    UploadRequest request;
+    request.browserImage_ = browserImage;
+    request.priority_ = browserImage->GetUploadPriority(maxStarveFrames_);
+
+    requests_.Push(request);
+}
+
+void UUploadScheduler::Remove(UBrowserImage *browserImage)
+{
+    for ( unsigned i = 0; i < requests_.Size(); ++i )
+    {
+        if ( requests_[i].browserImage_ == browserImage )
+        {
+            requests_.Erase(i--);
+        }
+    }
+}
+
+bool UUploadScheduler::ComparePriority(const UploadRequest &lhs, const UploadRequest &rhs)
+{
+    return lhs.priority_ > rhs.priority_;
+}
+
+void UUploadScheduler::HandlePostUpdate(StringHash eventType, VariantMap& eventData)
+{
+    uploadedBytes_ = 0;
+
+    if ( requests_.Empty() )
+    {
+        return;
+    }
+
+    Sort(requests_.Begin(), requests_.End(), ComparePriority);
+
+    unsigned budget = budgetBytes_;
+    htimer_.Reset();
+
+    for ( unsigned i = 0; i < requests_.Size(); ++i )
+    {
+        UBrowserImage *browserImage = requests_[i].browserImage_;
+
+        if ( browserImage == NULL )
+        {
+            continue;
+        }
+
+        // starving browsers get their rows uploaded regardless of the budget
+        bool starving = ( requests_[i].priority_ & UPLOAD_PRIORITY_STARVING ) != 0;
+
+        if ( budget == 0 && !starving )
+        {
+            continue;
+        }
+
+        unsigned bytes = browserImage->UploadPending(starving ? M_MAX_UNSIGNED : budget);
+
+        uploadedBytes_ += bytes;
+        budget -= Min(bytes, budget);
+    }
+
+    UpdateBudget(uploadedBytes_, htimer_.GetUSec(false));
+
+    requests_.Clear();
+}
+
+void UUploadScheduler::UpdateBudget(unsigned bytes, long long usec)
+{
+    if ( targetUSec_ == 0 || bytes == 0 || usec <= 0 )
+    {
+        return;
+    }
+
+    // smooth the measured bandwidth to avoid reacting to a single driver hitch
+    float bytesPerUSec = (float)bytes/(float)usec;
+    bytesPerUSec_ = ( bytesPerUSec_ > 0.0f ) ? Lerp(bytesPerUSec_, bytesPerUSec, 0.1f) : bytesPerUSec;
+
+    budgetBytes_ = Clamp((unsigned)(bytesPerUSec_ * targetUSec_), (unsigned)UPLOAD_MIN_BUDGET_BYTES, (unsigned)UPLOAD_MAX_BUDGET_BYTES);
+}
+
@@ -0,0 +1,102 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Container/Ptr.h>
+
+#include "UBrowserImage.h"
+
+using namespace Urho3D;
+
+//=============================================================================
+//=============================================================================
+#define UPLOAD_BUDGET_BYTES         (CEFBUF_WIDTH*CEFBUF_HEIGHT*CEFBUF_COMPONENTS)
+#define UPLOAD_MIN_BUDGET_BYTES     (64*1024)
+#define UPLOAD_MAX_BUDGET_BYTES     (4*UPLOAD_BUDGET_BYTES)
+#define UPLOAD_TARGET_USEC          2000
+#define UPLOAD_MAX_STARVE_FRAMES    4
+
+#define UPLOAD_PRIORITY_VISIBLE     0x10000000
+#define UPLOAD_PRIORITY_FOCUSED     0x20000000
+#define UPLOAD_PRIORITY_STARVING    0x40000000
+#define UPLOAD_PRIORITY_COVERAGE    0x0fffffff
+
+//=============================================================================
+// Distributes a per-frame byte budget for texture uploads across all browsers.
+// Browsers request every frame they have rows pending, the requests are served
+// in priority order on E_POSTUPDATE and leftover rows roll over to the next frame.
+//=============================================================================
+class UUploadScheduler : public Object
+{
+    URHO3D_OBJECT(UUploadScheduler, Object);
+public:
+
+    UUploadScheduler(Context *context);
+    virtual ~UUploadScheduler();
+
+    void Request(UBrowserImage *browserImage);
+    void Remove(UBrowserImage *browserImage);
+
+    // fixed budget, used as is when the target time is 0
+    void SetBudgetBytes(unsigned bytes)         { budgetBytes_ = bytes; }
+    unsigned GetBudgetBytes() const             { return budgetBytes_; }
+
+    // adapt the budget to the measured upload bandwidth, 0 usec disables it
+    void SetTargetUSec(unsigned usec)           { targetUSec_ = usec; }
+    unsigned GetTargetUSec() const              { return targetUSec_; }
+
+    // frames a browser can wait before it's uploaded regardless of the budget
+    void SetMaxStarveFrames(unsigned frames)    { maxStarveFrames_ = frames; }
+    unsigned GetMaxStarveFrames() const         { return maxStarveFrames_; }
+
+    // stats of the last frame
+    unsigned GetUploadedBytes() const           { return uploadedBytes_; }
+    float GetBytesPerUSec() const               { return bytesPerUSec_; }
+
+protected:
+    void HandlePostUpdate(StringHash eventType, VariantMap& eventData);
+    void UpdateBudget(unsigned bytes, long long usec);
+
+protected:
+    struct UploadRequest
+    {
+        WeakPtr<UBrowserImage> browserImage_;
+        unsigned priority_;
+    };
+
+    static bool ComparePriority(const UploadRequest &lhs, const UploadRequest &rhs);
+
+    Vector<UploadRequest> requests_;
+
+    unsigned budgetBytes_;
+    unsigned targetUSec_;
+    unsigned maxStarveFrames_;
+
+    unsigned uploadedBytes_;
+    float    bytesPerUSec_;
+
+    HiresTimer htimer_;
+};
+
@@ -0,0 +1,205 @@
+// Copyright (c) 2013 The Chromium Embedded Framework Authors. All rights
+// reserved. Use of this source code is governed by a BSD-style license that
+// can be found in the LICENSE file.
+
+#include "cefsimple/native_bindings.h"
+
+// LUMAK: result message entries, call id, success, then the result or the
+// error message.
+namespace {
+
+const int kArgCallId = 0;
+const int kArgEntry = 1;
+const int kArgFirst = 2;
+
+const int kResultCallId = 0;
+const int kResultSuccess = 1;
+const int kResultValue = 2;
+
+}  // namespace
+
+// The thunk behind every bound function, the generated conversions do the
+// rest.
+class NativeBindings::Handler : public CefV8Handler {
+ public:
+  explicit Handler(size_t entry) : entry_(entry) {}
+
+  virtual bool Execute(const CefString& name,
+                       CefRefPtr<CefV8Value> object,
+                       const CefV8ValueList& arguments,
+                       CefRefPtr<CefV8Value>& retval,
+                       CefString& exception) OVERRIDE {
+    CefRefPtr<CefV8Context> context = CefV8Context::GetCurrentContext();
+    NativeBindings::GetInstance()->Call(context->GetBrowser(), entry_,
+                                        arguments, exception);
+    retval = CefV8Value::CreateUndefined();
+    return true;
+  }
+
+ private:
+  const size_t entry_;
+
+  IMPLEMENT_REFCOUNTING(Handler);
+  DISALLOW_COPY_AND_ASSIGN(Handler);
+};
+
+// static
+NativeBindings* NativeBindings::GetInstance() {
+  static NativeBindings instance;
+  return &instance;
+}
+
+NativeBindings::NativeBindings()
+    : next_call_id_(0) {
+}
+
+void NativeBindings::OnContextCreated(CefRefPtr<CefBrowser> browser,
+                                      CefRefPtr<CefV8Context> context) {
+  if (entries_.empty())
+    return;
+
+  CefRefPtr<CefV8Value> object = CefV8Value::CreateObject(NULL);
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    object->SetValue(entries_[i].name,
+                     CefV8Value::CreateFunction(entries_[i].name,
+                                                new Handler(i)),
+                     V8_PROPERTY_ATTRIBUTE_READONLY);
+  }
+
+  context->GetGlobal()->SetValue(NATIVE_BINDINGS_OBJECT, object,
+                                 V8_PROPERTY_ATTRIBUTE_READONLY);
+}
+
+void NativeBindings::OnContextReleased(CefRefPtr<CefV8Context> context) {
+  std::map<int, PendingCall>::iterator it = pending_.begin();
+  while (it != pending_.end()) {
+    if (it->second.context->IsSame(context))
+      pending_.erase(it++);
+    else
+      ++it;
+  }
+}
+
+bool NativeBindings::Call(CefRefPtr<CefBrowser> browser,
+                          size_t entry,
+                          const CefV8ValueList& arguments,
+                          CefString& exception) {
+  const Entry& bound = entries_[entry];
+
+  // An optional callback after the declared arguments.
+  CefRefPtr<CefV8Value> callback;
+  if (arguments.size() == bound.arity + 1 && arguments.back()->IsFunction()) {
+    callback = arguments.back();
+  } else if (arguments.size() != bound.arity) {
+    exception = NATIVE_BINDINGS_OBJECT "." + bound.name + ": wrong number of arguments";
+    return false;
+  }
+
+  CefRefPtr<CefProcessMessage> message =
+      CefProcessMessage::Create(NATIVE_CALL_MESSAGE);
+  CefRefPtr<CefListValue> args = message->GetArgumentList();
+  args->SetSize(kArgFirst + bound.arity);
+
+  if (!bound.write_arguments(arguments, args, kArgFirst)) {
+    exception = NATIVE_BINDINGS_OBJECT "." + bound.name + ": argument of the wrong type";
+    return false;
+  }
+
+  // Id 0 asks for no result.
+  int call_id = 0;
+  if (callback) {
+    call_id = ++next_call_id_;
+    if (call_id <= 0)
+      call_id = next_call_id_ = 1;
+
+    PendingCall& pending = pending_[call_id];
+    pending.entry = entry;
+    pending.context = CefV8Context::GetCurrentContext();
+    pending.callback = callback;
+  }
+
+  args->SetInt(kArgCallId, call_id);
+  args->SetInt(kArgEntry, static_cast<int>(entry));
+  browser->SendProcessMessage(PID_BROWSER, message);
+  return true;
+}
+
+bool NativeBindings::OnRendererMessage(CefRefPtr<CefBrowser> browser,
+                                       CefRefPtr<CefProcessMessage> message) {
+  if (message->GetName() != NATIVE_RESULT_MESSAGE)
+    return false;
+
+  CefRefPtr<CefListValue> args = message->GetArgumentList();
+  std::map<int, PendingCall>::iterator it =
+      pending_.find(args->GetInt(kResultCallId));
+  if (it == pending_.end())
+    return true;
+
+  PendingCall pending = it->second;
+  pending_.erase(it);
+
+  if (!pending.context->Enter())
+    return true;
+
+  CefV8ValueList callback_args;
+  if (args->GetBool(kResultSuccess)) {
+    callback_args.push_back(
+        entries_[pending.entry].read_result(args, kResultValue));
+  } else {
+    callback_args.push_back(CefV8Value::CreateUndefined());
+    callback_args.push_back(
+        CefV8Value::CreateString(args->GetString(kResultValue)));
+  }
+  pending.callback->ExecuteFunction(NULL, callback_args);
+
+  pending.context->Exit();
+  return true;
+}
+
+bool NativeBindings::OnBrowserMessage(CefRefPtr<CefBrowser> browser,
+                                      CefRefPtr<CefProcessMessage> message) {
+  if (message->GetName() != NATIVE_CALL_MESSAGE)
+    return false;
+
+  // The message's list doesn't outlive this call.
+  base::AutoLock lock(lock_);
+  queued_.push_back(QueuedCall());
+  queued_.back().browser = browser;
+  queued_.back().args = message->GetArgumentList()->Copy();
+  return true;
+}
+
+unsigned NativeBindings::RunCalls() {
+  std::deque<QueuedCall> calls;
+  {
+    base::AutoLock lock(lock_);
+    calls.swap(queued_);
+  }
+
+  for (size_t i = 0; i < calls.size(); ++i) {
+    CefRefPtr<CefListValue> args = calls[i].args;
+    const int call_id = args->GetInt(kArgCallId);
+    const size_t entry = static_cast<size_t>(args->GetInt(kArgEntry));
+
+    CefRefPtr<CefListValue> result = CefListValue::Create();
+    bool success = entry < entries_.size() &&
+                   args->GetSize() == kArgFirst + entries_[entry].arity &&
+                   entries_[entry].invoke(args, kArgFirst, result);
+
+    if (call_id == 0)
+      continue;
+
+    CefRefPtr<CefProcessMessage> message =
+        CefProcessMessage::Create(NATIVE_RESULT_MESSAGE);
+    CefRefPtr<CefListValue> out = message->GetArgumentList();
+    out->SetInt(kResultCallId, call_id);
+    out->SetBool(kResultSuccess, success);
+    if (success)
+      out->SetValue(kResultValue, result->GetValue(0));
+    else
+      out->SetString(kResultValue, "bad call");
+    calls[i].browser->SendProcessMessage(PID_RENDERER, message);
+  }
+
+  return static_cast<unsigned>(calls.size());
+}
@@ -0,0 +1,500 @@
+// Copyright (c) 2013 The Chromium Embedded Framework Authors. All rights
+// reserved. Use of this source code is governed by a BSD-style license that
+// can be found in the LICENSE file.
+
+#ifndef CEF_TESTS_CEFSIMPLE_NATIVE_BINDINGS_H_
+#define CEF_TESTS_CEFSIMPLE_NATIVE_BINDINGS_H_
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "include/base/cef_lock.h"
+#include "include/base/cef_macros.h"
+#include "include/cef_browser.h"
+#include "include/cef_process_message.h"
+#include "include/cef_v8.h"
+#include "include/cef_values.h"
+
+// LUMAK: typed native functions for JS. A C++ function is registered once
+// with its signature,
+//
+//   NativeBindings::GetInstance()->Add("scale", &Scale);
+//
+// and shows up in every V8 context as window.urho.scale(v, s, callback).
+// The renderer side thunk is generated from the signature: arguments are
+// converted from V8 straight to typed CefListValue entries, nothing is
+// stringified or parsed. The call runs in the browser process and its result
+// comes back as callback(result) or callback(undefined, error).
+//
+// Both processes run the same executable and must register the same
+// functions in the same order, before CefExecuteProcess(). Structs are
+// bound by specializing NativeFields<T>:
+//
+//   template <> struct NativeFields<Vec3> {
+//     template <typename V> static void Visit(V& v, Vec3& s) {
+//       v("x", s.x); v("y", s.y); v("z", s.z);
+//     }
+//   };
+
+// Message names, shared by both sides.
+#define NATIVE_CALL_MESSAGE         "UrhoNativeCall"
+#define NATIVE_RESULT_MESSAGE       "UrhoNativeResult"
+#define NATIVE_BINDINGS_OBJECT      "urho"
+
+template <typename T>
+struct NativeFields;
+
+namespace native_bindings {
+
+// Conversions of one type between V8 values and list entries. Structs go
+// through NativeFields<T>, as a V8 object and as a nested list in field
+// order.
+template <typename T>
+struct Traits;
+
+struct FromV8Visitor {
+  CefRefPtr<CefV8Value> object;
+  bool ok;
+
+  template <typename M>
+  void operator()(const char* name, M& member) {
+    if (!ok)
+      return;
+    CefRefPtr<CefV8Value> value = object->GetValue(name);
+    ok = value.get() && Traits<M>::FromV8(value, &member);
+  }
+};
+
+struct ToV8Visitor {
+  CefRefPtr<CefV8Value> object;
+
+  template <typename M>
+  void operator()(const char* name, M& member) {
+    object->SetValue(name, Traits<M>::ToV8(member), V8_PROPERTY_ATTRIBUTE_NONE);
+  }
+};
+
+struct ToListVisitor {
+  CefRefPtr<CefListValue> list;
+  size_t index;
+
+  template <typename M>
+  void operator()(const char* name, M& member) {
+    Traits<M>::ToList(list, index++, member);
+  }
+};
+
+struct FromListVisitor {
+  CefRefPtr<CefListValue> list;
+  size_t index;
+  bool ok;
+
+  template <typename M>
+  void operator()(const char* name, M& member) {
+    if (ok)
+      ok = Traits<M>::FromList(list, index++, &member);
+  }
+};
+
+template <typename T>
+struct Traits {
+  static bool FromV8(CefRefPtr<CefV8Value> value, T* out) {
+    if (!value->IsObject())
+      return false;
+    FromV8Visitor visitor = { value, true };
+    NativeFields<T>::Visit(visitor, *out);
+    return visitor.ok;
+  }
+  static CefRefPtr<CefV8Value> ToV8(const T& value) {
+    ToV8Visitor visitor = { CefV8Value::CreateObject(NULL) };
+    T copy(value);
+    NativeFields<T>::Visit(visitor, copy);
+    return visitor.object;
+  }
+  static void ToList(CefRefPtr<CefListValue> list, size_t index,
+                     const T& value) {
+    ToListVisitor visitor = { CefListValue::Create(), 0 };
+    T copy(value);
+    NativeFields<T>::Visit(visitor, copy);
+    list->SetList(index, visitor.list);
+  }
+  static bool FromList(CefRefPtr<CefListValue> list, size_t index, T* out) {
+    if (list->GetType(index) != VTYPE_LIST)
+      return false;
+    FromListVisitor visitor = { list->GetList(index), 0, true };
+    NativeFields<T>::Visit(visitor, *out);
+    return visitor.ok;
+  }
+};
+
+template <>
+struct Traits<int> {
+  static bool FromV8(CefRefPtr<CefV8Value> value, int* out) {
+    if (!value->IsInt() && !value->IsUInt() && !value->IsDouble())
+      return false;
+    *out = value->GetIntValue();
+    return true;
+  }
+  static CefRefPtr<CefV8Value> ToV8(const int& value) {
+    return CefV8Value::CreateInt(value);
+  }
+  static void ToList(CefRefPtr<CefListValue> list, size_t index,
+                     const int& value) {
+    list->SetInt(index, value);
+  }
+  static bool FromList(CefRefPtr<CefListValue> list, size_t index, int* out) {
+    if (list->GetType(index) != VTYPE_INT)
+      return false;
+    *out = list->GetInt(index);
+    return true;
+  }
+};
+
+template <>
+struct Traits<double> {
+  static bool FromV8(CefRefPtr<CefV8Value> value, double* out) {
+    if (!value->IsInt() && !value->IsUInt() && !value->IsDouble())
+      return false;
+    *out = value->GetDoubleValue();
+    return true;
+  }
+  static CefRefPtr<CefV8Value> ToV8(const double& value) {
+    return CefV8Value::CreateDouble(value);
+  }
+  static void ToList(CefRefPtr<CefListValue> list, size_t index,
+                     const double& value) {
+    list->SetDouble(index, value);
+  }
+  static bool FromList(CefRefPtr<CefListValue> list, size_t index,
+                       double* out) {
+    if (list->GetType(index) != VTYPE_DOUBLE)
+      return false;
+    *out = list->GetDouble(index);
+    return true;
+  }
+};
+
+template <>
+struct Traits<float> {
+  static bool FromV8(CefRefPtr<CefV8Value> value, float* out) {
+    double d;
+    if (!Traits<double>::FromV8(value, &d))
+      return false;
+    *out = static_cast<float>(d);
+    return true;
+  }
+  static CefRefPtr<CefV8Value> ToV8(const float& value) {
+    return CefV8Value::CreateDouble(value);
+  }
+  static void ToList(CefRefPtr<CefListValue> list, size_t index,
+                     const float& value) {
+    list->SetDouble(index, value);
+  }
+  static bool FromList(CefRefPtr<CefListValue> list, size_t index,
+                       float* out) {
+    double d;
+    if (!Traits<double>::FromList(list, index, &d))
+      return false;
+    *out = static_cast<float>(d);
+    return true;
+  }
+};
+
+template <>
+struct Traits<bool> {
+  static bool FromV8(CefRefPtr<CefV8Value> value, bool* out) {
+    if (!value->IsBool())
+      return false;
+    *out = value->GetBoolValue();
+    return true;
+  }
+  static CefRefPtr<CefV8Value> ToV8(const bool& value) {
+    return CefV8Value::CreateBool(value);
+  }
+  static void ToList(CefRefPtr<CefListValue> list, size_t index,
+                     const bool& value) {
+    list->SetBool(index, value);
+  }
+  static bool FromList(CefRefPtr<CefListValue> list, size_t index, bool* out) {
+    if (list->GetType(index) != VTYPE_BOOL)
+      return false;
+    *out = list->GetBool(index);
+    return true;
+  }
+};
+
+template <>
+struct Traits<std::string> {
+  static bool FromV8(CefRefPtr<CefV8Value> value, std::string* out) {
+    if (!value->IsString())
+      return false;
+    *out = value->GetStringValue().ToString();
+    return true;
+  }
+  static CefRefPtr<CefV8Value> ToV8(const std::string& value) {
+    return CefV8Value::CreateString(value);
+  }
+  static void ToList(CefRefPtr<CefListValue> list, size_t index,
+                     const std::string& value) {
+    list->SetString(index, value);
+  }
+  static bool FromList(CefRefPtr<CefListValue> list, size_t index,
+                       std::string* out) {
+    if (list->GetType(index) != VTYPE_STRING)
+      return false;
+    *out = list->GetString(index).ToString();
+    return true;
+  }
+};
+
+template <typename E>
+struct Traits<std::vector<E> > {
+  static bool FromV8(CefRefPtr<CefV8Value> value, std::vector<E>* out) {
+    if (!value->IsArray())
+      return false;
+    const int length = value->GetArrayLength();
+    out->resize(length);
+    for (int i = 0; i < length; ++i) {
+      if (!Traits<E>::FromV8(value->GetValue(i), &(*out)[i]))
+        return false;
+    }
+    return true;
+  }
+  static CefRefPtr<CefV8Value> ToV8(const std::vector<E>& value) {
+    CefRefPtr<CefV8Value> array =
+        CefV8Value::CreateArray(static_cast<int>(value.size()));
+    for (size_t i = 0; i < value.size(); ++i)
+      array->SetValue(static_cast<int>(i), Traits<E>::ToV8(value[i]));
+    return array;
+  }
+  static void ToList(CefRefPtr<CefListValue> list, size_t index,
+                     const std::vector<E>& value) {
+    CefRefPtr<CefListValue> child = CefListValue::Create();
+    child->SetSize(value.size());
+    for (size_t i = 0; i < value.size(); ++i)
+      Traits<E>::ToList(child, i, value[i]);
+    list->SetList(index, child);
+  }
+  static bool FromList(CefRefPtr<CefListValue> list, size_t index,
+                       std::vector<E>* out) {
+    if (list->GetType(index) != VTYPE_LIST)
+      return false;
+    CefRefPtr<CefListValue> child = list->GetList(index);
+    out->resize(child->GetSize());
+    for (size_t i = 0; i < out->size(); ++i) {
+      if (!Traits<E>::FromList(child, i, &(*out)[i]))
+        return false;
+    }
+    return true;
+  }
+};
+
+template <typename T>
+struct Decay {
+  typedef T Type;
+};
+template <typename T>
+struct Decay<const T&> {
+  typedef T Type;
+};
+template <typename T>
+struct Decay<T&> {
+  typedef T Type;
+};
+
+template <size_t... I>
+struct IndexSequence {};
+template <size_t N, size_t... I>
+struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, I...> {};
+template <size_t... I>
+struct MakeIndexSequence<0, I...> {
+  typedef IndexSequence<I...> Type;
+};
+
+// V8 arguments to list entries, in the renderer.
+template <typename... Args>
+struct ArgumentWriter {
+  template <size_t... I>
+  static bool Write(const CefV8ValueList& arguments,
+                    CefRefPtr<CefListValue> list, size_t offset,
+                    IndexSequence<I...>) {
+    bool ok = true;
+    // Evaluated in order, each stops once one failed.
+    bool results[] = { true, (ok = ok && WriteOne<typename Decay<Args>::Type>(
+                                  arguments[I], list, offset + I))... };
+    (void)results;
+    return ok;
+  }
+
+  template <typename T>
+  static bool WriteOne(CefRefPtr<CefV8Value> value,
+                       CefRefPtr<CefListValue> list, size_t index) {
+    T native;
+    if (!Traits<T>::FromV8(value, &native))
+      return false;
+    Traits<T>::ToList(list, index, native);
+    return true;
+  }
+};
+
+// List entries to native arguments and the call, in the browser process.
+template <typename R, typename... Args>
+struct Invoker {
+  typedef std::function<R(Args...)> Function;
+
+  template <size_t... I>
+  static bool Call(const Function& function, CefRefPtr<CefListValue> args,
+                   size_t offset, CefRefPtr<CefListValue> result,
+                   IndexSequence<I...>) {
+    std::tuple<typename Decay<Args>::Type...> natives;
+    bool ok = true;
+    bool results[] = { true, (ok = ok &&
+        Traits<typename Decay<Args>::Type>::FromList(
+            args, offset + I, &std::get<I>(natives)))... };
+    (void)results;
+    if (!ok)
+      return false;
+    Traits<R>::ToList(result, 0, function(std::get<I>(natives)...));
+    return true;
+  }
+};
+
+template <typename... Args>
+struct Invoker<void, Args...> {
+  typedef std::function<void(Args...)> Function;
+
+  template <size_t... I>
+  static bool Call(const Function& function, CefRefPtr<CefListValue> args,
+                   size_t offset, CefRefPtr<CefListValue> result,
+                   IndexSequence<I...>) {
+    std::tuple<typename Decay<Args>::Type...> natives;
+    bool ok = true;
+    bool results[] = { true, (ok = ok &&
+        Traits<typename Decay<Args>::Type>::FromList(
+            args, offset + I, &std::get<I>(natives)))... };
+    (void)results;
+    if (!ok)
+      return false;
+    function(std::get<I>(natives)...);
+    result->SetNull(0);
+    return true;
+  }
+};
+
+template <typename R>
+struct ResultReader {
+  static CefRefPtr<CefV8Value> Read(CefRefPtr<CefListValue> list,
+                                    size_t index) {
+    R value;
+    if (!Traits<R>::FromList(list, index, &value))
+      return CefV8Value::CreateUndefined();
+    return Traits<R>::ToV8(value);
+  }
+};
+
+template <>
+struct ResultReader<void> {
+  static CefRefPtr<CefV8Value> Read(CefRefPtr<CefListValue> list,
+                                    size_t index) {
+    return CefV8Value::CreateUndefined();
+  }
+};
+
+}  // namespace native_bindings
+
+class NativeBindings {
+ public:
+  // One per process.
+  static NativeBindings* GetInstance();
+
+  template <typename R, typename... Args>
+  void Add(const std::string& name, R (*function)(Args...)) {
+    Add(name, std::function<R(Args...)>(function));
+  }
+
+  template <typename R, typename... Args>
+  void Add(const std::string& name, const std::function<R(Args...)>& function) {
+    typedef native_bindings::Invoker<R, Args...> InvokerType;
+    typedef typename native_bindings::MakeIndexSequence<sizeof...(Args)>::Type
+        Indices;
+
+    Entry entry;
+    entry.name = name;
+    entry.arity = sizeof...(Args);
+    entry.write_arguments = [](const CefV8ValueList& arguments,
+                               CefRefPtr<CefListValue> list, size_t offset) {
+      return native_bindings::ArgumentWriter<Args...>::Write(
+          arguments, list, offset, Indices());
+    };
+    entry.invoke = [function](CefRefPtr<CefListValue> args, size_t offset,
+                              CefRefPtr<CefListValue> result) {
+      return InvokerType::Call(function, args, offset, result, Indices());
+    };
+    entry.read_result = &native_bindings::ResultReader<R>::Read;
+    entries_.push_back(entry);
+  }
+
+  size_t GetCount() const { return entries_.size(); }
+
+  // Renderer process, from the CefRenderProcessHandler callbacks.
+  void OnContextCreated(CefRefPtr<CefBrowser> browser,
+                        CefRefPtr<CefV8Context> context);
+  void OnContextReleased(CefRefPtr<CefV8Context> context);
+  bool OnRendererMessage(CefRefPtr<CefBrowser> browser,
+                         CefRefPtr<CefProcessMessage> message);
+
+  // Browser process. Calls are queued by OnBrowserMessage() on the UI thread
+  // and run by RunCalls() on the thread that owns the bound functions.
+  bool OnBrowserMessage(CefRefPtr<CefBrowser> browser,
+                        CefRefPtr<CefProcessMessage> message);
+  unsigned RunCalls();
+
+ private:
+  NativeBindings();
+
+  struct Entry {
+    std::string name;
+    size_t arity;
+    std::function<bool(const CefV8ValueList&, CefRefPtr<CefListValue>,
+                       size_t)> write_arguments;
+    std::function<bool(CefRefPtr<CefListValue>, size_t,
+                       CefRefPtr<CefListValue>)> invoke;
+    CefRefPtr<CefV8Value> (*read_result)(CefRefPtr<CefListValue>, size_t);
+  };
+
+  // A call waiting for its result, renderer side.
+  struct PendingCall {
+    size_t entry;
+    CefRefPtr<CefV8Context> context;
+    CefRefPtr<CefV8Value> callback;
+  };
+
+  // A call waiting to run, browser side.
+  struct QueuedCall {
+    CefRefPtr<CefBrowser> browser;
+    CefRefPtr<CefListValue> args;
+  };
+
+  class Handler;
+  friend class Handler;
+
+  bool Call(CefRefPtr<CefBrowser> browser, size_t entry,
+            const CefV8ValueList& arguments, CefString& exception);
+
+  std::vector<Entry> entries_;
+
+  // Renderer side, only accessed on the renderer thread.
+  std::map<int, PendingCall> pending_;
+  int next_call_id_;
+
+  base::Lock lock_;
+  std::deque<QueuedCall> queued_;
+
+  DISALLOW_COPY_AND_ASSIGN(NativeBindings);
+};
+
+#endif  // CEF_TESTS_CEFSIMPLE_NATIVE_BINDINGS_H_
@@ -131,6 +131,13 @@ void SimpleApp::OnContextInitialized()
     // Check if a "--url=" value was provided via the command-line. If so, use
     // that instead of the default URL.
     url = command_line->GetSwitchValue("url");
+
+    // LUMAK: url set by the app, i.e. a page to bake
+    if (url.empty())
+    {
+        url = startUrl_;
+    }
+
     if (url.empty())
     {
         //url = "http://www.google.com";
@@ -28,6 +28,7 @@ class SimpleApp : public CefApp,
   CefRefPtr<SimpleHandler> simpHandler_;
   CefRefPtr<CefBrowser> syncBrowser_;
   bool bSyncBrowser_;
+  std::string startUrl_;
   void AppCloseBrowser();
 
  private:
@@ -6,6 +6,7 @@
 using namespace Urho3D;
 
 #include "cefsimple/simple_handler.h"
+#include "cefsimple/native_bindings.h"
 
 #include <sstream>
 #include <string>
@@ -29,9 +30,12 @@ SimpleHandler::SimpleHandler(CefRenderHandler *cefRenderHandler)
     : cefRenderHandler_(cefRenderHandler)
     , use_views_(false)
     , is_closing_(false)
-    , onLoadEnded_(false)
     , messageLoopStarted_(false)
     , onBeforeCloseCalled_(false)
+    , payloadRingFailed_(false)
+    , payloadsInRing_(0)
+    , payloadsInline_(0)
+    , payloadBytes_(0)
 {
   DCHECK(!g_instance);
   g_instance = this;
@@ -64,8 +68,35 @@ void SimpleHandler::OnAfterCreated(CefRefPtr<CefBrowser> browser)
 {
     CEF_REQUIRE_UI_THREAD();
 
+    // LUMAK: the router is shared by all browsers
+    if (!messageRouter_)
+    {
+        CefMessageRouterConfig config;
+        // an accepted query that's never answered times out with the
+        // router's -1001 instead of pending forever. Unknown routes fail
+        // with -1 (unhandled), a route removed while its query waited
+        // with the bridge's QUERY_ERROR_NO_ROUTE
+        config.query_timeout_ms = 30000;
+        // a runaway page queues behind its own queries instead of
+        // starving the ui thread, and is told to back off once it's full
+        config.browser_queries_per_second = 20000;
+        config.browser_query_burst = 4000;
+        config.throttle_policy = CefMessageRouterConfig::THROTTLE_QUEUE;
+        config.throttle_queue_size = 1024;
+        messageRouter_ = CefMessageRouterBrowserSide::Create(config);
+
+        for (size_t i = 0; i < queryHandlers_.size(); ++i)
+            messageRouter_->AddHandler(queryHandlers_[i].first, false, queryHandlers_[i].second);
+
+        for (size_t i = 0; i < routeLimits_.size(); ++i)
+            messageRouter_->SetRouteRateLimit(routeLimits_[i].prefix, routeLimits_[i].perSecond, routeLimits_[i].burst);
+    }
+
     // Add to the list of existing browsers.
     browser_list_.push_back(browser);
+
+    // LUMAK: a hibernated browser can be recreated after the last one closed
+    onBeforeCloseCalled_ = false;
 }
 
 bool SimpleHandler::DoClose(CefRefPtr<CefBrowser> browser) 
@@ -90,6 +121,17 @@ void SimpleHandler::OnBeforeClose(CefRefPtr<CefBrowser> browser)
 {
     CEF_REQUIRE_UI_THREAD();
 
+    // pending queries of this browser are canceled
+    if (messageRouter_)
+        messageRouter_->OnBeforeClose(browser);
+
+    ReleasePayloads(browser->GetIdentifier());
+
+    {
+        base::AutoLock lock(loadLock_);
+        loadEnded_.erase(browser->GetIdentifier());
+    }
+
     // Remove from the list of existing browsers.
     BrowserList::iterator bit = browser_list_.begin();
     for (; bit != browser_list_.end(); ++bit) 
@@ -103,6 +145,13 @@ void SimpleHandler::OnBeforeClose(CefRefPtr<CefBrowser> browser)
 
     if (browser_list_.empty()) 
     {
+        if (messageRouter_)
+        {
+            for (size_t i = 0; i < queryHandlers_.size(); ++i)
+                messageRouter_->RemoveHandler(queryHandlers_[i].first);
+            messageRouter_ = NULL;
+        }
+
         onBeforeCloseCalled_ = true;
 
         // All browser windows have closed. Quit the application message loop.
@@ -139,7 +188,162 @@ void SimpleHandler::OnLoadError(CefRefPtr<CefBrowser> browser,
 
 void SimpleHandler::OnLoadEnd(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame, int httpStatusCode)
 {
-    onLoadEnded_ = true;
+    if (!frame->IsMain())
+        return;
+
+    base::AutoLock lock(loadLock_);
+    loadEnded_.insert(browser->GetIdentifier());
+}
+
+bool SimpleHandler::HasLoadEnded(int browserId)
+{
+    base::AutoLock lock(loadLock_);
+    return loadEnded_.find(browserId) != loadEnded_.end();
+}
+
+bool SimpleHandler::OnBeforeBrowse(CefRefPtr<CefBrowser> browser,
+                                   CefRefPtr<CefFrame> frame,
+                                   CefRefPtr<CefRequest> request,
+                                   bool is_redirect)
+{
+    CEF_REQUIRE_UI_THREAD();
+
+    if (messageRouter_)
+        messageRouter_->OnBeforeBrowse(browser, frame);
+
+    if (frame->IsMain())
+    {
+        base::AutoLock lock(loadLock_);
+        loadEnded_.erase(browser->GetIdentifier());
+    }
+    return false;
+}
+
+void SimpleHandler::OnRenderProcessTerminated(CefRefPtr<CefBrowser> browser,
+                                              TerminationStatus status)
+{
+    CEF_REQUIRE_UI_THREAD();
+
+    if (messageRouter_)
+        messageRouter_->OnRenderProcessTerminated(browser);
+
+    // the blocks sent to the dead renderer won't be released
+    ReleasePayloads(browser->GetIdentifier());
+}
+
+void SimpleHandler::ReleasePayloads(int browserId)
+{
+    base::AutoLock lock(payloadLock_);
+    payloadRing_.ReleaseOwner(browserId);
+}
+
+void SimpleHandler::AddQueryHandler(CefMessageRouterBrowserSide::Handler *handler,
+                                    const std::string& requestPrefix)
+{
+    queryHandlers_.push_back(std::make_pair(handler, requestPrefix));
+}
+
+void SimpleHandler::SetRouteRateLimit(const std::string& requestPrefix, int queriesPerSecond, int burst)
+{
+    RouteLimit limit;
+    limit.prefix = requestPrefix;
+    limit.perSecond = queriesPerSecond;
+    limit.burst = burst;
+    routeLimits_.push_back(limit);
+}
+
+bool SimpleHandler::SendPayload(CefRefPtr<CefBrowser> browser,
+                                const std::string& topic,
+                                const char* data,
+                                size_t length)
+{
+    if (!browser)
+        return false;
+
+    CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create(PAYLOADSHM_MESSAGE);
+    CefRefPtr<CefListValue> args = message->GetArgumentList();
+    args->SetString(0, topic);
+
+    bool inRing = false;
+    unsigned offset = 0, serial = 0;
+
+    if (length >= PAYLOADSHM_MIN_BYTES)
+    {
+        base::AutoLock lock(payloadLock_);
+
+        if (!payloadRing_.IsOpen() && !payloadRingFailed_)
+        {
+            payloadRingName_ = PayloadShmName("urho_payload_");
+            payloadRingFailed_ = !payloadRing_.Create(payloadRingName_, PAYLOADSHM_RING_BYTES);
+
+            if (payloadRingFailed_)
+                SDL_Log("payload: failed to map %s, sending inline", payloadRingName_.c_str());
+        }
+
+        // the renderer holds the only reference until it has read it
+        if (payloadRing_.Write(data, (unsigned)length, 1, offset, serial, browser->GetIdentifier()))
+        {
+            args->SetString(1, payloadRingName_);
+            args->SetInt(2, (int)offset);
+            args->SetInt(3, (int)length);
+            args->SetInt(4, (int)serial);
+            ++payloadsInRing_;
+            inRing = true;
+        }
+        else
+        {
+            ++payloadsInline_;
+        }
+        payloadBytes_ += length;
+    }
+
+    // small, or the ring is full
+    if (!inRing)
+        args->SetString(1, std::string(data, length));
+
+    if (browser->SendProcessMessage(PID_RENDERER, message))
+        return true;
+
+    // nobody is going to release it
+    if (inRing)
+    {
+        base::AutoLock lock(payloadLock_);
+        payloadRing_.Cancel(offset, serial);
+    }
+    return false;
+}
+
+void SimpleHandler::LogPayloadStats()
+{
+    base::AutoLock lock(payloadLock_);
+
+    SDL_Log("payload: %u in ring, %u inline with the ring full, %llu bytes, ring used %u of %u, %u freed unreleased",
+            payloadsInRing_, payloadsInline_, payloadBytes_,
+            payloadRing_.GetUsed(), payloadRing_.GetCapacity(), payloadRing_.GetForcedCount());
+}
+
+void SimpleHandler::LogRouterStats()
+{
+    if (!CefCurrentlyOn(TID_UI))
+    {
+        // the router is only accessed on the UI thread
+        CefPostTask(TID_UI, base::Bind(&SimpleHandler::LogRouterStats, this));
+        return;
+    }
+
+    if (!messageRouter_)
+        return;
+
+    SDL_Log("router: %d pending, %d on a deadline, %d timed out",
+            messageRouter_->GetPendingCount(NULL, NULL),
+            messageRouter_->GetDeadlineCount(),
+            messageRouter_->GetTimedOutCount());
+
+    CefMessageRouterThrottleStats throttle;
+    messageRouter_->GetThrottleStats(&throttle);
+    SDL_Log("router throttle: %d queued, %d delayed, %d rejected, %d coalesced, %d back-offs",
+            throttle.queued, throttle.delayed, throttle.rejected,
+            throttle.coalesced, throttle.backoffs);
 }
 
 void SimpleHandler::CloseAllBrowsers(bool force_close) 
@@ -171,6 +375,13 @@ bool SimpleHandler::OnProcessMessageReceived(CefRefPtr<CefBrowser> browser,
                                              CefProcessId source_process,
                                              CefRefPtr<CefProcessMessage> message) 
 {
+    if (messageRouter_ && messageRouter_->OnProcessMessageReceived(browser, source_process, message))
+        return true;
+
+    // queued for NativeBindings::RunCalls() on the main thread
+    if (NativeBindings::GetInstance()->OnBrowserMessage(browser, message))
+        return true;
+
     std::string strname = message->GetName().ToString();
     SDL_Log("SH:onProcMsgRcv - %s", strname.c_str() );
     return false;
@@ -6,13 +6,21 @@
 #define CEF_TESTS_CEFSIMPLE_SIMPLE_HANDLER_H_
 
 #include "include/cef_client.h"
+#include "include/base/cef_lock.h"
+#include "include/wrapper/cef_message_router.h"
+
+#include "../../UPayloadShm.h"
 
 #include <list>
+#include <set>
+#include <string>
+#include <vector>
 
 class SimpleHandler : public CefClient,
                       public CefDisplayHandler,
                       public CefLifeSpanHandler,
-                      public CefLoadHandler {
+                      public CefLoadHandler,
+                      public CefRequestHandler {
  public:
   SimpleHandler(CefRenderHandler *cefRenderHandler);
   ~SimpleHandler();
@@ -31,6 +39,9 @@ class SimpleHandler : public CefClient,
   virtual CefRefPtr<CefLoadHandler> GetLoadHandler() OVERRIDE {
     return this;
   }
+  virtual CefRefPtr<CefRequestHandler> GetRequestHandler() OVERRIDE {
+    return this;
+  }
 
   // CefDisplayHandler methods:
   virtual void OnTitleChange(CefRefPtr<CefBrowser> browser,
@@ -52,6 +63,14 @@ class SimpleHandler : public CefClient,
                          CefRefPtr<CefFrame> frame,
                          int httpStatusCode)OVERRIDE;
 
+  // CefRequestHandler methods:
+  virtual bool OnBeforeBrowse(CefRefPtr<CefBrowser> browser,
+                              CefRefPtr<CefFrame> frame,
+                              CefRefPtr<CefRequest> request,
+                              bool is_redirect) OVERRIDE;
+  virtual void OnRenderProcessTerminated(CefRefPtr<CefBrowser> browser,
+                                         TerminationStatus status) OVERRIDE;
+
   // Request that all existing browser windows close.
   void CloseAllBrowsers(bool force_close);
 
@@ -64,18 +83,45 @@ class SimpleHandler : public CefClient,
   bool OnBeforeCloseWasCalled();
   void SetMessageLoopStarted(bool bset){ messageLoopStarted_ = bset; }
   bool messageLoopStarted_;
-  bool onLoadEnded_;
+
+  //LUMAK: true once the main frame of the browser finished loading, until it
+  // navigates or closes. Can be called from any thread.
+  bool HasLoadEnded(int browserId);
 
   virtual bool OnProcessMessageReceived(CefRefPtr<CefBrowser> browser,
                                         CefProcessId source_process,
                                         CefRefPtr<CefProcessMessage> message);
 
+  //LUMAK: cefQuery handlers, added to the message router once the first
+  // browser is created, call before that. A handler with a request prefix is
+  // only offered the queries that start with it.
+  void AddQueryHandler(CefMessageRouterBrowserSide::Handler *handler,
+                       const std::string& requestPrefix = std::string());
+
+  //LUMAK: rate limit for the queries starting with requestPrefix, over all
+  // browsers, on top of the per browser one. Call before the first browser
+  // is created, like AddQueryHandler().
+  void SetRouteRateLimit(const std::string& requestPrefix, int queriesPerSecond, int burst);
+
+  //LUMAK: a payload for window.onUrhoPayload(topic, text) in the main frame.
+  // Large ones go through a shared memory ring and only their location is
+  // sent. Can be called from any thread.
+  bool SendPayload(CefRefPtr<CefBrowser> browser, const std::string& topic,
+                   const char* data, size_t length);
+  void LogPayloadStats();
+
+  //LUMAK: pending and timed out cefQuery counts of the router, logged on the
+  // UI thread. Can be called from any thread.
+  void LogRouterStats();
 
 private:
   // Platform-specific implementation.
   void PlatformTitleChange(CefRefPtr<CefBrowser> browser,
                            const CefString& title);
 
+  // frees the ring blocks sent to a browser whose renderer is gone
+  void ReleasePayloads(int browserId);
+
   // True if the application is using the Views framework.
   const bool use_views_;
 
@@ -84,8 +130,33 @@ private:
   BrowserList browser_list_;
   bool onBeforeCloseCalled_;
 
+  // Handles the browser side of query routing. Only accessed on the CEF UI thread.
+  CefRefPtr<CefMessageRouterBrowserSide> messageRouter_;
+  std::vector<std::pair<CefMessageRouterBrowserSide::Handler*, std::string> > queryHandlers_;
+
+  struct RouteLimit
+  {
+    std::string prefix;
+    int perSecond;
+    int burst;
+  };
+  std::vector<RouteLimit> routeLimits_;
+
   bool is_closing_;
 
+  // browsers whose main frame has loaded
+  base::Lock loadLock_;
+  std::set<int> loadEnded_;
+
+  // Payload ring, created on the first large payload.
+  base::Lock payloadLock_;
+  PayloadShmWriter payloadRing_;
+  std::string payloadRingName_;
+  bool payloadRingFailed_;
+  unsigned payloadsInRing_;
+  unsigned payloadsInline_;
+  unsigned long long payloadBytes_;
+
   // Include the default reference counting implementation.
   IMPLEMENT_REFCOUNTING(SimpleHandler);
 };
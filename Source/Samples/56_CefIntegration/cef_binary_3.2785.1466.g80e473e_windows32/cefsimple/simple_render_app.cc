@@ -0,0 +1,121 @@
+// Copyright (c) 2013 The Chromium Embedded Framework Authors. All rights
+// reserved. Use of this source code is governed by a BSD-style license that
+// can be found in the LICENSE file.
+
+#include "cefsimple/simple_render_app.h"
+#include "cefsimple/native_bindings.h"
+
+#include "include/base/cef_logging.h"
+
+SimpleRenderApp::SimpleRenderApp()
+{
+}
+
+SimpleRenderApp::~SimpleRenderApp()
+{
+    PayloadReaderMap::iterator it = payloadReaders_.begin();
+    for ( ; it != payloadReaders_.end(); ++it)
+        delete it->second;
+}
+
+void SimpleRenderApp::OnWebKitInitialized()
+{
+    // must match the browser side config, see SimpleHandler::OnAfterCreated()
+    CefMessageRouterConfig config;
+    messageRouter_ = CefMessageRouterRendererSide::Create(config);
+}
+
+void SimpleRenderApp::OnContextCreated(CefRefPtr<CefBrowser> browser,
+                                       CefRefPtr<CefFrame> frame,
+                                       CefRefPtr<CefV8Context> context)
+{
+    messageRouter_->OnContextCreated(browser, frame, context);
+    NativeBindings::GetInstance()->OnContextCreated(browser, context);
+}
+
+void SimpleRenderApp::OnContextReleased(CefRefPtr<CefBrowser> browser,
+                                        CefRefPtr<CefFrame> frame,
+                                        CefRefPtr<CefV8Context> context)
+{
+    messageRouter_->OnContextReleased(browser, frame, context);
+    NativeBindings::GetInstance()->OnContextReleased(context);
+}
+
+bool SimpleRenderApp::OnProcessMessageReceived(CefRefPtr<CefBrowser> browser,
+                                               CefProcessId source_process,
+                                               CefRefPtr<CefProcessMessage> message)
+{
+    if (message->GetName() == PAYLOADSHM_MESSAGE)
+    {
+        OnPayload(browser, message->GetArgumentList());
+        return true;
+    }
+
+    if (NativeBindings::GetInstance()->OnRendererMessage(browser, message))
+        return true;
+
+    return messageRouter_->OnProcessMessageReceived(browser, source_process, message);
+}
+
+void SimpleRenderApp::OnPayload(CefRefPtr<CefBrowser> browser, CefRefPtr<CefListValue> args)
+{
+    CefString topic = args->GetString(0);
+    CefString text;
+
+    if (args->GetSize() == 2)
+    {
+        text = args->GetString(1);
+    }
+    else
+    {
+        std::string name = args->GetString(1).ToString();
+        const unsigned offset = (unsigned)args->GetInt(2);
+        const unsigned length = (unsigned)args->GetInt(3);
+        const unsigned serial = (unsigned)args->GetInt(4);
+
+        PayloadShmReader *reader = payloadReaders_[name];
+        if (!reader)
+        {
+            reader = new PayloadShmReader;
+            if (!reader->Open(name))
+            {
+                // the writer frees the block once it's past the maximum age
+                LOG(ERROR) << "payload: failed to map " << name;
+                delete reader;
+                payloadReaders_.erase(name);
+                return;
+            }
+            payloadReaders_[name] = reader;
+        }
+
+        // read in place, the one utf-8 to utf-16 conversion v8 needs anyway
+        const char *data = reader->Acquire(offset, length, serial);
+        if (!data)
+        {
+            LOG(ERROR) << "payload: stale block at " << offset << " in " << name;
+            return;
+        }
+
+        cef_string_utf8_to_utf16(data, length, text.GetWritableStruct());
+        if (!reader->Release(offset, serial))
+        {
+            LOG(ERROR) << "payload: block at " << offset << " in " << name << " freed while read";
+            return;
+        }
+    }
+
+    CefRefPtr<CefV8Context> context = browser->GetMainFrame()->GetV8Context();
+    if (!context || !context->Enter())
+        return;
+
+    CefRefPtr<CefV8Value> handler = context->GetGlobal()->GetValue("onUrhoPayload");
+    if (handler && handler->IsFunction())
+    {
+        CefV8ValueList handlerArgs;
+        handlerArgs.push_back(CefV8Value::CreateString(topic));
+        handlerArgs.push_back(CefV8Value::CreateString(text));
+        handler->ExecuteFunction(NULL, handlerArgs);
+    }
+
+    context->Exit();
+}
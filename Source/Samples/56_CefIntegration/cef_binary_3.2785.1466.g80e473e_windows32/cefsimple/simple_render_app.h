@@ -0,0 +1,55 @@
+// Copyright (c) 2013 The Chromium Embedded Framework Authors. All rights
+// reserved. Use of this source code is governed by a BSD-style license that
+// can be found in the LICENSE file.
+
+#ifndef CEF_TESTS_CEFSIMPLE_SIMPLE_RENDER_APP_H_
+#define CEF_TESTS_CEFSIMPLE_SIMPLE_RENDER_APP_H_
+
+#include <map>
+#include <string>
+
+#include "include/cef_app.h"
+#include "include/wrapper/cef_message_router.h"
+
+#include "../../UPayloadShm.h"
+
+// LUMAK: application-level callbacks for the render process, passed to
+// CefExecuteProcess(). Installs the renderer side of the message router so
+// that window.cefQuery() is available to pages, and hands the payloads sent
+// with SimpleHandler::SendPayload() to window.onUrhoPayload(). The native
+// bindings (window.urho) are installed in every context.
+class SimpleRenderApp : public CefApp,
+                        public CefRenderProcessHandler {
+ public:
+  SimpleRenderApp();
+  ~SimpleRenderApp();
+
+  // CefApp methods:
+  virtual CefRefPtr<CefRenderProcessHandler> GetRenderProcessHandler() OVERRIDE { return this; }
+
+  // CefRenderProcessHandler methods:
+  virtual void OnWebKitInitialized() OVERRIDE;
+  virtual void OnContextCreated(CefRefPtr<CefBrowser> browser,
+                                CefRefPtr<CefFrame> frame,
+                                CefRefPtr<CefV8Context> context) OVERRIDE;
+  virtual void OnContextReleased(CefRefPtr<CefBrowser> browser,
+                                 CefRefPtr<CefFrame> frame,
+                                 CefRefPtr<CefV8Context> context) OVERRIDE;
+  virtual bool OnProcessMessageReceived(CefRefPtr<CefBrowser> browser,
+                                        CefProcessId source_process,
+                                        CefRefPtr<CefProcessMessage> message) OVERRIDE;
+
+ private:
+  void OnPayload(CefRefPtr<CefBrowser> browser, CefRefPtr<CefListValue> args);
+
+  CefRefPtr<CefMessageRouterRendererSide> messageRouter_;
+
+  // Rings of the sending processes, mapped on their first payload.
+  typedef std::map<std::string, PayloadShmReader*> PayloadReaderMap;
+  PayloadReaderMap payloadReaders_;
+
+  // Include the default reference counting implementation.
+  IMPLEMENT_REFCOUNTING(SimpleRenderApp);
+};
+
+#endif  // CEF_TESTS_CEFSIMPLE_SIMPLE_RENDER_APP_H_
@@ -92,6 +92,14 @@
 // a reason other than Callback::Failure being executed then the associated
 // Handler's OnQueryCanceled method will be called.
 //
+// LUMAK: error codes. Besides -1 for canceled queries, the router fails
+// queries on its own with codes from -1000 down to -1099:
+//   -1001  the query timed out, see |query_timeout_ms|.
+//   -1002  the query is over a rate limit, see |throttle_policy|.
+//   -1003  the query was replaced by an identical one, see THROTTLE_COALESCE.
+// Handlers should pass Callback::Failure codes outside -1 and that range, so
+// that a page can tell the router's failures from the application's.
+//
 // Some possible usage patterns include:
 //
 // One-time Request. Use a non-persistent query to send a JavaScript request.
@@ -206,6 +214,60 @@ struct CefMessageRouterConfig {
   // Name of the JavaScript function that will be added to the 'window' object
   // for canceling a pending query. The default value is "cefQueryCancel".
   CefString js_cancel_function;
+
+  // LUMAK: Non-persistent queries that are still pending this many
+  // milliseconds after a handler accepted them are failed with an error code
+  // of -1001, and Handler::OnQueryCanceled is called. Deadlines are checked with
+  // a granularity of 50 milliseconds. The default value of 0 lets queries
+  // pend until they're answered or canceled. Only used by the browser side.
+  int query_timeout_ms;
+
+  // LUMAK: Token bucket limit on the queries each browser may send, refilled
+  // at |browser_queries_per_second| up to |browser_query_burst| tokens. A burst
+  // of 0 uses the rate. The default value of 0 disables the limit. Limits on
+  // requests starting with a prefix are set with
+  // CefMessageRouterBrowserSide::SetRouteRateLimit(). Only used by the browser
+  // side.
+  int browser_queries_per_second;
+  int browser_query_burst;
+
+  // What happens to a query that is over a limit:
+  //   THROTTLE_QUEUE     waits in a per-browser queue of up to
+  //                      |throttle_queue_size| queries and is dispatched when
+  //                      the tokens refill, in order. A query arriving at a
+  //                      full queue fails with an error code of -1002.
+  //   THROTTLE_REJECT    fails right away with an error code of -1002.
+  //   THROTTLE_COALESCE  queues like THROTTLE_QUEUE, but takes the place of a
+  //                      queued identical non-persistent request from the same
+  //                      context. The older one fails with an error code of
+  //                      -1003.
+  // A query failed with -1002 also tells the renderer to back off: new queries
+  // matching the exhausted limit fail locally, without reaching the browser
+  // process, until a token is expected. The default is THROTTLE_QUEUE with a
+  // queue of 64 queries.
+  enum ThrottlePolicy {
+    THROTTLE_QUEUE,
+    THROTTLE_REJECT,
+    THROTTLE_COALESCE,
+  };
+  ThrottlePolicy throttle_policy;
+  int throttle_queue_size;
+};
+
+///
+// LUMAK: Throttling counters of the browser side router.
+///
+struct CefMessageRouterThrottleStats {
+  // Queries waiting in the throttle queues right now.
+  int queued;
+
+  // Totals since the router was created: queries that waited in a queue,
+  // queries failed for being over a limit, queued queries replaced by an
+  // identical one and back-off signals sent to renderers.
+  int delayed;
+  int rejected;
+  int coalesced;
+  int backoffs;
 };
 
 ///
@@ -296,6 +358,15 @@ class CefMessageRouterBrowserSide :
   ///
   virtual bool AddHandler(Handler* handler, bool first) =0;
 
+  ///
+  // LUMAK: Add a new query handler that is only offered requests starting with
+  // |request_prefix|, other queries skip it without a call. An empty prefix
+  // matches every request. Otherwise the same as AddHandler() above.
+  ///
+  virtual bool AddHandler(Handler* handler,
+                          bool first,
+                          const CefString& request_prefix) =0;
+
   ///
   // Remove an existing query handler. Any pending queries associated with the
   // handler will be canceled. Handler::OnQueryCanceled will be called and the
@@ -324,6 +395,33 @@ class CefMessageRouterBrowserSide :
   virtual int GetPendingCount(CefRefPtr<CefBrowser> browser,
                               Handler* handler) =0;
 
+  ///
+  // LUMAK: Returns the number of pending queries waiting on a deadline and the
+  // total number of queries that timed out since the router was created. See
+  // CefMessageRouterConfig::query_timeout_ms. Must be called on the browser
+  // process UI thread.
+  ///
+  virtual int GetDeadlineCount() =0;
+  virtual int GetTimedOutCount() =0;
+
+  ///
+  // LUMAK: Limit the queries starting with |request_prefix|, over all browsers,
+  // to a token bucket refilled at |queries_per_second| up to |burst| tokens. A
+  // burst of 0 uses the rate, a rate of 0 removes the limit. A query is checked
+  // against the first matching prefix in the order they were set, in addition
+  // to CefMessageRouterConfig::browser_queries_per_second. Must be called on
+  // the browser process UI thread.
+  ///
+  virtual void SetRouteRateLimit(const CefString& request_prefix,
+                                 int queries_per_second,
+                                 int burst) =0;
+
+  ///
+  // LUMAK: Returns the throttling counters. Must be called on the browser
+  // process UI thread.
+  ///
+  virtual void GetThrottleStats(CefMessageRouterThrottleStats* stats) =0;
+
 
   // The below methods should be called from other CEF handlers. They must be
   // called exactly as documented for the router to function correctly.
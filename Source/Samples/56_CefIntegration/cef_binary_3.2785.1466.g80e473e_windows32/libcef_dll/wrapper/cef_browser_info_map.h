@@ -6,8 +6,12 @@
 #define CEF_LIBCEF_DLL_WRAPPER_CEF_BROWSER_INFO_MAP_H_
 #pragma once
 
-#include <map>
+#include <stddef.h>
 
+#include <utility>
+#include <vector>
+
+#include "include/base/cef_basictypes.h"
 #include "include/base/cef_logging.h"
 #include "include/base/cef_macros.h"
 
@@ -20,7 +24,90 @@ struct DefaultCefBrowserInfoMapTraits {
   }
 };
 
+// Hash of the per-browser ID. Overload for other IdType values.
+inline size_t CefBrowserInfoIdHash(int64 id) {
+  return static_cast<size_t>(id ^ (id >> 32));
+}
+
+inline size_t CefBrowserInfoIdHash(const std::pair<int, int>& id) {
+  return static_cast<size_t>(id.first) * 31U + static_cast<size_t>(id.second);
+}
+
+// LUMAK: free-list pool for the fixed size records kept in the map. Records
+// are carved out of slabs that are never returned to the heap, so a steady
+// stream of queries doesn't allocate once the pool has warmed up. Not thread
+// safe, each record type is only created and deleted on one thread.
+template <typename T>
+class CefInfoRecordPool {
+ public:
+  static void* Allocate(size_t size) {
+    DCHECK_EQ(size, sizeof(T));
+    if (!free_list_)
+      AddSlab();
+    FreeRecord* record = free_list_;
+    free_list_ = record->next;
+    return record;
+  }
+
+  static void Free(void* ptr) {
+    if (!ptr)
+      return;
+    FreeRecord* record = static_cast<FreeRecord*>(ptr);
+    record->next = free_list_;
+    free_list_ = record;
+  }
+
+  static size_t GetSlabBytes() { return slab_bytes_; }
+
+ private:
+  enum { kRecordsPerSlab = 64 };
+
+  struct FreeRecord {
+    FreeRecord* next;
+  };
+
+  union Record {
+    FreeRecord free;
+    char data[sizeof(T)];
+    double align_double;
+    int64 align_int64;
+    void* align_ptr;
+  };
+
+  static void AddSlab() {
+    Record* slab = new Record[kRecordsPerSlab];
+    slab_bytes_ += sizeof(Record) * kRecordsPerSlab;
+    for (int i = kRecordsPerSlab - 1; i >= 0; --i)
+      Free(&slab[i]);
+  }
+
+  static FreeRecord* free_list_;
+  static size_t slab_bytes_;
+};
+
+template <typename T>
+typename CefInfoRecordPool<T>::FreeRecord* CefInfoRecordPool<T>::free_list_ =
+    NULL;
+template <typename T>
+size_t CefInfoRecordPool<T>::slab_bytes_ = 0;
+
+// Routes new/delete of |Type| through CefInfoRecordPool. Place in the record's
+// declaration.
+#define CEF_INFO_RECORD_POOLED(Type)                          \
+  static void* operator new(size_t size) {                    \
+    return CefInfoRecordPool<Type>::Allocate(size);           \
+  }                                                           \
+  static void operator delete(void* ptr) {                    \
+    CefInfoRecordPool<Type>::Free(ptr);                       \
+  }
+
 // Maps an arbitrary IdType to an arbitrary ObjectType on a per-browser basis.
+// LUMAK: a single open-addressing table keyed by (browser ID, IdType) instead
+// of a map of heap allocated maps, so Add/Find/remove don't allocate nodes.
+// Removed entries leave a tombstone that's reused or purged on the next grow,
+// which keeps slots stable while a Visitor removes entries. Slots never move
+// during a visit: the table grows before a visit starts, and an Add from a
+// Visitor fails once the room left is used up. Visiting order is unspecified.
 template <typename IdType,
           typename ObjectType,
           typename Traits = DefaultCefBrowserInfoMapTraits<ObjectType> >
@@ -44,61 +131,87 @@ class CefBrowserInfoMap {
     virtual ~Visitor() {}
   };
 
-  CefBrowserInfoMap() {}
+  CefBrowserInfoMap()
+      : count_(0),
+        tombstones_(0),
+        visiting_(0) {}
 
   ~CefBrowserInfoMap() {
     clear();
   }
 
-  // Add an object associated with the specified ID values.
-  void Add(int browser_id, IdType info_id, ObjectType info) {
-    InfoMap* info_map = NULL;
-    typename BrowserInfoMap::const_iterator it_browser =
-        browser_info_map_.find(browser_id);
-    if (it_browser == browser_info_map_.end()) {
-      // No InfoMap exists for the browser ID so create it.
-      info_map = new InfoMap;
-      browser_info_map_.insert(std::make_pair(browser_id, info_map));
-    } else {
-      info_map = it_browser->second;
+  // Add an object associated with the specified ID values. Returns false,
+  // leaving |info| to the caller, when called from a Visitor and the table
+  // has no room left for it.
+  bool Add(int browser_id, IdType info_id, ObjectType info) {
+    if ((count_ + tombstones_ + 1) * 4 > slots_.size() * 3) {
+      if (visiting_ == 0) {
+        Rehash();
+      } else if (count_ + tombstones_ + 1 >= slots_.size()) {
+        // Slots can't move under a Visitor, and probing needs an empty slot.
+        return false;
+      }
+    }
+
+    size_t mask = slots_.size() - 1;
+    size_t index = Hash(browser_id, info_id) & mask;
+    size_t insert_at = slots_.size();
+
+    for (;; index = (index + 1) & mask) {
+      Slot& slot = slots_[index];
+      if (slot.state == kEmpty) {
+        if (insert_at == slots_.size())
+          insert_at = index;
+        break;
+      }
+      if (slot.state == kDeleted) {
+        if (insert_at == slots_.size())
+          insert_at = index;
+        continue;
+      }
       // The specified ID should not already exist in the map.
-      DCHECK(info_map->find(info_id) == info_map->end());
+      DCHECK(!(slot.browser_id == browser_id && slot.info_id == info_id));
     }
 
-    info_map->insert(std::make_pair(info_id, info));
+    Slot& slot = slots_[insert_at];
+    if (slot.state == kDeleted)
+      tombstones_--;
+    slot.state = kUsed;
+    slot.browser_id = browser_id;
+    slot.info_id = info_id;
+    slot.info = info;
+    count_++;
+    AddBrowserCount(browser_id, 1);
+    return true;
   }
 
   // Find the object with the specified ID values. |visitor| can optionally be
   // used to evaluate or remove the object at the same time. If the object is
   // removed using the Visitor the caller is responsible for destroying it.
   ObjectType Find(int browser_id, IdType info_id, Visitor* vistor) {
-    if (browser_info_map_.empty())
+    if (count_ == 0)
       return ObjectType();
 
-    typename BrowserInfoMap::iterator it_browser =
-        browser_info_map_.find(browser_id);
-    if (it_browser == browser_info_map_.end())
-      return ObjectType();
+    if (vistor)
+      BeginVisit();
 
-    InfoMap* info_map = it_browser->second;
-    typename InfoMap::iterator it_info = info_map->find(info_id);
-    if (it_info == info_map->end())
+    size_t index = FindSlot(browser_id, info_id);
+    if (index == slots_.size()) {
+      if (vistor)
+        EndVisit();
       return ObjectType();
+    }
 
-    ObjectType info = it_info->second;
+    Slot& slot = slots_[index];
+    ObjectType info = slot.info;
 
     bool remove = false;
-    if (vistor)
-      vistor->OnNextInfo(browser_id, it_info->first, info, &remove);
-    if (remove) {
-      info_map->erase(it_info);
-
-      if (info_map->empty()) {
-        // No more entries in the InfoMap so remove it.
-        browser_info_map_.erase(it_browser);
-        delete info_map;
-      }
+    if (vistor) {
+      vistor->OnNextInfo(browser_id, slot.info_id, info, &remove);
+      EndVisit();
     }
+    if (remove)
+      RemoveSlot(index);
 
     return info;
   }
@@ -108,41 +221,23 @@ class CefBrowserInfoMap {
   void FindAll(Visitor* visitor) {
     DCHECK(visitor);
 
-    if (browser_info_map_.empty())
+    if (count_ == 0)
       return;
 
     bool remove, keepgoing = true;
 
-    typename BrowserInfoMap::iterator it_browser = browser_info_map_.begin();
-    while (it_browser != browser_info_map_.end()) {
-      InfoMap* info_map = it_browser->second;
-
-      typename InfoMap::iterator it_info = info_map->begin();
-      while (it_info != info_map->end()) {
-        remove = false;
-        keepgoing = visitor->OnNextInfo(it_browser->first, it_info->first,
-                                        it_info->second, &remove);
-
-        if (remove)
-          info_map->erase(it_info++);
-        else
-          ++it_info;
-
-        if (!keepgoing)
-          break;
-      }
-
-      if (info_map->empty()) {
-        // No more entries in the InfoMap so remove it.
-        browser_info_map_.erase(it_browser++);
-        delete info_map;
-      } else {
-        ++it_browser;
-      }
+    BeginVisit();
+    for (size_t i = 0; i < slots_.size() && keepgoing; ++i) {
+      if (slots_[i].state != kUsed)
+        continue;
 
-      if (!keepgoing)
-        break;
+      remove = false;
+      keepgoing = visitor->OnNextInfo(slots_[i].browser_id, slots_[i].info_id,
+                                      slots_[i].info, &remove);
+      if (remove)
+        RemoveSlot(i);
     }
+    EndVisit();
   }
 
   // Find all objects associated with the specified browser. If any objects are
@@ -150,113 +245,186 @@ class CefBrowserInfoMap {
   void FindAll(int browser_id, Visitor* visitor) {
     DCHECK(visitor);
 
-    if (browser_info_map_.empty())
+    size_t left = size(browser_id);
+    if (left == 0)
       return;
 
-    typename BrowserInfoMap::iterator it_browser =
-        browser_info_map_.find(browser_id);
-    if (it_browser == browser_info_map_.end())
-      return;
+    bool remove, keepgoing = true;
 
-    InfoMap* info_map = it_browser->second;
-    bool remove, keepgoing;
+    BeginVisit();
+    for (size_t i = 0; i < slots_.size() && left > 0 && keepgoing; ++i) {
+      if (slots_[i].state != kUsed || slots_[i].browser_id != browser_id)
+        continue;
 
-    typename InfoMap::iterator it_info = info_map->begin();
-    while (it_info != info_map->end()) {
+      left--;
       remove = false;
-      keepgoing = visitor->OnNextInfo(browser_id, it_info->first,
-                                      it_info->second, &remove);
-
+      keepgoing = visitor->OnNextInfo(browser_id, slots_[i].info_id,
+                                      slots_[i].info, &remove);
       if (remove)
-        info_map->erase(it_info++);
-      else
-        ++it_info;
-
-      if (!keepgoing)
-        break;
-    }
-
-    if (info_map->empty()) {
-      // No more entries in the InfoMap so remove it.
-      browser_info_map_.erase(it_browser);
-      delete info_map;
+        RemoveSlot(i);
     }
+    EndVisit();
   }
 
   // Returns true if the map is empty.
-  bool empty() const { return browser_info_map_.empty(); }
+  bool empty() const { return count_ == 0; }
 
   // Returns the number of objects in the map.
-  size_t size() const {
-    if (browser_info_map_.empty())
-      return 0;
-
-    size_t size = 0;
-    typename BrowserInfoMap::const_iterator it_browser =
-        browser_info_map_.begin();
-    for (; it_browser != browser_info_map_.end(); ++it_browser)
-      size += it_browser->second->size();
-    return size;
-  }
+  size_t size() const { return count_; }
 
   // Returns the number of objects in the map that are associated with the
   // specified browser.
   size_t size(int browser_id) const {
-    if (browser_info_map_.empty())
-      return 0;
-
-    typename BrowserInfoMap::const_iterator it_browser =
-        browser_info_map_.find(browser_id);
-    if (it_browser != browser_info_map_.end())
-      return it_browser->second->size();
-
+    for (size_t i = 0; i < browser_counts_.size(); ++i) {
+      if (browser_counts_[i].first == browser_id)
+        return browser_counts_[i].second;
+    }
     return 0;
   }
 
   // Remove all objects from the map. The objects will be destructed.
   void clear() {
-    if (browser_info_map_.empty())
+    if (count_ == 0)
       return;
 
-    typename BrowserInfoMap::const_iterator it_browser =
-        browser_info_map_.begin();
-    for (; it_browser != browser_info_map_.end(); ++it_browser) {
-      InfoMap* info_map = it_browser->second;
-      typename InfoMap::const_iterator it_info = info_map->begin();
-      for (; it_info != info_map->end(); ++it_info)
-        Traits::Destruct(it_info->second);
-      delete info_map;
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      if (slots_[i].state == kUsed)
+        Traits::Destruct(slots_[i].info);
     }
-    browser_info_map_.clear();
+
+    slots_.clear();
+    browser_counts_.clear();
+    count_ = 0;
+    tombstones_ = 0;
   }
 
   // Remove all objects from the map that are associated with the specified
   // browser. The objects will be destructed.
   void clear(int browser_id) {
-    if (browser_info_map_.empty())
-      return;
+    size_t left = size(browser_id);
 
-    typename BrowserInfoMap::iterator it_browser =
-        browser_info_map_.find(browser_id);
-    if (it_browser == browser_info_map_.end())
-      return;
+    for (size_t i = 0; i < slots_.size() && left > 0; ++i) {
+      if (slots_[i].state != kUsed || slots_[i].browser_id != browser_id)
+        continue;
 
-    InfoMap* info_map = it_browser->second;
-    typename InfoMap::const_iterator it_info = info_map->begin();
-    for (; it_info != info_map->end(); ++it_info)
-      Traits::Destruct(it_info->second);
-
-    browser_info_map_.erase(it_browser);
-    delete info_map;
+      left--;
+      ObjectType info = slots_[i].info;
+      RemoveSlot(i);
+      Traits::Destruct(info);
+    }
   }
 
  private:
-  // Map IdType to ObjectType instance.
-  typedef std::map<IdType, ObjectType> InfoMap;
-  // Map browser ID to InfoMap instance.
-  typedef std::map<int, InfoMap*> BrowserInfoMap;
+  enum SlotState {
+    kEmpty = 0,
+    kUsed,
+    kDeleted,
+  };
+
+  struct Slot {
+    Slot() : state(kEmpty), browser_id(0), info_id(), info() {}
+
+    int state;
+    int browser_id;
+    IdType info_id;
+    ObjectType info;
+  };
+
+  static size_t Hash(int browser_id, const IdType& info_id) {
+    size_t hash = CefBrowserInfoIdHash(info_id) ^
+                  (static_cast<size_t>(browser_id) * 0x9E3779B1U);
+    hash *= 0x85EBCA6BU;
+    return hash ^ (hash >> 16);
+  }
+
+  size_t FindSlot(int browser_id, const IdType& info_id) const {
+    size_t mask = slots_.size() - 1;
+    size_t index = Hash(browser_id, info_id) & mask;
+
+    for (;; index = (index + 1) & mask) {
+      const Slot& slot = slots_[index];
+      if (slot.state == kEmpty)
+        return slots_.size();
+      if (slot.state == kUsed && slot.browser_id == browser_id &&
+          slot.info_id == info_id) {
+        return index;
+      }
+    }
+  }
+
+  void RemoveSlot(size_t index) {
+    Slot& slot = slots_[index];
+    AddBrowserCount(slot.browser_id, -1);
+    slot.state = kDeleted;
+    slot.info = ObjectType();
+    count_--;
+    tombstones_++;
+
+    // Nothing left, start over without tombstones.
+    if (count_ == 0 && visiting_ == 0) {
+      for (size_t i = 0; i < slots_.size(); ++i)
+        slots_[i].state = kEmpty;
+      tombstones_ = 0;
+    }
+  }
+
+  // Leaves a Visitor room to Add a quarter of the table before Add fails.
+  void BeginVisit() {
+    if (visiting_ == 0 && (count_ + tombstones_ + 1) * 4 > slots_.size() * 3)
+      Rehash();
+    visiting_++;
+  }
+
+  void EndVisit() {
+    DCHECK_GT(visiting_, 0);
+    visiting_--;
+  }
+
+  // Grows when live entries need it, otherwise only purges tombstones.
+  void Rehash() {
+    size_t capacity = slots_.empty() ? 16 : slots_.size();
+    while ((count_ + 1) * 2 > capacity)
+      capacity *= 2;
+
+    std::vector<Slot> old_slots(capacity);
+    old_slots.swap(slots_);
+    tombstones_ = 0;
+
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < old_slots.size(); ++i) {
+      if (old_slots[i].state != kUsed)
+        continue;
+
+      size_t index = Hash(old_slots[i].browser_id, old_slots[i].info_id) & mask;
+      while (slots_[index].state != kEmpty)
+        index = (index + 1) & mask;
+      slots_[index] = old_slots[i];
+    }
+  }
+
+  void AddBrowserCount(int browser_id, int delta) {
+    for (size_t i = 0; i < browser_counts_.size(); ++i) {
+      if (browser_counts_[i].first == browser_id) {
+        browser_counts_[i].second += delta;
+        if (browser_counts_[i].second == 0) {
+          browser_counts_[i] = browser_counts_.back();
+          browser_counts_.pop_back();
+        }
+        return;
+      }
+    }
+    DCHECK_GT(delta, 0);
+    browser_counts_.push_back(std::make_pair(browser_id, 1U));
+  }
+
+  // Open-addressing table, size is zero or a power of two.
+  std::vector<Slot> slots_;
+  size_t count_;
+  size_t tombstones_;
+  int visiting_;
 
-  BrowserInfoMap browser_info_map_;
+  // Live entries per browser, there are only ever a few browsers.
+  std::vector<std::pair<int, size_t> > browser_counts_;
 
   DISALLOW_COPY_AND_ASSIGN(CefBrowserInfoMap);
 };
@@ -4,15 +4,28 @@
 
 #include "include/wrapper/cef_message_router.h"
 
+#include <string.h>
+
+#include <deque>
 #include <map>
-#include <set>
+#include <utility>
+#include <vector>
+
+#include "include/base/cef_build.h"
+#if defined(OS_WIN)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
 
 #include "include/base/cef_bind.h"
 #include "include/base/cef_macros.h"
+#include "include/base/cef_ref_counted.h"
 #include "include/cef_task.h"
 #include "include/wrapper/cef_closure_task.h"
 #include "include/wrapper/cef_helpers.h"
 #include "libcef_dll/wrapper/cef_browser_info_map.h"
+#include "libcef_dll/wrapper/cef_timer_wheel.h"
 
 namespace {
 
@@ -22,6 +35,16 @@ const int kReservedId = 0;
 // Appended to the JS function name for related IPC messages.
 const char kMessageSuffix[] = "Msg";
 
+// LUMAK: appended to the JS query function name for batched responses.
+const char kBatchMessageSuffix[] = "BatchMsg";
+
+// LUMAK: appended to the JS query function name for back-off signals.
+const char kThrottleMessageSuffix[] = "ThrottleMsg";
+
+// Values per response in a batch: context ID, request ID, success flag,
+// error code and the response or error message.
+const int kBatchStride = 5;
+
 // JS object member argument names for cefQuery.
 const char kMemberRequest[] = "request";
 const char kMemberOnSuccess[] = "onSuccess";
@@ -32,6 +55,27 @@ const char kMemberPersistent[] = "persistent";
 const int kCanceledErrorCode = -1;
 const char kCanceledErrorMessage[] = "The query has been canceled";
 
+// LUMAK: the router's own error codes are in [-1099, -1000], clear of the
+// codes applications pass to Callback::Failure. See cef_message_router.h.
+// Error information when a query misses its deadline.
+const int kTimeoutErrorCode = -1001;
+const char kTimeoutErrorMessage[] = "The query has timed out";
+
+// Granularity of query deadlines, in milliseconds.
+const int kDeadlineTickMs = 50;
+
+// LUMAK: error information when a query is over a rate limit, or replaced by
+// an identical one while throttled.
+const int kThrottledErrorCode = -1002;
+const char kThrottledErrorMessage[] = "The query is over the rate limit";
+const int kCoalescedErrorCode = -1003;
+const char kCoalescedErrorMessage[] =
+    "The query has been replaced by an identical one";
+
+// Shortest and longest back-off asked of a renderer, in milliseconds.
+const int kMinBackoffMs = 50;
+const int kMaxBackoffMs = 5000;
+
 // Validate configuration settings.
 bool ValidateConfig(CefMessageRouterConfig& config) {
   // Must specify function names.
@@ -43,6 +87,79 @@ bool ValidateConfig(CefMessageRouterConfig& config) {
   return true;
 }
 
+// Monotonic clock for query deadlines, in milliseconds.
+int64 GetMonotonicMs() {
+#if defined(OS_WIN)
+  return static_cast<int64>(GetTickCount64());
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+int64 GetDeadlineTick() {
+  return GetMonotonicMs() / kDeadlineTickMs;
+}
+
+// Returns true if |request| starts with |prefix|. An empty prefix matches
+// every request.
+bool MatchesPrefix(const CefString& request, const CefString& prefix) {
+  const size_t length = prefix.length();
+  if (length == 0)
+    return true;
+  return request.length() >= length &&
+         memcmp(request.c_str(), prefix.c_str(),
+                length * sizeof(CefString::char_type)) == 0;
+}
+
+// LUMAK: token bucket for query rate limits. A rate of 0 is unlimited.
+class TokenBucket {
+ public:
+  TokenBucket()
+      : rate_(0),
+        burst_(0),
+        tokens_(0),
+        last_ms_(0) {}
+
+  // Starts full.
+  void Configure(int rate, int burst, int64 now_ms) {
+    rate_ = rate > 0 ? rate : 0;
+    burst_ = burst > 0 ? burst : rate_;
+    tokens_ = burst_;
+    last_ms_ = now_ms;
+  }
+
+  void Refill(int64 now_ms) {
+    if (rate_ == 0 || now_ms <= last_ms_)
+      return;
+    tokens_ += static_cast<double>(now_ms - last_ms_) * rate_ / 1000.0;
+    if (tokens_ > burst_)
+      tokens_ = burst_;
+    last_ms_ = now_ms;
+  }
+
+  bool HasToken() const { return rate_ == 0 || tokens_ >= 1.0; }
+
+  void Take() {
+    if (rate_ != 0)
+      tokens_ -= 1.0;
+  }
+
+  // Milliseconds until the next token, 0 if there is one.
+  int64 MsUntilToken() const {
+    if (HasToken())
+      return 0;
+    return static_cast<int64>((1.0 - tokens_) * 1000.0 / rate_) + 1;
+  }
+
+ private:
+  int rate_;
+  int burst_;
+  double tokens_;
+  int64 last_ms_;
+};
+
 // Helper template for generated ID values.
 template <typename T>
 class IdGenerator {
@@ -93,14 +210,16 @@ class CefMessageRouterBrowserSideImpl : public CefMessageRouterBrowserSide {
       }
 
       if (router_) {
-        CefPostTask(TID_UI,
-            base::Bind(&CefMessageRouterBrowserSideImpl::OnCallbackSuccess,
-                       router_.get(), browser_id_, query_id_, response));
+        // LUMAK: already on the UI thread, no second hop. The response is
+        // queued and goes out with the others of this tick.
+        CefRefPtr<CefMessageRouterBrowserSideImpl> router = router_;
 
         if (!persistent_) {
           // Non-persistent callbacks are only good for a single use.
           router_ = NULL;
         }
+
+        router->OnCallbackSuccess(browser_id_, query_id_, response);
       }
     }
 
@@ -115,13 +234,13 @@ class CefMessageRouterBrowserSideImpl : public CefMessageRouterBrowserSide {
       }
 
       if (router_) {
-        CefPostTask(TID_UI,
-            base::Bind(&CefMessageRouterBrowserSideImpl::OnCallbackFailure,
-                       router_.get(), browser_id_, query_id_, error_code,
-                       error_message));
+        CefRefPtr<CefMessageRouterBrowserSideImpl> router = router_;
 
         // Failure always invalidates the callback.
         router_ = NULL;
+
+        router->OnCallbackFailure(browser_id_, query_id_, error_code,
+                                  error_message);
       }
     }
 
@@ -144,31 +263,65 @@ class CefMessageRouterBrowserSideImpl : public CefMessageRouterBrowserSide {
         query_message_name_(
           config.js_query_function.ToString() + kMessageSuffix),
         cancel_message_name_(
-          config.js_cancel_function.ToString() + kMessageSuffix) {
+          config.js_cancel_function.ToString() + kMessageSuffix),
+        batch_message_name_(
+          config.js_query_function.ToString() + kBatchMessageSuffix),
+        throttle_message_name_(
+          config.js_query_function.ToString() + kThrottleMessageSuffix),
+        flush_posted_(false),
+        handlers_(new HandlerSnapshot),
+        deadlines_(GetDeadlineTick()),
+        deadline_tick_posted_(false),
+        timed_out_count_(0),
+        drain_posted_(false) {
+    memset(&throttle_stats_, 0, sizeof(throttle_stats_));
   }
 
   virtual ~CefMessageRouterBrowserSideImpl() {
     // There should be no pending queries when the router is deleted.
     DCHECK(browser_query_info_map_.empty());
+    DCHECK_EQ(throttle_stats_.queued, 0);
   }
 
   virtual bool AddHandler(Handler* handler, bool first) OVERRIDE {
+    return AddHandler(handler, first, CefString());
+  }
+
+  virtual bool AddHandler(Handler* handler,
+                          bool first,
+                          const CefString& request_prefix) OVERRIDE {
     CEF_REQUIRE_UI_THREAD();
-    if (handler_set_.find(handler) == handler_set_.end()) {
-      handler_set_.insert(
-          first ? handler_set_.begin() : handler_set_.end(), handler);
-      return true;
-    }
-    return false;
+    if (handlers_->Contains(handler))
+      return false;
+
+    // Copy-on-write, queries being dispatched keep the old snapshot.
+    HandlerEntry entry;
+    entry.handler = handler;
+    entry.prefix = request_prefix;
+
+    scoped_refptr<HandlerSnapshot> handlers(new HandlerSnapshot);
+    handlers->entries = handlers_->entries;
+    handlers->entries.insert(
+        first ? handlers->entries.begin() : handlers->entries.end(), entry);
+    handlers_ = handlers;
+    return true;
   }
 
   virtual bool RemoveHandler(Handler* handler) OVERRIDE {
     CEF_REQUIRE_UI_THREAD();
-    if (handler_set_.erase(handler) > 0) {
-      CancelPendingFor(NULL, handler, true);
-      return true;
+    if (!handlers_->Contains(handler))
+      return false;
+
+    scoped_refptr<HandlerSnapshot> handlers(new HandlerSnapshot);
+    handlers->entries.reserve(handlers_->entries.size() - 1);
+    for (size_t i = 0; i < handlers_->entries.size(); ++i) {
+      if (handlers_->entries[i].handler != handler)
+        handlers->entries.push_back(handlers_->entries[i]);
     }
-    return false;
+    handlers_ = handlers;
+
+    CancelPendingFor(NULL, handler, true);
+    return true;
   }
 
   virtual void CancelPending(CefRefPtr<CefBrowser> browser,
@@ -229,8 +382,50 @@ class CefMessageRouterBrowserSideImpl : public CefMessageRouterBrowserSide {
     return 0;
   }
 
+  virtual int GetDeadlineCount() OVERRIDE {
+    CEF_REQUIRE_UI_THREAD();
+    return static_cast<int>(deadlines_.size());
+  }
+
+  virtual int GetTimedOutCount() OVERRIDE {
+    CEF_REQUIRE_UI_THREAD();
+    return timed_out_count_;
+  }
+
+  virtual void SetRouteRateLimit(const CefString& request_prefix,
+                                 int queries_per_second,
+                                 int burst) OVERRIDE {
+    CEF_REQUIRE_UI_THREAD();
+
+    std::vector<RouteLimit>::iterator it = route_limits_.begin();
+    for (; it != route_limits_.end(); ++it) {
+      if (it->prefix == request_prefix)
+        break;
+    }
+
+    if (queries_per_second <= 0) {
+      if (it != route_limits_.end())
+        route_limits_.erase(it);
+      return;
+    }
+
+    if (it == route_limits_.end()) {
+      route_limits_.push_back(RouteLimit());
+      it = route_limits_.end() - 1;
+      it->prefix = request_prefix;
+    }
+    it->bucket.Configure(queries_per_second, burst, GetMonotonicMs());
+  }
+
+  virtual void GetThrottleStats(
+      CefMessageRouterThrottleStats* stats) OVERRIDE {
+    CEF_REQUIRE_UI_THREAD();
+    *stats = throttle_stats_;
+  }
+
   virtual void OnBeforeClose(CefRefPtr<CefBrowser> browser) OVERRIDE {
     CancelPendingFor(browser, NULL, false);
+    ReleaseThrottle(browser->GetIdentifier());
   }
 
   virtual void OnRenderProcessTerminated(
@@ -262,62 +457,22 @@ class CefMessageRouterBrowserSideImpl : public CefMessageRouterBrowserSide {
       const CefString& request = args->GetString(5);
       const bool persistent = args->GetBool(6);
 
-      if (handler_set_.empty()) {
+      if (handlers_->entries.empty()) {
         // No handlers so cancel the query.
         CancelUnhandledQuery(browser, context_id, request_id);
         return true;
       }
 
-      const int browser_id = browser->GetIdentifier();
-      const int64 query_id = query_id_generator_.GetNextId();
-
-      CefRefPtr<CefFrame> frame;
-      if (is_main_frame)
-        frame = browser->GetMainFrame();
-      else
-        frame = browser->GetFrame(frame_id);
-      CefRefPtr<CallbackImpl> callback(
-          new CallbackImpl(this, browser_id, query_id, persistent));
-    
-      // Make a copy of the handler list in case the user adds or removes a
-      // handler while we're iterating.
-      HandlerSet handler_set = handler_set_;
-
-      bool handled = false;
-      HandlerSet::const_iterator it_handler = handler_set.begin();
-      for (; it_handler != handler_set.end(); ++it_handler) {
-        handled = (*it_handler)->OnQuery(browser, frame, query_id, request,
-                                         persistent, callback.get());
-        if (handled)
-          break;
-      }
-
-      // If the query isn't handled nothing should be keeping a reference to
-      // the callback.
-      DCHECK(handled || callback->HasOneRef());
-
-      if (handled) {
-        // Persist the query information until the callback executes.
-        // It's safe to do this here because the callback will execute
-        // asynchronously.
-        QueryInfo* info = new QueryInfo;
-        info->browser = browser;
-        info->frame_id = frame_id;
-        info->is_main_frame = is_main_frame;
-        info->context_id = context_id;
-        info->request_id = request_id;
-        info->persistent = persistent;
-        info->callback = callback;
-        info->handler = *(it_handler);
-        browser_query_info_map_.Add(browser_id, query_id, info);
-      } else {
-        // Invalidate the callback.
-        callback->Detach();
-
-        // No one chose to handle the query so cancel it.
-        CancelUnhandledQuery(browser, context_id, request_id);
+      // LUMAK: over the limit queries are queued or failed here, before a
+      // handler or the QueryInfo map sees them.
+      if (IsThrottling() &&
+          ThrottleQuery(browser, frame_id, is_main_frame, context_id,
+                        request_id, request, persistent)) {
+        return true;
       }
 
+      DispatchQuery(browser, frame_id, is_main_frame, context_id, request_id,
+                    request, persistent);
       return true;
     } else if (message_name == cancel_message_name_) {
       CefRefPtr<CefListValue> args = message->GetArgumentList();
@@ -335,6 +490,117 @@ class CefMessageRouterBrowserSideImpl : public CefMessageRouterBrowserSide {
   }
 
  private:
+  typedef std::pair<int, int64> QueryKey;
+  typedef CefTimerWheel<QueryKey> QueryDeadlines;
+
+  // A query waiting in a throttle queue, not seen by any handler yet.
+  struct ThrottledQuery {
+    CefRefPtr<CefBrowser> browser;
+    int64 frame_id;
+    bool is_main_frame;
+    int context_id;
+    int request_id;
+    CefString request;
+    bool persistent;
+  };
+
+  // Rate limit and queue of one browser. |backoff_until| holds when the last
+  // back-off signal per request prefix runs out, the empty prefix standing for
+  // the browser limit.
+  struct BrowserThrottle {
+    TokenBucket bucket;
+    std::deque<ThrottledQuery> queue;
+    std::map<CefString, int64> backoff_until;
+  };
+
+  // Rate limit of the requests starting with |prefix|, shared by all
+  // browsers.
+  struct RouteLimit {
+    CefString prefix;
+    TokenBucket bucket;
+  };
+
+  // Offer a query to the handlers.
+  void DispatchQuery(CefRefPtr<CefBrowser> browser,
+                     int64 frame_id,
+                     bool is_main_frame,
+                     int context_id,
+                     int request_id,
+                     const CefString& request,
+                     bool persistent) {
+    const int browser_id = browser->GetIdentifier();
+    const int64 query_id = query_id_generator_.GetNextId();
+
+    CefRefPtr<CefFrame> frame;
+    if (is_main_frame)
+      frame = browser->GetMainFrame();
+    else
+      frame = browser->GetFrame(frame_id);
+    CefRefPtr<CallbackImpl> callback(
+        new CallbackImpl(this, browser_id, query_id, persistent));
+
+    // Persist the query information before the handlers see it, a handler
+    // may answer synchronously now that callbacks don't post to the UI
+    // thread.
+    QueryInfo* info = new QueryInfo;
+    info->browser = browser;
+    info->frame_id = frame_id;
+    info->is_main_frame = is_main_frame;
+    info->context_id = context_id;
+    info->request_id = request_id;
+    info->persistent = persistent;
+    info->callback = callback;
+    info->handler = NULL;
+    if (!browser_query_info_map_.Add(browser_id, query_id, info)) {
+      // LUMAK: only from a Visitor, when the table has no room left.
+      callback->Detach();
+      delete info;
+      SendQueryFailure(browser, context_id, request_id, kCanceledErrorCode,
+                       kCanceledErrorMessage);
+      return;
+    }
+
+    // Hold a reference to the current snapshot in case the user adds or
+    // removes a handler while we're iterating, no copy needed.
+    scoped_refptr<HandlerSnapshot> handlers = handlers_;
+
+    bool handled = false;
+    Handler* handler = NULL;
+    for (size_t i = 0; i < handlers->entries.size(); ++i) {
+      const HandlerEntry& entry = handlers->entries[i];
+      if (!entry.Matches(request))
+        continue;
+
+      handled = entry.handler->OnQuery(browser, frame, query_id, request,
+                                       persistent, callback.get());
+      if (handled) {
+        handler = entry.handler;
+        break;
+      }
+    }
+
+    if (handled) {
+      // Record the handler, unless it already completed the query.
+      info = browser_query_info_map_.Find(browser_id, query_id, NULL);
+      if (info) {
+        info->handler = handler;
+        if (!persistent && config_.query_timeout_ms > 0)
+          ArmDeadline(browser_id, query_id, info);
+      }
+    } else {
+      bool removed;
+      info = GetQueryInfo(browser_id, query_id, true, &removed);
+      if (info)
+        delete info;
+
+      // Invalidate the callback.
+      callback->Detach();
+
+      // No one chose to handle the query so cancel it.
+      CancelUnhandledQuery(browser, context_id, request_id);
+    }
+  }
+
   // Structure representing a pending query.
   struct QueryInfo {
     // Browser and frame originated the query.
@@ -357,6 +623,12 @@ class CefMessageRouterBrowserSideImpl : public CefMessageRouterBrowserSide {
 
     // Handler that should be notified if the query is automatically canceled.
     Handler* handler;
+
+    // Armed while the query waits on a deadline. Disarmed when the QueryInfo
+    // is deleted, whichever way the query ends.
+    QueryDeadlines::Node deadline;
+
+    CEF_INFO_RECORD_POOLED(QueryInfo)
   };
 
   // Retrieve a QueryInfo object from the map based on the browser-side query
@@ -438,14 +710,7 @@ class CefMessageRouterBrowserSideImpl : public CefMessageRouterBrowserSide {
                         int context_id,
                         int request_id,
                         const CefString& response) {
-    CefRefPtr<CefProcessMessage> message =
-        CefProcessMessage::Create(query_message_name_);
-    CefRefPtr<CefListValue> args = message->GetArgumentList();
-    args->SetInt(0, context_id);
-    args->SetInt(1, request_id);
-    args->SetBool(2, true);  // Indicates a success result.
-    args->SetString(3, response);
-    browser->SendProcessMessage(PID_RENDERER, message);
+    QueueResponse(browser, context_id, request_id, true, 0, response);
   }
 
   void SendQueryFailure(QueryInfo* info,
@@ -460,15 +725,65 @@ class CefMessageRouterBrowserSideImpl : public CefMessageRouterBrowserSide {
                         int request_id,
                         int error_code,
                         const CefString& error_message) {
-    CefRefPtr<CefProcessMessage> message =
-        CefProcessMessage::Create(query_message_name_);
-    CefRefPtr<CefListValue> args = message->GetArgumentList();
-    args->SetInt(0, context_id);
-    args->SetInt(1, request_id);
-    args->SetBool(2, false);  // Indicates a failure result.
-    args->SetInt(3, error_code);
-    args->SetString(4, error_message);
-    browser->SendProcessMessage(PID_RENDERER, message);
+    QueueResponse(browser, context_id, request_id, false, error_code,
+                  error_message);
+  }
+
+  // LUMAK: responses are appended to a per-browser batch and sent together
+  // by a single task at the end of the current UI thread tick. |context_id|
+  // identifies the frame, so one message per browser covers all its frames.
+  void QueueResponse(CefRefPtr<CefBrowser> browser,
+                     int context_id,
+                     int request_id,
+                     bool is_success,
+                     int error_code,
+                     const CefString& text) {
+    CEF_REQUIRE_UI_THREAD();
+
+    const int browser_id = browser->GetIdentifier();
+    ResponseBatch* batch = NULL;
+    for (size_t i = 0; i < response_batches_.size(); ++i) {
+      if (response_batches_[i].browser_id == browser_id) {
+        batch = &response_batches_[i];
+        break;
+      }
+    }
+
+    if (!batch) {
+      response_batches_.push_back(ResponseBatch());
+      batch = &response_batches_.back();
+      batch->browser_id = browser_id;
+      batch->browser = browser;
+      batch->message = CefProcessMessage::Create(batch_message_name_);
+      batch->count = 0;
+    }
+
+    CefRefPtr<CefListValue> args = batch->message->GetArgumentList();
+    const size_t base = batch->count * kBatchStride;
+    args->SetInt(base, context_id);
+    args->SetInt(base + 1, request_id);
+    args->SetBool(base + 2, is_success);
+    args->SetInt(base + 3, error_code);
+    args->SetString(base + 4, text);
+    batch->count++;
+
+    if (!flush_posted_) {
+      flush_posted_ = true;
+      CefPostTask(TID_UI,
+          base::Bind(&CefMessageRouterBrowserSideImpl::FlushResponses, this));
+    }
+  }
+
+  // Send the responses queued since the last flush, one message per browser.
+  void FlushResponses() {
+    CEF_REQUIRE_UI_THREAD();
+
+    flush_posted_ = false;
+
+    std::vector<ResponseBatch> batches;
+    batches.swap(response_batches_);
+    for (size_t i = 0; i < batches.size(); ++i)
+      batches[i].browser->SendProcessMessage(PID_RENDERER, batches[i].message);
   }
 
   // Cancel a query that has not been sent to a handler.
@@ -488,12 +803,308 @@ class CefMessageRouterBrowserSideImpl : public CefMessageRouterBrowserSide {
       frame = info->browser->GetMainFrame();
     else
       frame = info->browser->GetFrame(info->frame_id);
-    info->handler->OnQueryCanceled(info->browser, frame, query_id);
+    // The handler is unset while the query is still being dispatched.
+    if (info->handler)
+      info->handler->OnQueryCanceled(info->browser, frame, query_id);
 
     // Invalidate the callback.
     info->callback->Detach();
   }
 
+  // LUMAK: fail the query with a timeout if it's still pending after
+  // |query_timeout_ms|. Deadlines are rounded up to the next tick.
+  void ArmDeadline(int browser_id, int64 query_id, QueryInfo* info) {
+    const int64 ticks =
+        (config_.query_timeout_ms + kDeadlineTickMs - 1) / kDeadlineTickMs;
+    info->deadline.value = std::make_pair(browser_id, query_id);
+    deadlines_.Add(&info->deadline, GetDeadlineTick() + ticks);
+
+    // The tick task only runs while there are deadlines.
+    if (!deadline_tick_posted_) {
+      deadline_tick_posted_ = true;
+      CefPostDelayedTask(TID_UI,
+          base::Bind(&CefMessageRouterBrowserSideImpl::OnDeadlineTick, this),
+          kDeadlineTickMs);
+    }
+  }
+
+  void OnDeadlineTick() {
+    CEF_REQUIRE_UI_THREAD();
+
+    deadline_tick_posted_ = false;
+
+    // Expired queries are looked up again by ID, a handler notified of one
+    // timeout may complete or cancel the others.
+    std::vector<QueryKey> expired;
+    deadlines_.Advance(GetDeadlineTick(), &expired);
+    for (size_t i = 0; i < expired.size(); ++i) {
+      bool removed;
+      QueryInfo* info = GetQueryInfo(expired[i].first, expired[i].second, true,
+                                     &removed);
+      if (!info)
+        continue;
+
+      SendQueryFailure(info, kTimeoutErrorCode, kTimeoutErrorMessage);
+      CancelQuery(expired[i].second, info, false);
+      delete info;
+      timed_out_count_++;
+    }
+
+    if (!deadlines_.empty() && !deadline_tick_posted_) {
+      deadline_tick_posted_ = true;
+      CefPostDelayedTask(TID_UI,
+          base::Bind(&CefMessageRouterBrowserSideImpl::OnDeadlineTick, this),
+          kDeadlineTickMs);
+    }
+  }
+
+  bool IsThrottling() const {
+    return config_.browser_queries_per_second > 0 || !route_limits_.empty();
+  }
+
+  // The first route limit matching |request|, NULL if there's none.
+  RouteLimit* FindRouteLimit(const CefString& request) {
+    for (size_t i = 0; i < route_limits_.size(); ++i) {
+      if (MatchesPrefix(request, route_limits_[i].prefix))
+        return &route_limits_[i];
+    }
+    return NULL;
+  }
+
+  BrowserThrottle* GetBrowserThrottle(int browser_id, int64 now_ms) {
+    BrowserThrottleMap::iterator it = browser_throttles_.find(browser_id);
+    if (it == browser_throttles_.end()) {
+      it = browser_throttles_.insert(
+          std::make_pair(browser_id, BrowserThrottle())).first;
+      it->second.bucket.Configure(config_.browser_queries_per_second,
+                                  config_.browser_query_burst, now_ms);
+    }
+    return &it->second;
+  }
+
+  // Takes a token from both buckets, or from neither.
+  static bool TakeToken(BrowserThrottle* throttle, RouteLimit* route,
+                        int64 now_ms) {
+    throttle->bucket.Refill(now_ms);
+    if (route)
+      route->bucket.Refill(now_ms);
+    if (!throttle->bucket.HasToken() || (route && !route->bucket.HasToken()))
+      return false;
+    throttle->bucket.Take();
+    if (route)
+      route->bucket.Take();
+    return true;
+  }
+
+  // LUMAK: apply the rate limits to a new query. Returns false if the query
+  // should be dispatched now, true if it was queued or failed. Queries of a
+  // browser with a non-empty queue wait behind it to keep their order.
+  bool ThrottleQuery(CefRefPtr<CefBrowser> browser,
+                     int64 frame_id,
+                     bool is_main_frame,
+                     int context_id,
+                     int request_id,
+                     const CefString& request,
+                     bool persistent) {
+    const int64 now_ms = GetMonotonicMs();
+    BrowserThrottle* throttle =
+        GetBrowserThrottle(browser->GetIdentifier(), now_ms);
+    RouteLimit* route = FindRouteLimit(request);
+
+    if (throttle->queue.empty() && TakeToken(throttle, route, now_ms))
+      return false;
+
+    if (config_.throttle_policy == CefMessageRouterConfig::THROTTLE_REJECT) {
+      RejectQuery(browser, context_id, request_id, throttle, route, now_ms);
+      return true;
+    }
+
+    if (config_.throttle_policy == CefMessageRouterConfig::THROTTLE_COALESCE &&
+        !persistent) {
+      std::deque<ThrottledQuery>::iterator it = throttle->queue.begin();
+      for (; it != throttle->queue.end(); ++it) {
+        if (it->context_id == context_id && !it->persistent &&
+            it->request == request) {
+          SendQueryFailure(browser, context_id, it->request_id,
+                           kCoalescedErrorCode, kCoalescedErrorMessage);
+          it->frame_id = frame_id;
+          it->is_main_frame = is_main_frame;
+          it->request_id = request_id;
+          throttle_stats_.coalesced++;
+          return true;
+        }
+      }
+    }
+
+    if (static_cast<int>(throttle->queue.size()) >=
+        config_.throttle_queue_size) {
+      RejectQuery(browser, context_id, request_id, throttle, route, now_ms);
+      return true;
+    }
+
+    ThrottledQuery query;
+    query.browser = browser;
+    query.frame_id = frame_id;
+    query.is_main_frame = is_main_frame;
+    query.context_id = context_id;
+    query.request_id = request_id;
+    query.request = request;
+    query.persistent = persistent;
+    throttle->queue.push_back(query);
+    throttle_stats_.queued++;
+    throttle_stats_.delayed++;
+
+    int64 wait_ms = throttle->bucket.MsUntilToken();
+    if (route && route->bucket.MsUntilToken() > wait_ms)
+      wait_ms = route->bucket.MsUntilToken();
+    PostDrain(wait_ms);
+    return true;
+  }
+
+  // Fail an over the limit query and ask the renderer to back off from the
+  // exhausted limit, once per back-off period.
+  void RejectQuery(CefRefPtr<CefBrowser> browser,
+                   int context_id,
+                   int request_id,
+                   BrowserThrottle* throttle,
+                   RouteLimit* route,
+                   int64 now_ms) {
+    SendQueryFailure(browser, context_id, request_id, kThrottledErrorCode,
+                     kThrottledErrorMessage);
+    throttle_stats_.rejected++;
+
+    CefString prefix;
+    int64 wait_ms = throttle->bucket.MsUntilToken();
+    if (wait_ms == 0 && route) {
+      prefix = route->prefix;
+      wait_ms = route->bucket.MsUntilToken();
+    }
+    if (wait_ms == 0) {
+      // Only the queue is full, it drains at the token rate.
+      return;
+    }
+
+    int64& backoff_until = throttle->backoff_until[prefix];
+    if (now_ms < backoff_until)
+      return;
+
+    if (wait_ms < kMinBackoffMs)
+      wait_ms = kMinBackoffMs;
+    else if (wait_ms > kMaxBackoffMs)
+      wait_ms = kMaxBackoffMs;
+    backoff_until = now_ms + wait_ms;
+
+    CefRefPtr<CefProcessMessage> message =
+        CefProcessMessage::Create(throttle_message_name_);
+    CefRefPtr<CefListValue> args = message->GetArgumentList();
+    args->SetString(0, prefix);
+    args->SetInt(1, static_cast<int>(wait_ms));
+    browser->SendProcessMessage(PID_RENDERER, message);
+    throttle_stats_.backoffs++;
+  }
+
+  void PostDrain(int64 delay_ms) {
+    if (drain_posted_)
+      return;
+    drain_posted_ = true;
+    CefPostDelayedTask(TID_UI,
+        base::Bind(&CefMessageRouterBrowserSideImpl::DrainThrottled, this),
+        delay_ms > 0 ? delay_ms : 1);
+  }
+
+  // Dispatch the queued queries the buckets have refilled for.
+  void DrainThrottled() {
+    CEF_REQUIRE_UI_THREAD();
+
+    drain_posted_ = false;
+
+    const int64 now_ms = GetMonotonicMs();
+    int64 wait_ms = -1;
+
+    // A handler may cancel queries while we dispatch, so the queues are
+    // looked up again for every query.
+    std::vector<int> browser_ids;
+    BrowserThrottleMap::const_iterator it = browser_throttles_.begin();
+    for (; it != browser_throttles_.end(); ++it) {
+      if (!it->second.queue.empty())
+        browser_ids.push_back(it->first);
+    }
+
+    for (size_t i = 0; i < browser_ids.size(); ++i) {
+      for (;;) {
+        BrowserThrottleMap::iterator it_throttle =
+            browser_throttles_.find(browser_ids[i]);
+        if (it_throttle == browser_throttles_.end() ||
+            it_throttle->second.queue.empty()) {
+          break;
+        }
+
+        BrowserThrottle* throttle = &it_throttle->second;
+        RouteLimit* route = FindRouteLimit(throttle->queue.front().request);
+        if (!TakeToken(throttle, route, now_ms)) {
+          int64 wait = throttle->bucket.MsUntilToken();
+          if (route && route->bucket.MsUntilToken() > wait)
+            wait = route->bucket.MsUntilToken();
+          if (wait_ms < 0 || wait < wait_ms)
+            wait_ms = wait;
+          break;
+        }
+
+        ThrottledQuery query = throttle->queue.front();
+        throttle->queue.pop_front();
+        throttle_stats_.queued--;
+
+        DispatchQuery(query.browser, query.frame_id, query.is_main_frame,
+                      query.context_id, query.request_id, query.request,
+                      query.persistent);
+      }
+    }
+
+    if (wait_ms >= 0)
+      PostDrain(wait_ms);
+  }
+
+  // Remove queued queries. |browser_id|, |context_id| and |request_id| each
+  // match everything when kReservedId. Set |notify_renderer| to true if the
+  // renderer should be notified.
+  void DropThrottled(int browser_id, int context_id, int request_id,
+                     bool notify_renderer) {
+    BrowserThrottleMap::iterator it = browser_throttles_.begin();
+    for (; it != browser_throttles_.end(); ++it) {
+      if (browser_id != kReservedId && it->first != browser_id)
+        continue;
+
+      std::deque<ThrottledQuery>& queue = it->second.queue;
+      std::deque<ThrottledQuery>::iterator it_query = queue.begin();
+      while (it_query != queue.end()) {
+        if ((context_id == kReservedId || it_query->context_id == context_id) &&
+            (request_id == kReservedId || it_query->request_id == request_id)) {
+          if (notify_renderer) {
+            CancelUnhandledQuery(it_query->browser, it_query->context_id,
+                                 it_query->request_id);
+          }
+          it_query = queue.erase(it_query);
+          throttle_stats_.queued--;
+        } else {
+          ++it_query;
+        }
+      }
+    }
+  }
+
+  // Forget the buckets of a closed browser.
+  void ReleaseThrottle(int browser_id) {
+    if (!CefCurrentlyOn(TID_UI)) {
+      CefPostTask(TID_UI,
+          base::Bind(&CefMessageRouterBrowserSideImpl::ReleaseThrottle, this,
+                     browser_id));
+      return;
+    }
+
+    DropThrottled(browser_id, kReservedId, kReservedId, false);
+    browser_throttles_.erase(browser_id);
+  }
+
   // Cancel all pending queries associated with either |browser| or |handler|.
   // If both |browser| and |handler| are NULL all pending queries will be
   // canceled. Set |notify_renderer| to true if the renderer should be notified.
@@ -508,6 +1119,12 @@ class CefMessageRouterBrowserSideImpl : public CefMessageRouterBrowserSide {
       return;
     }
 
+    // Queued queries don't have a handler yet.
+    if (!handler && throttle_stats_.queued > 0) {
+      DropThrottled(browser.get() ? browser->GetIdentifier() : kReservedId,
+                    kReservedId, kReservedId, notify_renderer);
+    }
+
     if (browser_query_info_map_.empty())
       return;
 
@@ -553,6 +1170,9 @@ class CefMessageRouterBrowserSideImpl : public CefMessageRouterBrowserSide {
   // Cancel a query based on the renderer-side IDs. If |request_id| is
   // kReservedId all requests associated with |context_id| will be canceled.
   void CancelPendingRequest(int browser_id, int context_id, int request_id) {
+    if (throttle_stats_.queued > 0)
+      DropThrottled(browser_id, context_id, request_id, false);
+
     class Visitor : public BrowserQueryInfoMap::Visitor {
      public:
       Visitor(CefMessageRouterBrowserSideImpl* router,
@@ -591,16 +1211,75 @@ class CefMessageRouterBrowserSideImpl : public CefMessageRouterBrowserSide {
   const CefMessageRouterConfig config_;
   const std::string query_message_name_;
   const std::string cancel_message_name_;
+  const std::string batch_message_name_;
+  const std::string throttle_message_name_;
 
   IdGenerator<int64> query_id_generator_;
 
-  // Set of currently registered handlers. An entry is added when a handler is
-  // registered and removed when a handler is unregistered.
-  typedef std::set<Handler*> HandlerSet;
-  HandlerSet handler_set_;
+  // Responses for one browser waiting for the next flush.
+  struct ResponseBatch {
+    int browser_id;
+    CefRefPtr<CefBrowser> browser;
+    CefRefPtr<CefProcessMessage> message;
+    size_t count;
+  };
+
+  // Only accessed on the UI thread.
+  std::vector<ResponseBatch> response_batches_;
+  bool flush_posted_;
 
-  // Map of query ID to QueryInfo instance. An entry is added when a Handler
-  // indicates that it will handle the query and removed when either the query
+  // A registered handler and the request prefix it's offered, if any.
+  struct HandlerEntry {
+    bool Matches(const CefString& request) const {
+      return MatchesPrefix(request, prefix);
+    }
+
+    Handler* handler;
+    CefString prefix;
+  };
+
+  // Immutable list of handlers in call order. Only accessed on the UI thread.
+  class HandlerSnapshot : public base::RefCounted<HandlerSnapshot> {
+   public:
+    HandlerSnapshot() {}
+
+    bool Contains(Handler* handler) const {
+      for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].handler == handler)
+          return true;
+      }
+      return false;
+    }
+
+    std::vector<HandlerEntry> entries;
+
+   private:
+    friend class base::RefCounted<HandlerSnapshot>;
+    ~HandlerSnapshot() {}
+
+    DISALLOW_COPY_AND_ASSIGN(HandlerSnapshot);
+  };
+
+  // Currently registered handlers. Replaced, never modified, when a handler
+  // is registered or unregistered.
+  scoped_refptr<HandlerSnapshot> handlers_;
+
+  // Deadlines of the pending non-persistent queries, keyed by browser ID and
+  // query ID. Declared before the map so it outlives the QueryInfo objects.
+  // Only accessed on the UI thread.
+  QueryDeadlines deadlines_;
+  bool deadline_tick_posted_;
+  int timed_out_count_;
+
+  // Only accessed on the UI thread.
+  typedef std::map<int, BrowserThrottle> BrowserThrottleMap;
+  BrowserThrottleMap browser_throttles_;
+  std::vector<RouteLimit> route_limits_;
+  bool drain_posted_;
+  CefMessageRouterThrottleStats throttle_stats_;
+
+  // Map of query ID to QueryInfo instance. An entry is added when a query
+  // is dispatched to the handlers and removed when either the query
   // is completed via the Callback, the query is explicitly canceled from the
   // renderer process, or the associated context is (or will be) released.
   typedef CefBrowserInfoMap<int64, QueryInfo*> BrowserQueryInfoMap;
@@ -686,6 +1365,10 @@ class CefMessageRouterRendererSideImpl : public CefMessageRouterRendererSide {
         const int request_id = router_->SendQuery(
             context->GetBrowser(), frame_id, is_main_frame, context_id,
             requestVal->GetStringValue(), persistent, successVal, failureVal);
+        if (request_id == kReservedId) {
+          exception = "Too many pending queries";
+          return true;
+        }
         retval = CefV8Value::CreateInt(request_id);
         return true;
       } else if (name == config_.js_cancel_function) {
@@ -729,7 +1412,11 @@ class CefMessageRouterRendererSideImpl : public CefMessageRouterRendererSide {
         query_message_name_(
           config.js_query_function.ToString() + kMessageSuffix),
         cancel_message_name_(
-          config.js_cancel_function.ToString() + kMessageSuffix) {
+          config.js_cancel_function.ToString() + kMessageSuffix),
+        batch_message_name_(
+          config.js_query_function.ToString() + kBatchMessageSuffix),
+        throttle_message_name_(
+          config.js_query_function.ToString() + kThrottleMessageSuffix) {
   }
 
   virtual ~CefMessageRouterRendererSideImpl() {
@@ -865,6 +1552,27 @@ class CefMessageRouterRendererSideImpl : public CefMessageRouterRendererSide {
       }
 
       return true;
+    } else if (message_name == batch_message_name_) {
+      // LUMAK: one task runs every callback in the batch. The message's own
+      // list is only valid for the duration of this call.
+      CefRefPtr<CefListValue> args = message->GetArgumentList();
+      DCHECK_EQ(args->GetSize() % kBatchStride, 0U);
+
+      CefPostTask(TID_RENDERER,
+          base::Bind(
+              &CefMessageRouterRendererSideImpl::ExecuteBatchCallbacks, this,
+              browser->GetIdentifier(), args->Copy()));
+
+      return true;
+    } else if (message_name == throttle_message_name_) {
+      // LUMAK: the browser process is throttling queries of this browser
+      // that start with the prefix, an empty one meaning all of them.
+      CefRefPtr<CefListValue> args = message->GetArgumentList();
+      DCHECK_EQ(args->GetSize(), 2U);
+
+      SetBackoff(browser->GetIdentifier(), args->GetString(0),
+                 GetMonotonicMs() + args->GetInt(1));
+      return true;
     }
 
     return false;
@@ -881,6 +1589,15 @@ class CefMessageRouterRendererSideImpl : public CefMessageRouterRendererSide {
 
     // Failure callback function. May be NULL.
     CefRefPtr<CefV8Value> failure_callback;
+
+    CEF_INFO_RECORD_POOLED(RequestInfo)
+  };
+
+  // Queries starting with |prefix| fail locally until |until_ms|.
+  struct Backoff {
+    int browser_id;
+    CefString prefix;
+    int64 until_ms;
   };
 
   // Retrieve a RequestInfo object from the map based on the renderer-side
@@ -922,7 +1639,7 @@ class CefMessageRouterRendererSideImpl : public CefMessageRouterRendererSide {
     return info;
   }
 
-  // Returns the new request ID.
+  // Returns the new request ID, or kReservedId if it couldn't be recorded.
   int SendQuery(CefRefPtr<CefBrowser> browser,
                 int64 frame_id,
                 bool is_main_frame,
@@ -939,8 +1656,24 @@ class CefMessageRouterRendererSideImpl : public CefMessageRouterRendererSide {
     info->persistent = persistent;
     info->success_callback = success_callback;
     info->failure_callback = failure_callback;
-    browser_request_info_map_.Add(browser->GetIdentifier(),
-        std::make_pair(context_id, request_id), info);
+    if (!browser_request_info_map_.Add(browser->GetIdentifier(),
+            std::make_pair(context_id, request_id), info)) {
+      // LUMAK: a query sent from a callback run by a Visitor, when the
+      // table has no room left. The caller throws.
+      delete info;
+      return kReservedId;
+    }
+
+    if (!backoffs_.empty() && IsBackedOff(browser->GetIdentifier(), request)) {
+      // LUMAK: the browser process would reject it, don't send it. The
+      // callback runs asynchronously like any other response.
+      CefPostTask(TID_RENDERER,
+          base::Bind(
+              &CefMessageRouterRendererSideImpl::ExecuteFailureCallback, this,
+              browser->GetIdentifier(), context_id, request_id,
+              kThrottledErrorCode, CefString(kThrottledErrorMessage)));
+      return request_id;
+    }
 
     CefRefPtr<CefProcessMessage> message =
         CefProcessMessage::Create(query_message_name_);
@@ -959,6 +1692,42 @@ class CefMessageRouterRendererSideImpl : public CefMessageRouterRendererSide {
     return request_id;
   }
 
+  void SetBackoff(int browser_id, const CefString& prefix, int64 until_ms) {
+    for (size_t i = 0; i < backoffs_.size(); ++i) {
+      if (backoffs_[i].browser_id == browser_id &&
+          backoffs_[i].prefix == prefix) {
+        backoffs_[i].until_ms = until_ms;
+        return;
+      }
+    }
+
+    Backoff backoff;
+    backoff.browser_id = browser_id;
+    backoff.prefix = prefix;
+    backoff.until_ms = until_ms;
+    backoffs_.push_back(backoff);
+  }
+
+  // Returns true if |request| is under a back-off signal. Expired signals are
+  // removed on the way.
+  bool IsBackedOff(int browser_id, const CefString& request) {
+    const int64 now_ms = GetMonotonicMs();
+    bool backed_off = false;
+
+    std::vector<Backoff>::iterator it = backoffs_.begin();
+    while (it != backoffs_.end()) {
+      if (it->until_ms <= now_ms) {
+        it = backoffs_.erase(it);
+        continue;
+      }
+      if (it->browser_id == browser_id && MatchesPrefix(request, it->prefix))
+        backed_off = true;
+      ++it;
+    }
+
+    return backed_off;
+  }
+
   // If |request_id| is kReservedId all requests associated with |context_id|
   // will be canceled, otherwise only the specified |request_id| will be
   // canceled. Returns true if any request was canceled. 
@@ -1049,6 +1818,26 @@ class CefMessageRouterRendererSideImpl : public CefMessageRouterRendererSide {
       delete info;
   }
 
+  // Execute the callbacks for each response in a batch, in the order the
+  // browser process completed them.
+  void ExecuteBatchCallbacks(int browser_id, CefRefPtr<CefListValue> args) {
+    CEF_REQUIRE_RENDERER_THREAD();
+
+    const size_t size = args->GetSize();
+    for (size_t base = 0; base + kBatchStride <= size; base += kBatchStride) {
+      const int context_id = args->GetInt(base);
+      const int request_id = args->GetInt(base + 1);
+      if (args->GetBool(base + 2)) {
+        ExecuteSuccessCallback(browser_id, context_id, request_id,
+                               args->GetString(base + 4));
+      } else {
+        ExecuteFailureCallback(browser_id, context_id, request_id,
+                               args->GetInt(base + 3),
+                               args->GetString(base + 4));
+      }
+    }
+  }
+
   // Execute the onFailure JavaScript callback.
   void ExecuteFailureCallback(int browser_id, int context_id, int request_id,
                               int error_code, const CefString& error_message) {
@@ -1113,6 +1902,8 @@ class CefMessageRouterRendererSideImpl : public CefMessageRouterRendererSide {
   const CefMessageRouterConfig config_;
   const std::string query_message_name_;
   const std::string cancel_message_name_;
+  const std::string batch_message_name_;
+  const std::string throttle_message_name_;
 
   IdGenerator<int> context_id_generator_;
   IdGenerator<int> request_id_generator_;
@@ -1131,6 +1922,9 @@ class CefMessageRouterRendererSideImpl : public CefMessageRouterRendererSide {
   typedef std::map<int, CefRefPtr<CefV8Context> > ContextMap;
   ContextMap context_map_;
 
+  // Back-off signals from the browser process. Only a handful at a time.
+  std::vector<Backoff> backoffs_;
+
   DISALLOW_COPY_AND_ASSIGN(CefMessageRouterRendererSideImpl);
 };
 
@@ -1138,7 +1932,12 @@ class CefMessageRouterRendererSideImpl : public CefMessageRouterRendererSide {
 
 CefMessageRouterConfig::CefMessageRouterConfig()
   : js_query_function("cefQuery"),
-    js_cancel_function("cefQueryCancel") {
+    js_cancel_function("cefQueryCancel"),
+    query_timeout_ms(0),
+    browser_queries_per_second(0),
+    browser_query_burst(0),
+    throttle_policy(THROTTLE_QUEUE),
+    throttle_queue_size(64) {
 }
 
 // static
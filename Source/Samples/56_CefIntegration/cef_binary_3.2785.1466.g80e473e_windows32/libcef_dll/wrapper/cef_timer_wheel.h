@@ -0,0 +1,203 @@
+// Copyright (c) 2014 The Chromium Embedded Framework Authors. All rights
+// reserved. Use of this source code is governed by a BSD-style license that
+// can be found in the LICENSE file.
+
+#ifndef CEF_LIBCEF_DLL_WRAPPER_CEF_TIMER_WHEEL_H_
+#define CEF_LIBCEF_DLL_WRAPPER_CEF_TIMER_WHEEL_H_
+#pragma once
+
+#include <stddef.h>
+
+#include <vector>
+
+#include "include/base/cef_basictypes.h"
+#include "include/base/cef_logging.h"
+#include "include/base/cef_macros.h"
+
+// LUMAK: hierarchical timer wheel for coarse deadlines. Time is counted in
+// ticks chosen by the owner. Four levels of 64 slots cover 2^24 ticks, later
+// deadlines are clamped to that. Adding and removing a node is O(1), a node
+// is moved down at most three times before it expires. Nodes are intrusive,
+// so arming a deadline doesn't allocate. Not thread safe.
+template <typename T>
+class CefTimerWheel {
+ public:
+  // Embed in the record that owns the deadline. |value| is handed back when
+  // the deadline expires. A node disarms itself when it's destroyed.
+  class Node {
+   public:
+    Node()
+        : value(),
+          wheel_(NULL),
+          prev_(this),
+          next_(this),
+          expires_(0) {}
+
+    ~Node() {
+      if (wheel_)
+        wheel_->Remove(this);
+    }
+
+    bool IsArmed() const { return wheel_ != NULL; }
+    int64 expires() const { return expires_; }
+
+    T value;
+
+   private:
+    friend class CefTimerWheel;
+
+    CefTimerWheel* wheel_;
+    Node* prev_;
+    Node* next_;
+    int64 expires_;
+
+    DISALLOW_COPY_AND_ASSIGN(Node);
+  };
+
+  // |now| is the current tick.
+  explicit CefTimerWheel(int64 now)
+      : next_(now + 1),
+        size_(0) {}
+
+  ~CefTimerWheel() {
+    for (int level = 0; level < kLevels; ++level) {
+      for (int slot = 0; slot < kSlots; ++slot) {
+        Node* head = &slots_[level][slot];
+        while (head->next_ != head)
+          Remove(head->next_);
+      }
+    }
+  }
+
+  // Arm |node| to expire at tick |expires|, rearming it if it's already armed.
+  // Deadlines that already passed expire on the next Advance().
+  void Add(Node* node, int64 expires) {
+    if (node->wheel_)
+      Remove(node);
+
+    node->expires_ = expires < next_ ? next_ : expires;
+    node->wheel_ = this;
+    Link(node);
+    ++size_;
+  }
+
+  // Disarm |node|.
+  void Remove(Node* node) {
+    DCHECK_EQ(node->wheel_, this);
+    Unlink(node);
+    node->wheel_ = NULL;
+    --size_;
+  }
+
+  // Advance to tick |now| and append the values of the expired nodes to
+  // |expired| in deadline order. The nodes are disarmed before they're
+  // reported, so the owner may delete them right away.
+  void Advance(int64 now, std::vector<T>* expired) {
+    if (size_ == 0) {
+      // Nothing to cascade, skip the idle ticks.
+      if (now >= next_)
+        next_ = now + 1;
+      return;
+    }
+
+    while (next_ <= now && size_ > 0) {
+      const int index = static_cast<int>(next_ & kSlotMask);
+
+      // Entering a new lap of a level moves the nodes of its next slot down.
+      if (index == 0) {
+        for (int level = 1; level < kLevels; ++level) {
+          const int slot = static_cast<int>(
+              (next_ >> (level * kSlotBits)) & kSlotMask);
+          Cascade(level, slot);
+          if (slot != 0)
+            break;
+        }
+      }
+
+      ++next_;
+
+      Node* head = &slots_[0][index];
+      while (head->next_ != head) {
+        Node* node = head->next_;
+        Remove(node);
+        expired->push_back(node->value);
+      }
+    }
+
+    if (next_ <= now)
+      next_ = now + 1;
+  }
+
+  // Number of armed nodes.
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+ private:
+  enum {
+    kLevels = 4,
+    kSlotBits = 6,
+    kSlots = 1 << kSlotBits,
+    kSlotMask = kSlots - 1,
+  };
+
+  void Link(Node* node) {
+    int64 delta = node->expires_ - next_;
+    const int64 max_delta = (static_cast<int64>(1) << (kLevels * kSlotBits)) - 1;
+    if (delta > max_delta) {
+      delta = max_delta;
+      node->expires_ = next_ + delta;
+    }
+
+    int level = 0;
+    while (level < kLevels - 1 &&
+           delta >= (static_cast<int64>(1) << ((level + 1) * kSlotBits))) {
+      ++level;
+    }
+
+    const int slot = static_cast<int>(
+        (node->expires_ >> (level * kSlotBits)) & kSlotMask);
+    Node* head = &slots_[level][slot];
+    node->prev_ = head->prev_;
+    node->next_ = head;
+    head->prev_->next_ = node;
+    head->prev_ = node;
+  }
+
+  static void Unlink(Node* node) {
+    node->prev_->next_ = node->next_;
+    node->next_->prev_ = node->prev_;
+    node->prev_ = node->next_ = node;
+  }
+
+  // Relink the nodes of one slot now that they're closer to expiring.
+  void Cascade(int level, int slot) {
+    Node* head = &slots_[level][slot];
+    Node list;
+    if (head->next_ == head)
+      return;
+
+    // Detach the whole slot first, relinking may append to the same list.
+    list.next_ = head->next_;
+    list.prev_ = head->prev_;
+    list.next_->prev_ = &list;
+    list.prev_->next_ = &list;
+    head->next_ = head->prev_ = head;
+
+    while (list.next_ != &list) {
+      Node* node = list.next_;
+      Unlink(node);
+      Link(node);
+    }
+  }
+
+  // Slot list heads, never armed themselves.
+  Node slots_[kLevels][kSlots];
+
+  // Next tick to process.
+  int64 next_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(CefTimerWheel);
+};
+
+#endif  // CEF_LIBCEF_DLL_WRAPPER_CEF_TIMER_WHEEL_H_